@@ -24,7 +24,9 @@
 #ifndef FCPP_VALIDATIONS_H
 #define FCPP_VALIDATIONS_H
 
+#include <optional>
 #include <sstream>
+#include <stdexcept>
 #include <string>
 
 namespace fcpp::asserts {
@@ -37,10 +39,14 @@ namespace fcpp::asserts {
 class invariant {
 private:
   const bool condition_;
-  std::stringstream message_;
+  // Only built once violated, so invariants that hold don't allocate.
+  std::optional<std::stringstream> message_;
 
-  invariant(bool condition, std::string message)
-      : condition_(condition), message_(message) {}
+  invariant(bool condition) : condition_(condition) {
+    if (!condition_) {
+      message_.emplace();
+    }
+  }
 
   // https://herbsutter.com/2014/05/03/reader-qa-how-can-i-prevent-a-type-from-being-instantiated-on-the-stack/
   invariant() = delete;
@@ -52,7 +58,7 @@ public:
       // Living dangerously, guaranteed not to live on the stack though. See
       // above link.
       throw std::invalid_argument(  // lgtm [cpp/throw-in-destructor]
-          message_.str());
+          message_->str());
     }
   }
 
@@ -66,7 +72,9 @@ public:
    */
   template <typename Text>
   friend invariant &&operator<<(invariant &&item, const Text &text) {
-    item.message_ << text;
+    if (item.message_) {
+      *item.message_ << text;
+    }
     return std::move(item);
   }
 
@@ -79,7 +87,7 @@ public:
    * @param condition Any predicate that affirms the invariant condition.
    * @return invariant Item holding invariant evaluation.
    */
-  static invariant eval(bool condition) { return invariant(condition, ""); }
+  static invariant eval(bool condition) { return invariant(condition); }
 };
 
 } // namespace fcpp::asserts
@@ -0,0 +1,219 @@
+/**
+ * @file generator.h
+ * @author Andrew Walsh (awalsh128@gmail.com)
+ * @brief Coroutine generators that produce items on demand for lazy streams.
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef FCPP_GENERATOR_H
+#define FCPP_GENERATOR_H
+
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "asserts.h"
+#include "stream.h"
+
+namespace fcpp {
+
+/**
+ * @brief Coroutine that yields items one at a time, only running when the
+ * next item is asked for.
+ *
+ * @code
+ * fcpp::Generator<int> naturals() {
+ *   for (int i = 0;; i++) {
+ *     co_yield i;
+ *   }
+ * }
+ *
+ * auto evens = fcpp::query(naturals())
+ *     .where([](const int &x) { return x % 2 == 0; })
+ *     .take(10)
+ *     .to_vector();
+ * @endcode
+ *
+ * @tparam T Type of items to yield.
+ */
+template <typename T>
+class Generator final {
+public:
+  /**
+   * @brief Coroutine state holding the last yielded item.
+   */
+  class promise_type final {
+  public:
+    Generator<T> get_return_object();
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    std::suspend_always final_suspend() noexcept { return {}; }
+    std::suspend_always yield_value(T item);
+    void return_void() {}
+    void unhandled_exception();
+
+  private:
+    friend class Generator<T>;
+
+    std::optional<T> current_;
+    std::exception_ptr error_;
+  };
+
+  Generator() = delete;
+  /**
+   * @brief Destroys the coroutine, even if it has not finished.
+   */
+  ~Generator();
+  /**
+   * @brief Move constructor.
+   */
+  Generator(Generator &&other) noexcept;
+  /**
+   * @brief Copy constructor.
+   * @remark Not allowed since a coroutine can only be resumed by one owner.
+   */
+  Generator(const Generator &) = delete;
+  /**
+   * @brief Copy assignment operator.
+   * @remark Not allowed since a coroutine can only be resumed by one owner.
+   * @return Generator&
+   */
+  Generator &operator=(const Generator &) = delete;
+
+  /**
+   * @brief Resumes the coroutine until it yields the next item or returns.
+   *
+   * Exceptions thrown by the coroutine are rethrown here.
+   *
+   * @return std::optional<T> The item or std::nullopt once the coroutine has
+   * returned.
+   */
+  std::optional<T> next();
+
+private:
+  explicit Generator(std::coroutine_handle<promise_type> handle);
+
+  std::coroutine_handle<promise_type> handle_;
+};
+
+/**
+ * @brief Queries the items of a generator lazily.
+ *
+ * The generator is only resumed for as many items as are pulled through the
+ * stream, so infinite generators can be queried with operations like
+ * @ref Stream<T>::take or @ref Stream<T>::first_or_default.
+ *
+ * @tparam T Type of items the generator yields.
+ * @param generator Generator to pull the items from.
+ * @param morsel_size Maximum number of items to pull at a time.
+ * @return Stream<T>
+ */
+template <typename T>
+Stream<T>
+query(Generator<T> generator, size_t morsel_size = kDefaultMorselSize);
+
+} // namespace fcpp
+
+/******************************************************************************
+ *
+ * @brief Keep definitions separate to allow the declarations to stay clean and
+ * compact.
+ *
+ *****************************************************************************/
+
+namespace fcpp {
+
+template <typename T>
+Generator<T> Generator<T>::promise_type::get_return_object() {
+  return Generator<T>(
+      std::coroutine_handle<promise_type>::from_promise(*this));
+}
+
+template <typename T>
+std::suspend_always Generator<T>::promise_type::yield_value(T item) {
+  current_.emplace(std::move(item));
+  return {};
+}
+
+template <typename T>
+void Generator<T>::promise_type::unhandled_exception() {
+  error_ = std::current_exception();
+}
+
+template <typename T>
+Generator<T>::Generator(std::coroutine_handle<promise_type> handle)
+    : handle_(handle) {}
+
+template <typename T>
+Generator<T>::~Generator() {
+  if (handle_) {
+    handle_.destroy();
+  }
+}
+
+template <typename T>
+Generator<T>::Generator(Generator &&other) noexcept
+    : handle_(std::exchange(other.handle_, nullptr)) {}
+
+template <typename T>
+std::optional<T> Generator<T>::next() {
+  asserts::invariant::eval(static_cast<bool>(handle_))
+      << "Generator was moved from.";
+  if (handle_.done()) {
+    return std::nullopt;
+  }
+  promise_type &promise = handle_.promise();
+  promise.current_.reset();
+  handle_.resume();
+  if (promise.error_) {
+    std::rethrow_exception(std::exchange(promise.error_, nullptr));
+  }
+  return std::move(promise.current_);
+}
+
+template <typename T>
+Stream<T> query(Generator<T> generator, size_t morsel_size) {
+  // Shared since sources must be copyable and generators are not.
+  auto shared = std::make_shared<Generator<T>>(std::move(generator));
+  return Stream<T>(
+      [shared](size_t limit) -> std::optional<typename Stream<T>::Task> {
+        // Resumed here rather than in the task since a coroutine must be
+        // resumed in order, one item at a time.
+        std::vector<T> morsel;
+        while (morsel.size() < limit) {
+          std::optional<T> item = shared->next();
+          if (!item) {
+            break;
+          }
+          morsel.push_back(std::move(*item));
+        }
+        if (morsel.empty()) {
+          return std::nullopt;
+        }
+        return Stream<T>::ready(std::move(morsel));
+      },
+      morsel_size);
+}
+
+} // namespace fcpp
+
+#endif // FCPP_GENERATOR_H
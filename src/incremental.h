@@ -0,0 +1,630 @@
+/**
+ * @file incremental.h
+ * @author Andrew Walsh (awalsh128@gmail.com)
+ * @brief Materialized queries over append only sources that are updated with
+ * each appended batch instead of being recomputed.
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef FCPP_INCREMENTAL_H
+#define FCPP_INCREMENTAL_H
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <set>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "traits.h"
+
+namespace fcpp::incremental {
+
+template <typename T, typename State>
+class View;
+
+template <typename U>
+class Collected;
+
+template <typename U>
+class Distinct;
+
+template <typename K, typename U, typename KeySelector>
+class Grouped;
+
+template <typename U, typename A, typename AccumulateFn>
+class Accumulated;
+
+template <typename K, typename U, typename A, typename KeySelector,
+          typename AccumulateFn>
+class KeyedAccumulated;
+
+template <typename U, typename Less>
+class TopK;
+
+/**
+ * @brief Query over the batches appended to a source, built up like a
+ * @ref Queryable<T> and ended by the operation to keep materialized.
+ *
+ * Item by item operations (@ref where, @ref select) are applied to every
+ * appended batch only. The ending operation keeps the state it needs (the
+ * outputs, a distinct set, group or aggregate tables, a top-k heap) so that
+ * each batch updates its result in time proportional to the batch.
+ *
+ * @code
+ * auto totals = fcpp::incremental::query<Trade>()
+ *     .where([](const Trade &trade) { return trade.settled; })
+ *     .keyed_accumulate(
+ *         [](const Trade &trade) { return trade.account; }, 0.0,
+ *         [](double total, const Trade &trade) {
+ *           return total + trade.amount;
+ *         });
+ * totals.append(read_new_trades());
+ * const std::map<int, double> &by_account = totals.result();
+ * @endcode
+ *
+ * @tparam T Type of items appended to the source.
+ * @tparam U Type of items produced by the operations so far.
+ */
+template <typename T, typename U = T>
+class Query final {
+public:
+  /**
+   * @brief Applies the operations so far to an appended batch.
+   */
+  typedef std::function<std::vector<U>(std::vector<T>)> Delta;
+
+  /**
+   * @brief Construct a new Query object from the operations to apply to each
+   * batch.
+   *
+   * @param delta Operations to apply to each batch.
+   */
+  explicit Query(Delta delta);
+  Query() = delete;
+
+  /**
+   * @brief Keeps a running accumulation of all items.
+   *
+   * @tparam A Accumulating value type.
+   * @tparam AccumulateFn std::function<A(A, const U&)> Transform function
+   * type.
+   * @param initial Value to start with.
+   * @param accumulate_func Transform function to apply to each item.
+   * @return View<T, Accumulated> Result is the accumulated value.
+   */
+  template <typename A, typename AccumulateFn>
+  auto accumulate(A initial, AccumulateFn accumulate_func);
+
+  /**
+   * @brief Keeps the set of distinct items.
+   *
+   * @return View<T, Distinct<U>> Result is a std::set<U>.
+   */
+  View<T, Distinct<U>> distinct();
+
+  /**
+   * @brief Keeps the items grouped by key.
+   *
+   * @tparam KeySelector Transform to key function type.
+   * std::function<K(const U&)>
+   * @param key_selector Transform to key function to apply to each item.
+   * @return View<T, Grouped> Result is a std::map<K, std::vector<U>>.
+   */
+  template <typename KeySelector>
+  auto keyed_group_by(KeySelector key_selector);
+
+  /**
+   * @brief Keeps a running accumulation of the items of every key.
+   *
+   * @tparam KeySelector Transform to key function type.
+   * std::function<K(const U&)>
+   * @tparam A Accumulating value type.
+   * @tparam AccumulateFn std::function<A(A, const U&)> Transform function
+   * type.
+   * @param key_selector Transform to key function to apply to each item.
+   * @param initial Value every key starts with.
+   * @param accumulate_func Transform function to apply to each item.
+   * @return View<T, KeyedAccumulated> Result is a std::map<K, A>.
+   */
+  template <typename KeySelector, typename A, typename AccumulateFn>
+  auto keyed_accumulate(
+      KeySelector key_selector, A initial, AccumulateFn accumulate_func);
+
+  /**
+   * @brief Projects each appended item into a new form.
+   *
+   * @tparam Selector Transform function type. std::function<V(U)>
+   * @param selector Transform function to apply to each item.
+   * @return Query<T, V>
+   */
+  template <typename Selector>
+  auto select(Selector selector);
+
+  /**
+   * @brief Keeps the items in the order they were appended.
+   *
+   * @return View<T, Collected<U>> Result is a std::vector<U>.
+   */
+  View<T, Collected<U>> to_vector();
+
+  /**
+   * @brief Keeps the first items by the selected value, as with
+   * @ref Queryable<T>::order_by followed by @ref Queryable<T>::take.
+   *
+   * @tparam ValueSelector Transform to value function type.
+   * std::function<V(const U&)>
+   * @param value Number of items to keep.
+   * @param value_selector Transform to value function to apply to each item.
+   * @param descending True if to keep the greatest values, otherwise the
+   * smallest.
+   * @return View<T, TopK> Result is an ordered std::vector<U>.
+   */
+  template <typename ValueSelector>
+  auto
+  top_k(size_t value, ValueSelector value_selector, bool descending = false);
+
+  /**
+   * @brief Keeps appended items that satisfy the predicate / conditional.
+   *
+   * @param predicate Function to test each item for a condition.
+   * @return Query<T, U>
+   */
+  template <typename Predicate>
+  Query<T, U> where(Predicate predicate);
+
+private:
+  Delta delta_;
+};
+
+/**
+ * @brief Materialized result of a query that is updated as batches are
+ * appended to its source.
+ *
+ * @tparam T Type of items appended to the source.
+ * @tparam State Kept state of the ending operation.
+ */
+template <typename T, typename State>
+class View final {
+public:
+  typedef typename State::item_type item_type;
+
+  View(typename Query<T, item_type>::Delta delta, State state);
+  View() = delete;
+
+  /**
+   * @brief Updates the result with a batch appended to the source. Only the
+   * batch goes through the operations.
+   *
+   * @param batch Items appended to the source.
+   */
+  void append(std::vector<T> batch);
+
+  /**
+   * @brief Gets the number of items appended so far.
+   *
+   * @return size_t
+   */
+  size_t appended() const;
+
+  /**
+   * @brief Gets the current result.
+   *
+   * @return const auto& Reference that stays valid as batches are appended.
+   */
+  const auto &result() const;
+
+private:
+  typename Query<T, item_type>::Delta delta_;
+  State state_;
+  size_t appended_;
+};
+
+/**
+ * @brief State of @ref Query<T, U>::to_vector.
+ */
+template <typename U>
+class Collected final {
+public:
+  typedef U item_type;
+
+  void update(std::vector<U> delta);
+  const std::vector<U> &result() const;
+
+private:
+  std::vector<U> items_;
+};
+
+/**
+ * @brief State of @ref Query<T, U>::distinct.
+ */
+template <typename U>
+class Distinct final {
+public:
+  typedef U item_type;
+
+  void update(std::vector<U> delta);
+  const std::set<U> &result() const;
+
+private:
+  std::set<U> items_;
+};
+
+/**
+ * @brief State of @ref Query<T, U>::keyed_group_by.
+ */
+template <typename K, typename U, typename KeySelector>
+class Grouped final {
+public:
+  typedef U item_type;
+
+  explicit Grouped(KeySelector key_selector);
+  void update(std::vector<U> delta);
+  const std::map<K, std::vector<U>> &result() const;
+
+private:
+  KeySelector key_selector_;
+  std::map<K, std::vector<U>> groups_;
+};
+
+/**
+ * @brief State of @ref Query<T, U>::accumulate.
+ */
+template <typename U, typename A, typename AccumulateFn>
+class Accumulated final {
+public:
+  typedef U item_type;
+
+  Accumulated(A initial, AccumulateFn accumulate_func);
+  void update(std::vector<U> delta);
+  const A &result() const;
+
+private:
+  A value_;
+  AccumulateFn accumulate_func_;
+};
+
+/**
+ * @brief State of @ref Query<T, U>::keyed_accumulate.
+ */
+template <typename K, typename U, typename A, typename KeySelector,
+          typename AccumulateFn>
+class KeyedAccumulated final {
+public:
+  typedef U item_type;
+
+  KeyedAccumulated(
+      KeySelector key_selector, A initial, AccumulateFn accumulate_func);
+  void update(std::vector<U> delta);
+  const std::map<K, A> &result() const;
+
+private:
+  KeySelector key_selector_;
+  A initial_;
+  AccumulateFn accumulate_func_;
+  std::map<K, A> values_;
+};
+
+/**
+ * @brief State of @ref Query<T, U>::top_k. Keeps at most k items in order, so
+ * once k are kept most appended items are rejected with a single comparison
+ * against the worst of them. The rest are sorted and merged in, so each batch
+ * costs about its accepted items rather than k.
+ */
+template <typename U, typename Less>
+class TopK final {
+public:
+  typedef U item_type;
+
+  TopK(size_t value, Less less);
+  void update(std::vector<U> delta);
+  const std::vector<U> &result() const;
+
+private:
+  size_t value_;
+  Less less_;
+  std::vector<U> items_;
+};
+
+/**
+ * @brief Starts an incremental query over batches of items.
+ *
+ * @tparam T Type of items appended to the source.
+ * @return Query<T, T>
+ */
+template <typename T>
+Query<T, T> query();
+
+} // namespace fcpp::incremental
+
+/******************************************************************************
+ *
+ * @brief Keep definitions separate to allow the declarations to stay clean and
+ * compact.
+ *
+ *****************************************************************************/
+
+namespace fcpp::incremental {
+
+template <typename T, typename U>
+Query<T, U>::Query(Delta delta) : delta_(std::move(delta)) {}
+
+template <typename T, typename U>
+template <typename A, typename AccumulateFn>
+auto Query<T, U>::accumulate(A initial, AccumulateFn accumulate_func) {
+  using State = Accumulated<U, A, AccumulateFn>;
+  return View<T, State>(
+      std::move(delta_),
+      State(std::move(initial), std::move(accumulate_func)));
+}
+
+template <typename T, typename U>
+View<T, Distinct<U>> Query<T, U>::distinct() {
+  static_assert(
+      traits::is_less_than_comparable<U>::value,
+      "Type must be less-than comparable.");
+  return View<T, Distinct<U>>(std::move(delta_), Distinct<U>());
+}
+
+template <typename T, typename U>
+template <typename KeySelector>
+auto Query<T, U>::keyed_group_by(KeySelector key_selector) {
+  static_assert(
+      !traits::is_copying_selector<KeySelector, U>::value,
+      "Key selector must take items by reference, not copy every item.");
+  using K = std::decay_t<decltype(key_selector(std::declval<const U &>()))>;
+  static_assert(
+      traits::is_less_than_comparable<K>::value,
+      "Key selector must produce a value that is less-than comparable.");
+  using State = Grouped<K, U, KeySelector>;
+  return View<T, State>(std::move(delta_), State(std::move(key_selector)));
+}
+
+template <typename T, typename U>
+template <typename KeySelector, typename A, typename AccumulateFn>
+auto Query<T, U>::keyed_accumulate(
+    KeySelector key_selector, A initial, AccumulateFn accumulate_func) {
+  static_assert(
+      !traits::is_copying_selector<KeySelector, U>::value,
+      "Key selector must take items by reference, not copy every item.");
+  using K = std::decay_t<decltype(key_selector(std::declval<const U &>()))>;
+  static_assert(
+      traits::is_less_than_comparable<K>::value,
+      "Key selector must produce a value that is less-than comparable.");
+  using State = KeyedAccumulated<K, U, A, KeySelector, AccumulateFn>;
+  return View<T, State>(
+      std::move(delta_),
+      State(
+          std::move(key_selector), std::move(initial),
+          std::move(accumulate_func)));
+}
+
+template <typename T, typename U>
+template <typename Selector>
+auto Query<T, U>::select(Selector selector) {
+  using V = decltype(selector(std::declval<U>()));
+  return Query<T, V>(
+      [delta = std::move(delta_), selector](std::vector<T> batch) {
+        std::vector<U> items = delta(std::move(batch));
+        std::vector<V> selected;
+        selected.reserve(items.size());
+        std::transform(
+            std::make_move_iterator(items.begin()),
+            std::make_move_iterator(items.end()),
+            std::back_inserter(selected), selector);
+        return selected;
+      });
+}
+
+template <typename T, typename U>
+View<T, Collected<U>> Query<T, U>::to_vector() {
+  return View<T, Collected<U>>(std::move(delta_), Collected<U>());
+}
+
+template <typename T, typename U>
+template <typename ValueSelector>
+auto Query<T, U>::top_k(
+    size_t value, ValueSelector value_selector, bool descending) {
+  static_assert(
+      !traits::is_copying_selector<ValueSelector, U>::value,
+      "Value selector must take items by reference, not copy every item.");
+  static_assert(
+      traits::is_less_than_comparable<std::decay_t<decltype(value_selector(
+          std::declval<const U &>()))>>::value,
+      "ValueSelector return type must be less-than compareable.");
+  auto less = [value_selector, descending](const U &lhs, const U &rhs) {
+    const auto &lhs_value = value_selector(lhs);
+    const auto &rhs_value = value_selector(rhs);
+    return descending ? rhs_value < lhs_value : lhs_value < rhs_value;
+  };
+  using State = TopK<U, decltype(less)>;
+  return View<T, State>(std::move(delta_), State(value, std::move(less)));
+}
+
+template <typename T, typename U>
+template <typename Predicate>
+Query<T, U> Query<T, U>::where(Predicate predicate) {
+  return Query<T, U>(
+      [delta = std::move(delta_), predicate](std::vector<T> batch) {
+        std::vector<U> items = delta(std::move(batch));
+        items.erase(
+            std::remove_if(
+                items.begin(), items.end(),
+                [&predicate](const U &item) { return !predicate(item); }),
+            items.end());
+        return items;
+      });
+}
+
+template <typename T, typename State>
+View<T, State>::View(typename Query<T, item_type>::Delta delta, State state)
+    : delta_(std::move(delta)), state_(std::move(state)), appended_(0) {}
+
+template <typename T, typename State>
+void View<T, State>::append(std::vector<T> batch) {
+  appended_ += batch.size();
+  state_.update(delta_(std::move(batch)));
+}
+
+template <typename T, typename State>
+size_t View<T, State>::appended() const {
+  return appended_;
+}
+
+template <typename T, typename State>
+const auto &View<T, State>::result() const {
+  return state_.result();
+}
+
+template <typename U>
+void Collected<U>::update(std::vector<U> delta) {
+  if (items_.empty()) {
+    items_ = std::move(delta);
+    return;
+  }
+  items_.insert(
+      items_.end(), std::make_move_iterator(delta.begin()),
+      std::make_move_iterator(delta.end()));
+}
+
+template <typename U>
+const std::vector<U> &Collected<U>::result() const {
+  return items_;
+}
+
+template <typename U>
+void Distinct<U>::update(std::vector<U> delta) {
+  items_.insert(
+      std::make_move_iterator(delta.begin()),
+      std::make_move_iterator(delta.end()));
+}
+
+template <typename U>
+const std::set<U> &Distinct<U>::result() const {
+  return items_;
+}
+
+template <typename K, typename U, typename KeySelector>
+Grouped<K, U, KeySelector>::Grouped(KeySelector key_selector)
+    : key_selector_(std::move(key_selector)) {}
+
+template <typename K, typename U, typename KeySelector>
+void Grouped<K, U, KeySelector>::update(std::vector<U> delta) {
+  for (U &item : delta) {
+    groups_[key_selector_(std::as_const(item))].push_back(std::move(item));
+  }
+}
+
+template <typename K, typename U, typename KeySelector>
+const std::map<K, std::vector<U>> &
+Grouped<K, U, KeySelector>::result() const {
+  return groups_;
+}
+
+template <typename U, typename A, typename AccumulateFn>
+Accumulated<U, A, AccumulateFn>::Accumulated(
+    A initial, AccumulateFn accumulate_func)
+    : value_(std::move(initial)), accumulate_func_(std::move(accumulate_func)) {
+}
+
+template <typename U, typename A, typename AccumulateFn>
+void Accumulated<U, A, AccumulateFn>::update(std::vector<U> delta) {
+  for (const U &item : delta) {
+    value_ = accumulate_func_(std::move(value_), item);
+  }
+}
+
+template <typename U, typename A, typename AccumulateFn>
+const A &Accumulated<U, A, AccumulateFn>::result() const {
+  return value_;
+}
+
+template <typename K, typename U, typename A, typename KeySelector,
+          typename AccumulateFn>
+KeyedAccumulated<K, U, A, KeySelector, AccumulateFn>::KeyedAccumulated(
+    KeySelector key_selector, A initial, AccumulateFn accumulate_func)
+    : key_selector_(std::move(key_selector)), initial_(std::move(initial)),
+      accumulate_func_(std::move(accumulate_func)) {}
+
+template <typename K, typename U, typename A, typename KeySelector,
+          typename AccumulateFn>
+void KeyedAccumulated<K, U, A, KeySelector, AccumulateFn>::update(
+    std::vector<U> delta) {
+  for (const U &item : delta) {
+    auto it = values_.try_emplace(key_selector_(item), initial_).first;
+    it->second = accumulate_func_(std::move(it->second), item);
+  }
+}
+
+template <typename K, typename U, typename A, typename KeySelector,
+          typename AccumulateFn>
+const std::map<K, A> &
+KeyedAccumulated<K, U, A, KeySelector, AccumulateFn>::result() const {
+  return values_;
+}
+
+template <typename U, typename Less>
+TopK<U, Less>::TopK(size_t value, Less less)
+    : value_(value), less_(std::move(less)) {}
+
+template <typename U, typename Less>
+void TopK<U, Less>::update(std::vector<U> delta) {
+  if (value_ == 0) {
+    return;
+  }
+  if (items_.size() == value_) {
+    delta.erase(
+        std::remove_if(
+            delta.begin(), delta.end(),
+            [this](const U &item) { return !less_(item, items_.back()); }),
+        delta.end());
+  }
+  if (delta.empty()) {
+    return;
+  }
+  // Stable so that equal items are kept in the order they were appended.
+  std::stable_sort(delta.begin(), delta.end(), less_);
+  if (delta.size() > value_) {
+    delta.erase(delta.begin() + value_, delta.end());
+  }
+  size_t kept = items_.size();
+  std::move(delta.begin(), delta.end(), std::back_inserter(items_));
+  std::inplace_merge(
+      items_.begin(), items_.begin() + kept, items_.end(), less_);
+  if (items_.size() > value_) {
+    items_.erase(items_.begin() + value_, items_.end());
+  }
+}
+
+template <typename U, typename Less>
+const std::vector<U> &TopK<U, Less>::result() const {
+  return items_;
+}
+
+template <typename T>
+Query<T, T> query() {
+  return Query<T, T>([](std::vector<T> batch) { return batch; });
+}
+
+} // namespace fcpp::incremental
+
+#endif // FCPP_INCREMENTAL_H
@@ -0,0 +1,63 @@
+#include "mapped.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fcpp::mapped {
+
+File::File(const std::filesystem::path &path, Options options)
+    : data_(nullptr), size_(0) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  asserts::invariant::eval(fd != -1)
+      << "Unable to open file " << path << ": " << std::strerror(errno) << ".";
+
+  struct stat status;
+  if (::fstat(fd, &status) == -1) {
+    int error = errno;
+    ::close(fd);
+    asserts::invariant::eval(false) << "Unable to get size of file " << path
+                                    << ": " << std::strerror(error) << ".";
+  }
+  size_ = status.st_size;
+
+  if (size_ > 0) {
+    void *mapped = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    int error = errno;
+    ::close(fd);
+    asserts::invariant::eval(mapped != MAP_FAILED)
+        << "Unable to map file " << path << ": " << std::strerror(error)
+        << ".";
+    data_ = static_cast<const std::byte *>(mapped);
+
+    // Hints only, so failures are ignored.
+    if (options.sequential) {
+      ::madvise(mapped, size_, MADV_SEQUENTIAL);
+    }
+    if (options.will_need) {
+      ::madvise(mapped, size_, MADV_WILLNEED);
+    }
+#ifdef MADV_HUGEPAGE
+    if (options.huge_pages) {
+      ::madvise(mapped, size_, MADV_HUGEPAGE);
+    }
+#endif
+  } else {
+    ::close(fd);
+  }
+}
+
+File::~File() {
+  if (data_ != nullptr) {
+    ::munmap(const_cast<std::byte *>(data_), size_);
+  }
+}
+
+const std::byte *File::data() const { return data_; }
+
+size_t File::size() const { return size_; }
+
+} // namespace fcpp::mapped
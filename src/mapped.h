@@ -0,0 +1,157 @@
+/**
+ * @file mapped.h
+ * @author Andrew Walsh (awalsh128@gmail.com)
+ * @brief Zero copy queries over files of packed fixed size records through
+ * memory mapping.
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef FCPP_MAPPED_H
+#define FCPP_MAPPED_H
+
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <span>
+#include <type_traits>
+
+#include "asserts.h"
+#include "query.h"
+
+namespace fcpp::mapped {
+
+/**
+ * @brief Hints given to the kernel about how a mapped file will be read.
+ */
+struct Options {
+  /**
+   * @brief Items will be read in order, so pages can be read ahead
+   * aggressively and dropped once passed (MADV_SEQUENTIAL).
+   */
+  bool sequential = true;
+  /**
+   * @brief The whole file will be needed soon, so start reading it in right
+   * away (MADV_WILLNEED).
+   */
+  bool will_need = false;
+  /**
+   * @brief Back the mapping with transparent huge pages where the kernel and
+   * file system allow it (MADV_HUGEPAGE). Reduces TLB misses on large scans.
+   */
+  bool huge_pages = false;
+};
+
+/**
+ * @brief Read only memory mapping of a whole file.
+ */
+class File final {
+public:
+  /**
+   * @brief Construct a new File object by mapping the file at the path.
+   *
+   * @param path Path of the file to map.
+   * @param options Hints about how the mapping will be read.
+   */
+  explicit File(const std::filesystem::path &path, Options options = {});
+  /**
+   * @brief Unmaps the file.
+   */
+  ~File();
+  File() = delete;
+  File(const File &) = delete;
+  File &operator=(const File &) = delete;
+
+  /**
+   * @brief Gets the mapped bytes of the file.
+   *
+   * @return const std::byte* Null if the file is empty.
+   */
+  const std::byte *data() const;
+
+  /**
+   * @brief Gets the size of the file in bytes.
+   *
+   * @return size_t
+   */
+  size_t size() const;
+
+private:
+  const std::byte *data_;
+  size_t size_;
+};
+
+} // namespace fcpp::mapped
+
+namespace fcpp {
+
+/**
+ * @brief Queries a file of packed records in place by memory mapping it.
+ *
+ * No item is deserialized or copied by read only operations. The mapping is
+ * kept alive by the returned query and any query narrowed from it.
+ *
+ * @code
+ * double total = fcpp::query_mmap<Tick>("ticks.bin")
+ *     .accumulate(0.0, [](double sum, const Tick &tick) {
+ *       return sum + tick.price;
+ *     });
+ * @endcode
+ *
+ * @tparam T Trivially copyable type of the records.
+ * @param path Path of the file to map. Its size must be a multiple of
+ * sizeof(T).
+ * @param options Hints about how the mapping will be read.
+ * @return SpanQueryable<T>
+ */
+template <typename T>
+SpanQueryable<T> query_mmap(
+    const std::filesystem::path &path, mapped::Options options = {});
+
+} // namespace fcpp
+
+/******************************************************************************
+ *
+ * @brief Keep definitions separate to allow the declarations to stay clean and
+ * compact.
+ *
+ *****************************************************************************/
+
+namespace fcpp {
+
+template <typename T>
+SpanQueryable<T>
+query_mmap(const std::filesystem::path &path, mapped::Options options) {
+  static_assert(
+      std::is_trivially_copyable_v<T>,
+      "T must be trivially copyable to be read in place.");
+
+  auto file = std::make_shared<mapped::File>(path, options);
+  asserts::invariant::eval(file->size() % sizeof(T) == 0)
+      << "File " << path << " size of " << file->size()
+      << " bytes must be a multiple of the record size of " << sizeof(T)
+      << " bytes.";
+
+  std::span<const T> items(
+      reinterpret_cast<const T *>(file->data()), file->size() / sizeof(T));
+  return SpanQueryable<T>(items, std::move(file));
+}
+
+} // namespace fcpp
+
+#endif // FCPP_MAPPED_H
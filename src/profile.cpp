@@ -0,0 +1,108 @@
+#include "profile.h"
+
+#include <atomic>
+#include <cstddef>
+#include <ctime>
+#include <iomanip>
+
+namespace fcpp::profile {
+
+namespace {
+
+#ifdef FCPP_PROFILING
+std::atomic<size_t> allocation_count{0};
+std::atomic<size_t> allocation_bytes{0};
+std::atomic<size_t> reallocation_count{0};
+// Size of the last allocation of the thread if nothing was freed since.
+thread_local size_t last_allocation = 0;
+#endif
+
+double milliseconds(std::chrono::nanoseconds duration) {
+  return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+} // namespace
+
+Allocations allocations() {
+#ifdef FCPP_PROFILING
+  return {
+      allocation_count.load(std::memory_order_relaxed),
+      allocation_bytes.load(std::memory_order_relaxed),
+      reallocation_count.load(std::memory_order_relaxed)};
+#else
+  return {};
+#endif
+}
+
+void record_allocation([[maybe_unused]] size_t bytes) noexcept {
+#ifdef FCPP_PROFILING
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  allocation_bytes.fetch_add(bytes, std::memory_order_relaxed);
+  last_allocation = bytes;
+#endif
+}
+
+void record_deallocation([[maybe_unused]] size_t bytes) noexcept {
+#ifdef FCPP_PROFILING
+  if (bytes < last_allocation) {
+    reallocation_count.fetch_add(1, std::memory_order_relaxed);
+  }
+  last_allocation = 0;
+#endif
+}
+
+void Profile::add(OperatorStats stats) {
+  operators_.push_back(std::move(stats));
+}
+
+const std::vector<OperatorStats> &Profile::operators() const {
+  return operators_;
+}
+
+void Profile::report(std::ostream &out) const {
+  auto row = [&out](
+                 const std::string &name, size_t rows_in, size_t rows_out,
+                 std::chrono::nanoseconds wall, std::chrono::nanoseconds cpu,
+                 const Allocations &allocations) {
+    out << std::left << std::setw(16) << name << std::right << std::setw(12)
+        << rows_in << std::setw(12) << rows_out << std::fixed
+        << std::setprecision(3) << std::setw(12) << milliseconds(wall)
+        << std::setw(12) << milliseconds(cpu) << std::setw(10)
+        << allocations.count << std::setw(14) << allocations.bytes
+        << std::setw(10) << allocations.reallocations << "\n";
+  };
+
+  out << std::left << std::setw(16) << "operator" << std::right
+      << std::setw(12) << "rows in" << std::setw(12) << "rows out"
+      << std::setw(12) << "wall ms" << std::setw(12) << "proc cpu ms"
+      << std::setw(10) << "allocs" << std::setw(14) << "bytes"
+      << std::setw(10) << "reallocs" << "\n";
+  std::chrono::nanoseconds wall{0};
+  std::chrono::nanoseconds cpu{0};
+  Allocations allocations;
+  for (const OperatorStats &stats : operators_) {
+    row(stats.name, stats.rows_in, stats.rows_out, stats.wall, stats.cpu,
+        stats.allocations);
+    wall += stats.wall;
+    cpu += stats.cpu;
+    allocations.count += stats.allocations.count;
+    allocations.bytes += stats.allocations.bytes;
+    allocations.reallocations += stats.allocations.reallocations;
+  }
+  row("total", operators_.empty() ? 0 : operators_.front().rows_in,
+      operators_.empty() ? 0 : operators_.back().rows_out, wall, cpu,
+      allocations);
+}
+
+namespace detail {
+
+std::chrono::nanoseconds cpu_time() {
+  timespec time;
+  ::clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time);
+  return std::chrono::seconds(time.tv_sec) +
+         std::chrono::nanoseconds(time.tv_nsec);
+}
+
+} // namespace detail
+
+} // namespace fcpp::profile
@@ -0,0 +1,266 @@
+/**
+ * @file profile.h
+ * @author Andrew Walsh (awalsh128@gmail.com)
+ * @brief Per operator statistics of profiled query chains.
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef FCPP_PROFILE_H
+#define FCPP_PROFILE_H
+
+#include "trace.h"
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace fcpp::profile {
+
+/**
+ * @brief True if profiling is compiled in, by defining FCPP_PROFILING (e.g.
+ * through the CMake option of the same name). It must be defined the same way
+ * for the library and everything including it.
+ *
+ * Without it, queries cannot be profiled and the bookkeeping compiles away.
+ * With it, queries that are not profiled pay a null check per operator and
+ * every allocation the program records is counted.
+ */
+#ifdef FCPP_PROFILING
+constexpr bool kEnabled = true;
+#else
+constexpr bool kEnabled = false;
+#endif
+
+/**
+ * @brief Number and size of heap allocations.
+ */
+struct Allocations {
+  size_t count = 0;
+  size_t bytes = 0;
+  /**
+   * @brief Allocations that replaced a smaller block, e.g. a growing vector
+   * moving to a new buffer. Included in @ref count.
+   */
+  size_t reallocations = 0;
+};
+
+/**
+ * @brief Gets the allocations recorded for the whole process so far. Always
+ * zero if profiling is not compiled in.
+ *
+ * @return Allocations
+ */
+Allocations allocations();
+
+/**
+ * @brief Records an allocation for @ref allocations. The library does not
+ * replace the global operator new itself, so a program that wants
+ * allocations profiled calls this from its own replacement. Does nothing if
+ * profiling is not compiled in.
+ *
+ * @param bytes Size requested.
+ */
+void record_allocation(size_t bytes) noexcept;
+
+/**
+ * @brief Records a deallocation, from the program's replacement of the
+ * global operator delete. A deallocation of a smaller block right after an
+ * allocation on the same thread is how containers grow, so that allocation
+ * is counted as a reallocation. Does nothing if profiling is not compiled
+ * in.
+ *
+ * @param bytes Size of the block, as requested if known.
+ */
+void record_deallocation(size_t bytes) noexcept;
+
+/**
+ * @brief Statistics of a single operator of a profiled chain.
+ */
+struct OperatorStats {
+  /**
+   * @brief Name of the operator method.
+   */
+  std::string name;
+  size_t rows_in = 0;
+  size_t rows_out = 0;
+  std::chrono::nanoseconds wall{0};
+  /**
+   * @brief CPU time of the whole process, so work of the pool threads is
+   * included and so is any other thread running at the same time.
+   */
+  std::chrono::nanoseconds cpu{0};
+  /**
+   * @brief Allocations recorded while the operator ran, see
+   * @ref record_allocation.
+   */
+  Allocations allocations;
+};
+
+/**
+ * @brief Statistics of the operators of a profiled chain, in the order they
+ * ran.
+ */
+class Profile final {
+public:
+  /**
+   * @brief Adds the statistics of an operator that finished.
+   *
+   * @param stats Statistics of the operator.
+   */
+  void add(OperatorStats stats);
+
+  /**
+   * @brief Gets the statistics of the operators in the order they ran.
+   *
+   * @return const std::vector<OperatorStats>&
+   */
+  const std::vector<OperatorStats> &operators() const;
+
+  /**
+   * @brief Prints a table with a row per operator and a total row.
+   *
+   * @param out Stream to print to.
+   */
+  void report(std::ostream &out) const;
+
+private:
+  std::vector<OperatorStats> operators_;
+};
+
+#ifdef FCPP_PROFILING
+/**
+ * @brief Profile a query passes along its chain, empty if not profiled.
+ */
+typedef std::shared_ptr<Profile> Handle;
+#else
+/**
+ * @brief Placeholder for the profile a query passes along its chain, taking
+ * no space when profiling is not compiled in.
+ */
+struct Handle {};
+#endif
+
+/**
+ * @brief Measures an operator from construction to @ref finish. Also records
+ * a trace span of the operator if tracing is compiled in, see trace::start.
+ */
+class Scope final {
+public:
+  /**
+   * @brief Starts measuring if the query is profiled.
+   *
+   * @param profile Profile of the query running the operator.
+   * @param name Name of the operator method.
+   * @param rows_in Number of items going into the operator.
+   */
+  Scope(const Handle &profile, const char *name, size_t rows_in);
+
+  /**
+   * @brief Records the operator and passes the profile on to its result.
+   *
+   * @param rows_out Number of items coming out of the operator.
+   * @param result Profile of the query the operator produced.
+   */
+  void finish(size_t rows_out, Handle &result);
+
+private:
+  [[no_unique_address]] trace::Span span_;
+#ifdef FCPP_PROFILING
+  Handle profile_;
+  const char *name_;
+  size_t rows_in_;
+  std::chrono::steady_clock::time_point wall_;
+  std::chrono::nanoseconds cpu_;
+  Allocations allocations_;
+#endif
+};
+
+namespace detail {
+
+/**
+ * @brief Gets the CPU time used by the process so far.
+ *
+ * @return std::chrono::nanoseconds
+ */
+std::chrono::nanoseconds cpu_time();
+
+} // namespace detail
+
+} // namespace fcpp::profile
+
+/******************************************************************************
+ *
+ * @brief Keep definitions separate to allow the declarations to stay clean and
+ * compact.
+ *
+ *****************************************************************************/
+
+namespace fcpp::profile {
+
+#ifdef FCPP_PROFILING
+
+inline Scope::Scope(const Handle &profile, const char *name, size_t rows_in)
+    : profile_(profile), name_(name), rows_in_(rows_in) {
+  span_.begin(name, "operator");
+  span_.arg("rows_in", rows_in);
+  if (profile_) {
+    allocations_ = allocations();
+    cpu_ = detail::cpu_time();
+    wall_ = std::chrono::steady_clock::now();
+  }
+}
+
+inline void Scope::finish(size_t rows_out, Handle &result) {
+  span_.arg("rows_out", rows_out);
+  span_.end();
+  if (!profile_) {
+    return;
+  }
+  auto wall = std::chrono::steady_clock::now() - wall_;
+  auto cpu = detail::cpu_time() - cpu_;
+  Allocations allocated = allocations();
+  profile_->add(OperatorStats{
+      name_, rows_in_, rows_out,
+      std::chrono::duration_cast<std::chrono::nanoseconds>(wall), cpu,
+      {allocated.count - allocations_.count,
+       allocated.bytes - allocations_.bytes,
+       allocated.reallocations - allocations_.reallocations}});
+  result = std::move(profile_);
+}
+
+#else
+
+inline Scope::Scope(const Handle &, const char *name, size_t rows_in) {
+  span_.begin(name, "operator");
+  span_.arg("rows_in", rows_in);
+}
+
+inline void Scope::finish(size_t rows_out, Handle &) {
+  span_.arg("rows_out", rows_out);
+  span_.end();
+}
+
+#endif
+
+} // namespace fcpp::profile
+
+#endif // FCPP_PROFILE_H
@@ -26,12 +26,18 @@
 #define FCPP_QUERY_H
 
 #include <algorithm>
+#include <bit>
 #include <functional>
+#include <future>
 #include <iterator>
 #include <map>
+#include <memory>
+#include <numeric>
 #include <optional>
+#include <ostream>
 #include <random>
 #include <set>
+#include <span>
 #include <tuple>
 #include <type_traits>
 #include <utility>
@@ -40,6 +46,9 @@
 #include <vector>
 
 #include "asserts.h"
+#include "profile.h"
+#include "scheduler.h"
+#include "stream.h"
 #include "traits.h"
 #include "transforms.h"
 
@@ -114,6 +123,25 @@ class WhenFalse;
 template <typename TrueT, typename FalseT>
 class Merge;
 
+/**
+ * @brief Two sequences zipped by position and stored side by side.
+ *
+ * @tparam T Type of items from the left hand side sequence.
+ * @tparam U Type of items from the right hand side sequence.
+ * @tparam MayPad False if both sides always have the same size.
+ */
+template <typename T, typename U, bool MayPad = true>
+class Zipped;
+
+/**
+ * @brief Read only query over items that are not owned, like a memory mapped
+ * file.
+ *
+ * @tparam T Type of items to query over.
+ */
+template <typename T>
+class SpanQueryable;
+
 /**
  * @brief Queries the sequence of items using a vector.
  *
@@ -124,6 +152,16 @@ class Merge;
 template <typename T>
 Queryable<T> query(std::vector<T> items);
 
+/**
+ * @brief Queries the sequence of items in place without copying them.
+ *
+ * @tparam T Type of items to query over.
+ * @param items Items to query over. Must outlive the query.
+ * @return SpanQueryable<T>
+ */
+template <typename T>
+SpanQueryable<T> query(std::span<const T> items);
+
 /**
  * @brief Core object used to query items and hold the sequence state.
  *
@@ -156,6 +194,10 @@ Queryable<T> query(std::vector<T> items);
  *   [](auto x) { return x.y; }   // Fundamental type
  *   [](auto& x) { return x.y; }  // Larger composite type
  *
+ * Key and value selectors are called on const references to the items. Ones
+ * that would copy every item, by taking items that are not cheap to copy by
+ * value, fail to compile.
+ *
  * @tparam T Type of items to query over.
  */
 template <typename T>
@@ -276,22 +318,35 @@ public:
   /**
    * @brief Branches the sequence into two based on a condition.
    *
+   * @remark When concurrent, the block queries must not share unsynchronized
+   * state since they can run at the same time on different threads.
+   *
    * @param predicate Function to test each item for a condition.
+   * @param concurrent True to run the true and false block queries
+   * concurrently on the library thread pool, joined at Merge::merge.
    * @return WhenTrue<T> True / if block query for items that evaluated to true.
    */
   template <typename Predicate>
-  WhenTrue<T> branch(Predicate predicate);
+  WhenTrue<T> branch(Predicate predicate, bool concurrent = false);
 
   /**
    * @brief Produces the set difference of two sequences.
    *
+   * @remark Both sequences must be sorted. If this one is much smaller, its
+   * items are binary searched in the right hand side instead of walking both.
+   *
    * @param rhs_items Right hand side sequence.
    * @return Queryable<T> Sequence of items not found in both sequences.
    */
   Queryable<T> difference(std::vector<T> rhs_items);
 
   /**
-   * @brief Gets distinct items from a sequence.
+   * @brief Gets distinct items from a sequence, in sorted order.
+   *
+   * @remark Skipped if the sequence is already distinct, e.g. after another
+   * distinct, a union or operations that keep a subsequence in order like
+   * @ref where and @ref take. Sorts in place rather than through a set if T
+   * is move assignable.
    *
    * @return Queryable<T>
    */
@@ -320,6 +375,9 @@ public:
    * @brief Projects each item in the sequence-of-sequences and flattens the
    * resulting sequences into one (i.e. vector<vector<T>> -> vector<T>).
    *
+   * @remark The result is allocated once up front. Large sequences of default
+   * constructible items are moved in parallel on the library thread pool.
+   *
    * @return Queryable<U = std::vector<T>>
    */
   auto flatten();
@@ -327,16 +385,36 @@ public:
   /**
    * @brief Groups the items of a sequence.
    *
-   * @tparam KeySelector Transform function type. std::function<K(T)>
+   * @tparam KeySelector Transform function type.
+   * std::function<K(const T&)>
    * @param key_selector Transform to key function to apply to each item.
    * @return Queryable<std::vector<T>>
    */
   template <typename KeySelector>
   Queryable<std::vector<T>> group_by(KeySelector key_selector);
 
+  /**
+   * @brief Groups the items of a sequence, spilling them to temporary files
+   * partitioned by key hash once the groups exceed a memory budget.
+   *
+   * @remark See @ref Stream<T>::keyed_group_by.
+   *
+   * @tparam KeySelector Transform to key function type.
+   * std::function<K(const T&)>
+   * @param key_selector Transform to key function to apply to each item.
+   * @param budget Memory the groups may hold and where to spill them.
+   * @return Stream<std::vector<T>> The groups, produced as they are pulled.
+   */
+  template <typename KeySelector>
+  Stream<std::vector<T>>
+  group_by(KeySelector key_selector, spill::MemoryBudget budget);
+
   /**
    * @brief Produces the set intersection of two sequences.
    *
+   * @remark Both sequences must be sorted. If one is much smaller, its items
+   * are binary searched in the other instead of walking both.
+   *
    * @param rhs_items Right hand side sequence.
    * @return Queryable<T> The intersected set that share the same items.
    */
@@ -345,32 +423,89 @@ public:
   /**
    * @brief Correlates the items of two sequences based on matching keys.
    *
+   * @remark A right hand side that is small next to this one is scanned for
+   * each key, otherwise it is grouped by key in a tree first.
+   *
    * @tparam U Type of the right hand side sequence.
-   * @tparam LhsKeySelector Transform to key function type. std::function<K(T)>
-   * @tparam RhsKeySelector Transform to key function type. std::function<K(U)>
+   * @tparam LhsKeySelector Transform to key function type.
+   * std::function<K(const T&)>
+   * @tparam RhsKeySelector Transform to key function type.
+   * std::function<K(const U&)>
    * @param rhs_items The right hand side sequence to join against.
    * @param lhs_key_selector Transform to key function to apply to each item in
    * this / left hand side sequence.
    * @param rhs_key_selector Transform to key function to apply to each item in
    * the right hand side sequence.
-   * @return Queryable<std::tuple<T, U>>
+   * @return Zipped<T, U, false> Matched pairs stored side by side.
    */
   template <typename U, typename LhsKeySelector, typename RhsKeySelector>
-  Queryable<std::tuple<T, U>> join(
+  Zipped<T, U, false> join(
       std::vector<U> rhs_items, LhsKeySelector lhs_key_selector,
       RhsKeySelector rhs_key_selector);
 
+  /**
+   * @brief Correlates the items of two sequences based on matching keys,
+   * spilling both sides to temporary files partitioned by key hash if the
+   * right hand side exceeds a memory budget.
+   *
+   * @remark See @ref Stream<T>::join.
+   *
+   * @tparam U Type of the right hand side sequence.
+   * @tparam LhsKeySelector Transform to key function type.
+   * std::function<K(const T&)>
+   * @tparam RhsKeySelector Transform to key function type.
+   * std::function<K(const U&)>
+   * @param rhs_items The right hand side sequence to join against.
+   * @param lhs_key_selector Transform to key function to apply to each item in
+   * this / left hand side sequence.
+   * @param rhs_key_selector Transform to key function to apply to each item in
+   * the right hand side sequence.
+   * @param budget Memory the right hand side may hold and where to spill.
+   * @return Stream<std::pair<T, U>> Matched pairs, joined as they are pulled.
+   */
+  template <typename U, typename LhsKeySelector, typename RhsKeySelector>
+  Stream<std::pair<T, U>> join(
+      std::vector<U> rhs_items, LhsKeySelector lhs_key_selector,
+      RhsKeySelector rhs_key_selector, spill::MemoryBudget budget);
+
   /**
    * @brief Groups the items of a sequence by key and produces as a key-group
    * pair sequence.
    *
-   * @tparam KeySelector Transform to key function type. std::function<K(T)>
+   * @tparam KeySelector Transform to key function type.
+   * std::function<K(const T&)>
    * @param key_selector Transform to key function to apply to each item.
    * @return Queryable<std::pair<K, std::vector<T>>>
    */
   template <typename KeySelector>
   auto keyed_group_by(KeySelector key_selector);
 
+  /**
+   * @brief Groups the items of a sequence by key and produces them as a
+   * stream of key-group pairs, spilling them to temporary files partitioned by
+   * key hash once the groups exceed a memory budget. Use it in place of
+   * @ref to_multi_value_map when the map would not fit in memory.
+   *
+   * @remark See @ref Stream<T>::keyed_group_by.
+   *
+   * @tparam KeySelector Transform to key function type.
+   * std::function<K(const T&)>
+   * @param key_selector Transform to key function to apply to each item.
+   * @param budget Memory the groups may hold and where to spill them.
+   * @return Stream<std::pair<K, std::vector<T>>>
+   */
+  template <typename KeySelector>
+  auto keyed_group_by(KeySelector key_selector, spill::MemoryBudget budget);
+
+  /**
+   * @brief Gets a lazy stream over the sequence that evaluates its operations
+   * morsel by morsel.
+   *
+   * @param morsel_size Number of items to pull through the stream at a time.
+   * @return Stream<T>
+   */
+  Stream<T> lazy(size_t morsel_size = kDefaultMorselSize);
+
   /**
    * @brief Gets the maximum item from the sequence.
    *
@@ -381,7 +516,8 @@ public:
   /**
    * @brief Gets the maximum item from the sequence based on a selected value.
    *
-   * @tparam ValueSelector Transform to value function type. std::function<V(T)>
+   * @tparam ValueSelector Transform to value function type.
+   * std::function<V(const T&)>
    * @param value_selector Transform to value function to apply to each item.
    * @return T
    */
@@ -398,7 +534,8 @@ public:
   /**
    * @brief Gets the minimum item from the sequence based on a selected value.
    *
-   * @tparam ValueSelector Transform to value function type. std::function<V(T)>
+   * @tparam ValueSelector Transform to value function type.
+   * std::function<V(const T&)>
    * @param value_selector Transform to value function to apply to each item.
    * @return T
    */
@@ -408,7 +545,8 @@ public:
   /**
    * @brief Orders the sequence by the selected value.
    *
-   * @tparam ValueSelector Transform to value function type. std::function<V(T)>
+   * @tparam ValueSelector Transform to value function type.
+   * std::function<V(const T&)>
    * @param value_selector Transform to value function to apply to each item.
    * @param descending True if to order by greater to smaller values, otherwise
    * smaller to greater.
@@ -417,6 +555,62 @@ public:
   template <typename ValueSelector>
   Queryable<T> order_by(ValueSelector value_selector, bool descending = false);
 
+  /**
+   * @brief Orders the sequence by the selected value, spilling sorted runs to
+   * temporary files instead of sorting all items at once.
+   *
+   * @remark See @ref Stream<T>::order_by.
+   *
+   * @tparam ValueSelector Transform to value function type.
+   * std::function<V(const T&)>
+   * @param value_selector Transform to value function to apply to each item.
+   * @param descending True if to order by greater to smaller values, otherwise
+   * smaller to greater.
+   * @param budget Memory the sorted items may hold and where to spill them.
+   * @return Stream<T> The ordered items, merged as they are pulled.
+   */
+  template <typename ValueSelector>
+  Stream<T> order_by(
+      ValueSelector value_selector, bool descending,
+      spill::MemoryBudget budget);
+
+  /**
+   * @brief Records statistics of every operator applied to the query from
+   * here on: rows in and out, wall and CPU time, and allocations.
+   *
+   * @code
+   * auto profiled = fcpp::query(items).profile().where(pred).select(sel);
+   * auto result = profiled.to_vector();
+   * profiled.report(std::cout);
+   * @endcode
+   *
+   * @remark Only available if profiling is compiled in, see
+   * @ref profile::kEnabled. Operators that produce another query are
+   * recorded; terminal operations and lazy streams are not. Allocations are
+   * only counted if the program records them, see
+   * @ref profile::record_allocation, and are counted for the whole process,
+   * so other threads allocating at the same time are included.
+   *
+   * @return Queryable<T>
+   */
+  Queryable<T> profile();
+
+  /**
+   * @brief Gets the statistics recorded since @ref profile was called.
+   *
+   * @return const profile::Profile* Statistics or nullptr if the query is
+   * not profiled.
+   */
+  const profile::Profile *profiling() const;
+
+  /**
+   * @brief Prints the statistics recorded since @ref profile was called, an
+   * operator per row.
+   *
+   * @param out Stream to print to.
+   */
+  void report(std::ostream &out) const;
+
   /**
    * @brief Inverts the order of the items in the sequence.
    *
@@ -434,6 +628,18 @@ public:
   template <typename Selector>
   auto select(Selector selector);
 
+  /**
+   * @brief Projects each item into a sequence and flattens the sequences as
+   * they are produced, without building a sequence-of-sequences first.
+   *
+   * @tparam Selector Transform to sequence function type.
+   * std::function<Range<U>(T)>
+   * @param selector Transform to sequence function to apply to each item.
+   * @return Queryable<U>
+   */
+  template <typename Selector>
+  auto select_many(Selector selector);
+
   /**
    * @brief Randomizes / shuffles all the item's order in the sequence.
    *
@@ -511,7 +717,8 @@ public:
   /**
    * @brief Groups items by a selected key value and puts them into a hash map.
    *
-   * @tparam KeySelector Transform to key function type. std::function<K(T)>
+   * @tparam KeySelector Transform to key function type.
+   * std::function<K(const T&)>
    * @param key_selector Transform to key function to apply to each item.
    * @return std::map<K, std::vector<T>>
    */
@@ -522,11 +729,12 @@ public:
    * @brief Groups items by selected key value, takes the first item of every
    * group, and puts them into a hash map.
    *
-   * @tparam KeySelector Transform to key function type. std::function<K(T)>
+   * @tparam KeySelector Transform to key function type.
+   * std::function<K(const T&)>
    * @param key_selector Transform to key function to apply to each item.
    * @return std::map<K, T>
    */
-  template <typename KeySelector /* = std::function<K(T)>*/>
+  template <typename KeySelector /* = std::function<K(const T&)>*/>
   auto to_single_value_map(KeySelector key_selector);
 
   /**
@@ -562,40 +770,54 @@ public:
   Queryable<T> where(Predicate predicate);
 
   /**
-   * @brief Produces a sequence of tuples with items from the two specified
-   * sequences.
+   * @brief Pairs the items of the two sequences by position.
+   *
+   * @remark No tuples are built until the result is materialized, see
+   * @ref Zipped.
    *
    * @tparam U Type of the right hand side items.
-   * @param rhs_items Right hand side items of the produced tuple sequence.
+   * @param rhs_items Right hand side items of the zipped sequence.
    * @param truncate Truncate the combined sequence by the minimum size of the
-   * two. If false both T and U must have a default constructor so default
-   * values can be provided if one sequence is larger than the other.
-   * @return Queryable<std::tuple<T, U>>
+   * two. If false the shorter side is padded when tuples are built, which
+   * requires a default constructor, see @ref Zipped.
+   * @return Zipped<T, U>
    */
   template <typename U>
-  Queryable<std::tuple<T, U>>
-  zip(std::vector<U> rhs_items, bool truncate = false);
+  Zipped<T, U> zip(std::vector<U> rhs_items, bool truncate = false);
 
   /**
-   * @brief Produces a sequence of tuples with items from the two specified
-   * sequences.
+   * @brief Pairs the items of the two sequences by position.
+   *
+   * @remark No tuples are built until the result is materialized, see
+   * @ref Zipped.
    *
    * @tparam U Type of the right hand side items.
-   * @param rhs_items Right hand side items of the produced tuple sequence.
+   * @param rhs_items Right hand side items of the zipped sequence.
    * @param truncate Truncate the combined sequence by the minimum size of the
-   * two. If false both T and U must have a default constructor so default
-   * values can be provided if one sequence is larger than the other.
-   * @return Queryable<std::tuple<T, U>>
+   * two. If false the shorter side is padded when tuples are built, which
+   * requires a default constructor, see @ref Zipped.
+   * @return Zipped<T, U>
    */
   template <typename U>
-  Queryable<std::tuple<T, U>>
-  zip(std::initializer_list<U> rhs_items, bool truncate);
+  Zipped<T, U> zip(std::initializer_list<U> rhs_items, bool truncate);
 
 private:
+  template <typename U>
+  friend class Queryable;
+
   /**
    * @brief Sequence of items to be queried over.
    */
   std::vector<T> items_;
+  /**
+   * @brief Profile the operators are recorded to, if profiled.
+   */
+  [[no_unique_address]] profile::Handle profile_;
+  /**
+   * @brief True if the items are known to be sorted and free of duplicates,
+   * so that @ref distinct has nothing left to do.
+   */
+  bool distinct_ = false;
 };
 
 } // namespace fcpp
@@ -609,11 +831,94 @@ private:
 
 namespace fcpp {
 
+namespace detail {
+
+/**
+ * @brief Indicates if binary searching every item of a sorted sequence in
+ * another is cheaper than walking both, going by their sizes.
+ *
+ * @param searched_size Size of the sequence whose items are searched for.
+ * @param searched_in_size Size of the sequence searched in.
+ * @return true Searching takes fewer comparisons.
+ * @return false Walking takes fewer comparisons.
+ */
+inline bool searches_faster(size_t searched_size, size_t searched_in_size) {
+  return searched_size * std::bit_width(searched_in_size) < searched_in_size;
+}
+
+/**
+ * @brief Items grouped by key. Groups are in the order their keys were first
+ * seen and ordinals gives the group of each key, in key order.
+ */
+template <typename K, typename T>
+struct KeyedGroups {
+  std::map<K, size_t> ordinals;
+  std::vector<std::vector<T>> groups;
+};
+
+/**
+ * @brief Groups items by key. The groups are sized in a first pass so that
+ * each item is moved into its group exactly once.
+ *
+ * @param items Items to group, left moved from.
+ * @param key_selector Transform to key function, called once per item.
+ * @return KeyedGroups<K, T>
+ */
+template <typename K, typename T, typename KeySelector>
+KeyedGroups<K, T>
+group_by_key(std::vector<T> &items, KeySelector &key_selector) {
+  KeyedGroups<K, T> keyed;
+  std::vector<size_t> item_ordinals;
+  item_ordinals.reserve(items.size());
+  std::vector<size_t> sizes;
+  for (const T &item : items) {
+    auto [it, inserted] =
+        keyed.ordinals.try_emplace(key_selector(item), sizes.size());
+    if (inserted) {
+      sizes.push_back(0);
+    }
+    sizes[it->second]++;
+    item_ordinals.push_back(it->second);
+  }
+  keyed.groups.resize(sizes.size());
+  for (size_t i = 0; i < sizes.size(); i++) {
+    keyed.groups[i].reserve(sizes[i]);
+  }
+  for (size_t i = 0; i < items.size(); i++) {
+    keyed.groups[item_ordinals[i]].push_back(std::move(items[i]));
+  }
+  return keyed;
+}
+
+/**
+ * @brief Indicates if scanning the right hand side of a join for each left
+ * hand side key (nested loop join) is cheaper than grouping it by key in a
+ * tree first, going by their sizes. Allocating a node of the tree is taken to
+ * cost about as much as 32 comparisons.
+ *
+ * @param lhs_size Size of the left hand side sequence.
+ * @param rhs_size Size of the right hand side sequence.
+ * @return true Scanning is cheaper.
+ * @return false Grouping is cheaper.
+ */
+inline bool scans_faster(size_t lhs_size, size_t rhs_size) {
+  constexpr size_t node_cost = 32;
+  return lhs_size * rhs_size <=
+         lhs_size * std::bit_width(rhs_size) + rhs_size * node_cost;
+}
+
+} // namespace detail
+
 template <typename T>
 Queryable<T> query(std::vector<T> items) {
   return Queryable<T>(std::move(items));
 }
 
+template <typename T>
+SpanQueryable<T> query(std::span<const T> items) {
+  return SpanQueryable<T>(items);
+}
+
 template <typename T>
 Queryable<T>::Queryable(std::vector<T> items) : items_(std::move(items)) {}
 
@@ -642,10 +947,13 @@ template <typename T>
 template <typename ActionFn>
 Queryable<T> Queryable<T>::action(ActionFn action_func) {
   // @todo Check that ActionFn is a unary operation.
+  profile::Scope scope(profile_, "action", items_.size());
   std::for_each(items_.begin(), items_.end(), [&action_func](auto item) {
     action_func(item);
   });
-  return Queryable<T>(std::move(items_));
+  Queryable<T> result(std::move(items_));
+  scope.finish(result.size(), result.profile_);
+  return result;
 }
 
 template <typename T>
@@ -666,13 +974,32 @@ Queryable<T> Queryable<T>::difference(std::vector<T> rhs_items) {
       traits::is_equality_comparable<T>::value,
       "T must be equality comparable.");
   // @todo Bubble up concepts for comparisons.
+  profile::Scope scope(profile_, "difference", items_.size());
   std::vector<T> difference;
-  std::set_difference(
-      std::make_move_iterator(items_.begin()),
-      std::make_move_iterator(items_.end()),
-      std::make_move_iterator(rhs_items.begin()),
-      std::make_move_iterator(rhs_items.end()), std::back_inserter(difference));
-  return Queryable<T>(std::move(difference));
+  if (detail::searches_faster(items_.size(), rhs_items.size())) {
+    // Same as std::set_difference, where every match consumes a right hand
+    // side item.
+    auto rhs_it = rhs_items.begin();
+    for (T &item : items_) {
+      rhs_it = std::lower_bound(rhs_it, rhs_items.end(), item);
+      if (rhs_it != rhs_items.end() && !(item < *rhs_it)) {
+        ++rhs_it;
+        continue;
+      }
+      difference.push_back(std::move(item));
+    }
+  } else {
+    std::set_difference(
+        std::make_move_iterator(items_.begin()),
+        std::make_move_iterator(items_.end()),
+        std::make_move_iterator(rhs_items.begin()),
+        std::make_move_iterator(rhs_items.end()),
+        std::back_inserter(difference));
+  }
+  Queryable<T> result(std::move(difference));
+  result.distinct_ = distinct_;
+  scope.finish(result.size(), result.profile_);
+  return result;
 }
 
 template <typename T>
@@ -680,11 +1007,33 @@ Queryable<T> Queryable<T>::distinct() {
   static_assert(
       traits::is_equality_comparable<T>::value,
       "T must be equality comparable.");
-  // @todo Reduce the number of transforms.
-  std::set<T> distinguished(
-      std::make_move_iterator(items_.begin()),
-      std::make_move_iterator(items_.end()));
-  return Queryable<T>(transforms::to_vector(std::move(distinguished)));
+  profile::Scope scope(profile_, "distinct", items_.size());
+  if (distinct_) {
+    Queryable<T> result(std::move(*this));
+    scope.finish(result.size(), result.profile_);
+    return result;
+  }
+  if constexpr (
+      std::is_move_assignable_v<T> && std::is_move_constructible_v<T>) {
+    // Stable so the first of equal items is kept, like a set would.
+    if (!std::is_sorted(items_.begin(), items_.end())) {
+      std::stable_sort(items_.begin(), items_.end());
+    }
+    items_.erase(
+        std::unique(
+            items_.begin(), items_.end(),
+            [](const T &lhs, const T &rhs) { return !(lhs < rhs); }),
+        items_.end());
+  } else {
+    std::set<T> distinguished(
+        std::make_move_iterator(items_.begin()),
+        std::make_move_iterator(items_.end()));
+    items_ = transforms::to_vector(std::move(distinguished));
+  }
+  Queryable<T> result(std::move(items_));
+  result.distinct_ = true;
+  scope.finish(result.size(), result.profile_);
+  return result;
 }
 
 template <typename T>
@@ -706,61 +1055,141 @@ template <typename T>
 auto Queryable<T>::flatten() {
   // @todo asserts::invariant T is a vector.
   using U = T::value_type;
+  // Minimum number of items moved per parallel block.
+  constexpr size_t block_size = 1 << 16;
+  profile::Scope scope(profile_, "flatten", items_.size());
+
+  // Offset of every sub sequence in the flattened sequence.
+  std::vector<size_t> offsets(items_.size() + 1, 0);
+  std::transform_inclusive_scan(
+      items_.begin(), items_.end(), offsets.begin() + 1, std::plus<>(),
+      [](const T &item) { return item.size(); });
+  size_t size = offsets.back();
+
   std::vector<U> flattened;
-  for (T &item : items_) {
-    for (U &sub_item : item) {
-      flattened.push_back(std::move(sub_item));
+  if constexpr (
+      std::is_default_constructible_v<U> && std::is_move_assignable_v<U>) {
+    if (size >= 2 * block_size) {
+      // Each block moves into its own disjoint range of the result.
+      flattened.resize(size);
+      size_t items_per_block =
+          std::max<size_t>(1, items_.size() * block_size / size);
+      scheduler::parallel_for(
+          0, items_.size(), items_per_block, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+              std::move(
+                  items_[i].begin(), items_[i].end(),
+                  flattened.begin() + offsets[i]);
+            }
+          });
+      Queryable<U> result(std::move(flattened));
+      scope.finish(result.size(), result.profile_);
+      return result;
     }
   }
-  return Queryable<U>(std::move(flattened));
+
+  flattened.reserve(size);
+  for (T &item : items_) {
+    std::move(item.begin(), item.end(), std::back_inserter(flattened));
+  }
+  Queryable<U> result(std::move(flattened));
+  scope.finish(result.size(), result.profile_);
+  return result;
 }
 
 template <typename T>
 template <typename KeySelector>
 Queryable<std::vector<T>> Queryable<T>::group_by(KeySelector key_selector) {
-  using K = decltype(key_selector(*items_.begin()));
+  static_assert(
+      std::is_invocable_v<KeySelector &, const T &>,
+      "Key selector must be callable on a const reference to an item.");
+  static_assert(
+      !traits::is_copying_selector<KeySelector, T>::value,
+      "Key selector must take items by reference, not copy every item.");
+  using K = traits::key_of_t<KeySelector, T>;
   static_assert(
       traits::is_less_than_comparable<K>::value,
       "Key selector must produce a value that is less-than comparable.");
+  profile::Scope scope(profile_, "group_by", items_.size());
 
-  std::map<K, std::vector<T>> keyed_groups;
-  std::for_each(
-      std::make_move_iterator(items_.begin()),
-      std::make_move_iterator(items_.end()), [&](auto item) {
-        keyed_groups[key_selector(item)].push_back(std::move(item));
-      });
-
+  auto keyed = detail::group_by_key<K>(items_, key_selector);
   std::vector<std::vector<T>> groups;
-  groups.resize(keyed_groups.size());
-  std::transform(
-      std::make_move_iterator(keyed_groups.begin()),
-      std::make_move_iterator(keyed_groups.end()), groups.begin(),
-      [this](std::pair<K, std::vector<T>> pair) {
-        return std::move(pair.second);
-      });
+  groups.reserve(keyed.groups.size());
+  for (const auto &[key, ordinal] : keyed.ordinals) {
+    groups.push_back(std::move(keyed.groups[ordinal]));
+  }
 
-  return Queryable<std::vector<T>>(std::move(groups));
+  Queryable<std::vector<T>> result(std::move(groups));
+  scope.finish(result.size(), result.profile_);
+  return result;
+}
+
+template <typename T>
+template <typename KeySelector>
+Stream<std::vector<T>>
+Queryable<T>::group_by(KeySelector key_selector, spill::MemoryBudget budget) {
+  return lazy().group_by(std::move(key_selector), std::move(budget));
 }
 
 template <typename T>
 Queryable<T> Queryable<T>::intersect(const std::vector<T> &rhs_items) {
   // @todo Investigate potential copies of rhs_items when set_intersection
   // called.
+  profile::Scope scope(profile_, "intersect", items_.size());
   std::vector<T> intersection;
-  std::set_intersection(
-      std::make_move_iterator(items_.begin()),
-      std::make_move_iterator(items_.end()), rhs_items.begin(), rhs_items.end(),
-      std::back_inserter(intersection));
-  return Queryable<T>(std::move(intersection));
+  // Same as std::set_intersection, where every match consumes an item of
+  // both sides and the left hand side item is kept.
+  if (detail::searches_faster(items_.size(), rhs_items.size())) {
+    auto rhs_it = rhs_items.begin();
+    for (T &item : items_) {
+      rhs_it = std::lower_bound(rhs_it, rhs_items.end(), item);
+      if (rhs_it == rhs_items.end()) {
+        break;
+      }
+      if (!(item < *rhs_it)) {
+        intersection.push_back(std::move(item));
+        ++rhs_it;
+      }
+    }
+  } else if (detail::searches_faster(rhs_items.size(), items_.size())) {
+    auto lhs_it = items_.begin();
+    for (const T &rhs_item : rhs_items) {
+      lhs_it = std::lower_bound(lhs_it, items_.end(), rhs_item);
+      if (lhs_it == items_.end()) {
+        break;
+      }
+      if (!(rhs_item < *lhs_it)) {
+        intersection.push_back(std::move(*lhs_it));
+        ++lhs_it;
+      }
+    }
+  } else {
+    std::set_intersection(
+        std::make_move_iterator(items_.begin()),
+        std::make_move_iterator(items_.end()), rhs_items.begin(),
+        rhs_items.end(), std::back_inserter(intersection));
+  }
+  Queryable<T> result(std::move(intersection));
+  result.distinct_ = distinct_;
+  scope.finish(result.size(), result.profile_);
+  return result;
 }
 
 template <typename T>
 template <typename U, typename LhsKeySelector, typename RhsKeySelector>
-Queryable<std::tuple<T, U>> Queryable<T>::join(
+Zipped<T, U, false> Queryable<T>::join(
     std::vector<U> rhs_items, LhsKeySelector lhs_key_selector,
     RhsKeySelector rhs_key_selector) {
-  using KU = decltype(rhs_key_selector(*rhs_items.begin()));
-  using KT = decltype(rhs_key_selector(*items_.begin()));
+  static_assert(
+      std::is_invocable_v<LhsKeySelector &, const T &> &&
+          std::is_invocable_v<RhsKeySelector &, const U &>,
+      "Key selectors must be callable on a const reference to an item.");
+  static_assert(
+      !traits::is_copying_selector<LhsKeySelector, T>::value &&
+          !traits::is_copying_selector<RhsKeySelector, U>::value,
+      "Key selectors must take items by reference, not copy every item.");
+  using KT = traits::key_of_t<LhsKeySelector, T>;
+  using KU = traits::key_of_t<RhsKeySelector, U>;
   static_assert(
       std::is_same<KU, KT>::value,
       "Left and right hand key selectors must produce the same type.");
@@ -770,42 +1199,130 @@ Queryable<std::tuple<T, U>> Queryable<T>::join(
       traits::is_less_than_comparable<K>::value,
       "Key selectors must produce a type that is less-than compareable.");
 
-  std::map<K, std::vector<U>> rhs_mapped;
-  std::for_each(
-      std::make_move_iterator(rhs_items.begin()),
-      std::make_move_iterator(rhs_items.end()), [&, this](U rhs_item) {
-        rhs_mapped[rhs_key_selector(rhs_item)].push_back(std::move(rhs_item));
-      });
-
-  std::vector<std::tuple<T, U>> joined;
-  std::for_each(
-      std::make_move_iterator(items_.begin()),
-      std::make_move_iterator(items_.end()), [&, this](auto lhs_item) {
-        auto lhs_key = lhs_key_selector(lhs_item);
-        auto rhs_it = rhs_mapped.find(lhs_key);
-        if (rhs_it != rhs_mapped.end()) {
-          for (U &rhs_item : rhs_it->second) {
-            joined.push_back({std::move(lhs_item), std::move(rhs_item)});
-          }
+  // Right hand side group of a key along with how many left hand side items
+  // still have to be paired with it, so the last pairing can move.
+  struct Group {
+    std::vector<U> items;
+    size_t lhs_remaining = 0;
+  };
+  // Chosen by the sizes of both sides, either groups are scanned in a
+  // vector or looked up in a tree.
+  bool scanned = detail::scans_faster(items_.size(), rhs_items.size());
+  std::vector<std::pair<K, Group>> rhs_scanned;
+  std::map<K, Group> rhs_mapped;
+  auto find = [&](const K &key) -> Group * {
+    if (scanned) {
+      for (auto &[rhs_key, group] : rhs_scanned) {
+        if (!(rhs_key < key) && !(key < rhs_key)) {
+          return &group;
         }
-      });
+      }
+      return nullptr;
+    }
+    auto rhs_it = rhs_mapped.find(key);
+    return rhs_it != rhs_mapped.end() ? &rhs_it->second : nullptr;
+  };
+  if (scanned) {
+    rhs_scanned.reserve(rhs_items.size());
+    for (U &rhs_item : rhs_items) {
+      K key = rhs_key_selector(std::as_const(rhs_item));
+      Group *group = find(key);
+      if (group == nullptr) {
+        group = &rhs_scanned.emplace_back(std::move(key), Group()).second;
+      }
+      group->items.push_back(std::move(rhs_item));
+    }
+  } else {
+    for (U &rhs_item : rhs_items) {
+      rhs_mapped[rhs_key_selector(std::as_const(rhs_item))].items.push_back(
+          std::move(rhs_item));
+    }
+  }
+
+  std::vector<Group *> lhs_groups;
+  lhs_groups.reserve(items_.size());
+  size_t joined_size = 0;
+  for (T &lhs_item : items_) {
+    Group *group = find(lhs_key_selector(std::as_const(lhs_item)));
+    if (group != nullptr) {
+      group->lhs_remaining++;
+      joined_size += group->items.size();
+    }
+    lhs_groups.push_back(group);
+  }
+
+  std::vector<T> lhs_joined;
+  std::vector<U> rhs_joined;
+  lhs_joined.reserve(joined_size);
+  rhs_joined.reserve(joined_size);
+  for (size_t i = 0; i < items_.size(); i++) {
+    Group *group = lhs_groups[i];
+    if (group == nullptr) {
+      continue;
+    }
+    bool last_lhs = --group->lhs_remaining == 0;
+    for (size_t j = 0; j < group->items.size(); j++) {
+      lhs_joined.push_back(
+          transforms::move_or_copy(items_[i], j + 1 == group->items.size()));
+      rhs_joined.push_back(
+          transforms::move_or_copy(group->items[j], last_lhs));
+    }
+  }
+
+  return Zipped<T, U, false>(
+      std::move(lhs_joined), std::move(rhs_joined), /*truncate=*/true);
+}
 
-  return Queryable<std::tuple<T, U>>(std::move(joined));
+template <typename T>
+template <typename U, typename LhsKeySelector, typename RhsKeySelector>
+Stream<std::pair<T, U>> Queryable<T>::join(
+    std::vector<U> rhs_items, LhsKeySelector lhs_key_selector,
+    RhsKeySelector rhs_key_selector, spill::MemoryBudget budget) {
+  return lazy().join(
+      Stream<U>::from_vector(std::move(rhs_items)),
+      std::move(lhs_key_selector), std::move(rhs_key_selector),
+      std::move(budget));
 }
 
 template <typename T>
 template <typename KeySelector>
 auto Queryable<T>::keyed_group_by(KeySelector key_selector) {
-  using K = decltype(key_selector(*items_.begin()));
-
-  std::map<K, std::vector<T>> mapped;
-  for (int i = 0; i < items_.size(); i++) {
-    // @todo Avoid a copy of items_[i] on key_selector call for large objects.
-    mapped[key_selector(items_[i])].push_back(std::move(items_[i]));
+  static_assert(
+      std::is_invocable_v<KeySelector &, const T &>,
+      "Key selector must be callable on a const reference to an item.");
+  static_assert(
+      !traits::is_copying_selector<KeySelector, T>::value,
+      "Key selector must take items by reference, not copy every item.");
+  using K = traits::key_of_t<KeySelector, T>;
+  static_assert(
+      traits::is_less_than_comparable<K>::value,
+      "Key selector must produce a value that is less-than comparable.");
+  profile::Scope scope(profile_, "keyed_group_by", items_.size());
+
+  auto keyed = detail::group_by_key<K>(items_, key_selector);
+  // Extracted so the keys move out too.
+  std::vector<std::pair<K, std::vector<T>>> groups;
+  groups.reserve(keyed.groups.size());
+  while (!keyed.ordinals.empty()) {
+    auto node = keyed.ordinals.extract(keyed.ordinals.begin());
+    groups.emplace_back(
+        std::move(node.key()), std::move(keyed.groups[node.mapped()]));
   }
-  return Queryable<std::pair<K, std::vector<T>>>(
-      {std::make_move_iterator(mapped.begin()),
-       std::make_move_iterator(mapped.end())});
+  Queryable<std::pair<K, std::vector<T>>> result(std::move(groups));
+  scope.finish(result.size(), result.profile_);
+  return result;
+}
+
+template <typename T>
+template <typename KeySelector>
+auto Queryable<T>::keyed_group_by(
+    KeySelector key_selector, spill::MemoryBudget budget) {
+  return lazy().keyed_group_by(std::move(key_selector), std::move(budget));
+}
+
+template <typename T>
+Stream<T> Queryable<T>::lazy(size_t morsel_size) {
+  return Stream<T>::from_vector(std::move(items_), morsel_size);
 }
 
 template <typename T>
@@ -824,6 +1341,9 @@ T Queryable<T>::max() {
 template <typename T>
 template <typename ValueSelector>
 T Queryable<T>::max(ValueSelector value_selector) {
+  static_assert(
+      !traits::is_copying_selector<ValueSelector, T>::value,
+      "Value selector must take items by reference, not copy every item.");
   static_assert(
       traits::is_less_than_comparable<decltype(value_selector(
           *items_.begin()))>::value,
@@ -853,8 +1373,11 @@ T Queryable<T>::min() {
 }
 
 template <typename T>
-template <typename ValueSelector /* = std::function<K(T)>*/>
+template <typename ValueSelector /* = std::function<V(const T&)>*/>
 T Queryable<T>::min(ValueSelector value_selector) {
+  static_assert(
+      !traits::is_copying_selector<ValueSelector, T>::value,
+      "Value selector must take items by reference, not copy every item.");
   static_assert(
       traits::is_less_than_comparable<decltype(value_selector(
           *items_.begin()))>::value,
@@ -874,6 +1397,9 @@ template <typename T>
 template <typename ValueSelector>
 Queryable<T>
 Queryable<T>::order_by(ValueSelector value_selector, bool descending) {
+  static_assert(
+      !traits::is_copying_selector<ValueSelector, T>::value,
+      "Value selector must take items by reference, not copy every item.");
   static_assert(
       std::is_copy_assignable_v<T> ||
           (std::is_move_assignable_v<T> && std::is_move_constructible_v<T>),
@@ -885,6 +1411,7 @@ Queryable<T>::order_by(ValueSelector value_selector, bool descending) {
       "ValueSelector return type must be less-than compareable.");
 
   using K = decltype(value_selector(*items_.begin()));
+  profile::Scope scope(profile_, "order_by", items_.size());
   std::sort(
       items_.begin(), items_.end(),
       [&value_selector, descending](const auto &lhs, const auto &rhs) -> bool {
@@ -893,19 +1420,62 @@ Queryable<T>::order_by(ValueSelector value_selector, bool descending) {
         return descending ? lhs_value > rhs_value : lhs_value < rhs_value;
       });
 
-  return Queryable<T>(std::move(items_));
+  Queryable<T> result(std::move(items_));
+  scope.finish(result.size(), result.profile_);
+  return result;
+}
+
+template <typename T>
+template <typename ValueSelector>
+Stream<T> Queryable<T>::order_by(
+    ValueSelector value_selector, bool descending,
+    spill::MemoryBudget budget) {
+  return lazy().order_by(
+      std::move(value_selector), descending, std::move(budget));
+}
+
+template <typename T>
+Queryable<T> Queryable<T>::profile() {
+  static_assert(
+      profile::kEnabled && sizeof(T) > 0,
+      "Profiling must be compiled in by defining FCPP_PROFILING.");
+#ifdef FCPP_PROFILING
+  profile_ = std::make_shared<profile::Profile>();
+#endif
+  return Queryable<T>(std::move(*this));
+}
+
+template <typename T>
+const profile::Profile *Queryable<T>::profiling() const {
+#ifdef FCPP_PROFILING
+  return profile_.get();
+#else
+  return nullptr;
+#endif
+}
+
+template <typename T>
+void Queryable<T>::report(std::ostream &out) const {
+  const profile::Profile *profiled = profiling();
+  asserts::invariant::eval(profiled != nullptr)
+      << "Query must be profiled to report on it.";
+  profiled->report(out);
 }
 
 template <typename T>
 Queryable<T> Queryable<T>::reverse() {
+  profile::Scope scope(profile_, "reverse", items_.size());
   std::reverse(items_.begin(), items_.end());
-  return Queryable<T>(std::move(items_));
+  Queryable<T> result(std::move(items_));
+  scope.finish(result.size(), result.profile_);
+  return result;
 }
 
 template <typename T>
 template <typename Selector /* = std::function<U(T)>*/>
 auto Queryable<T>::select(Selector selector) {
   using U = decltype(selector(*items_.begin()));
+  profile::Scope scope(profile_, "select", items_.size());
   std::vector<U> selected;
   selected.reserve(items_.size());
   std::transform(
@@ -913,14 +1483,37 @@ auto Queryable<T>::select(Selector selector) {
       std::make_move_iterator(items_.end()), std::back_inserter(selected),
       selector);
 
-  return Queryable<U>(std::move(selected));
+  Queryable<U> result(std::move(selected));
+  scope.finish(result.size(), result.profile_);
+  return result;
+}
+
+template <typename T>
+template <typename Selector>
+auto Queryable<T>::select_many(Selector selector) {
+  using Range = decltype(selector(std::move(*items_.begin())));
+  using U = std::decay_t<decltype(*std::begin(std::declval<Range &>()))>;
+  profile::Scope scope(profile_, "select_many", items_.size());
+  std::vector<U> selected;
+  selected.reserve(items_.size());
+  for (T &item : items_) {
+    Range range = selector(std::move(item));
+    std::move(
+        std::begin(range), std::end(range), std::back_inserter(selected));
+  }
+  Queryable<U> result(std::move(selected));
+  scope.finish(result.size(), result.profile_);
+  return result;
 }
 
 template <typename T>
 Queryable<T> Queryable<T>::shuffle() {
+  profile::Scope scope(profile_, "shuffle", items_.size());
   std::shuffle(
       items_.begin(), items_.end(), std::mt19937(std::random_device()()));
-  return Queryable<T>(std::move(items_));
+  Queryable<T> result(std::move(items_));
+  scope.finish(result.size(), result.profile_);
+  return result;
 }
 
 template <typename T>
@@ -934,9 +1527,13 @@ Queryable<T> Queryable<T>::skip(size_t value) {
       << "Skip value " << value
       << " must be less than or equal to sequence size of " << size() << ".";
 
-  return Queryable<T>(
+  profile::Scope scope(profile_, "skip", items_.size());
+  Queryable<T> result(
       {std::make_move_iterator(items_.begin() + value),
        std::make_move_iterator(items_.end())});
+  result.distinct_ = distinct_;
+  scope.finish(result.size(), result.profile_);
+  return result;
 }
 
 template <typename T>
@@ -952,6 +1549,7 @@ Queryable<T>::slice(size_t start_index, size_t size, size_t stride) {
       << " must be less than or equal to the sequence size of " << this->size()
       << ".";
 
+  profile::Scope scope(profile_, "slice", items_.size());
   std::vector<T> sliced;
   sliced.reserve(size);
 
@@ -961,7 +1559,9 @@ Queryable<T>::slice(size_t start_index, size_t size, size_t stride) {
     i += stride;
   }
 
-  return Queryable<T>(std::move(sliced));
+  Queryable<T> result(std::move(sliced));
+  scope.finish(result.size(), result.profile_);
+  return result;
 }
 
 template <typename T>
@@ -976,9 +1576,13 @@ Queryable<T> Queryable<T>::take(size_t value) {
       << "Take value " << value
       << " must be less than or equal to sequence size of " << size() << ".";
 
-  return Queryable<T>(
+  profile::Scope scope(profile_, "take", items_.size());
+  Queryable<T> result(
       {std::make_move_iterator(items_.begin()),
        std::make_move_iterator(items_.begin() + value)});
+  result.distinct_ = distinct_;
+  scope.finish(result.size(), result.profile_);
+  return result;
 }
 
 template <typename T>
@@ -987,6 +1591,7 @@ Queryable<T> Queryable<T>::take_random(size_t value) {
       << "Take random value " << value
       << " must be less than or equal to sequence size of " << size() << ".";
 
+  profile::Scope scope(profile_, "take_random", items_.size());
   std::vector<int> indices;
   indices.reserve(items_.size());
   for (int i = 0; i < items_.size(); i++) {
@@ -1002,38 +1607,51 @@ Queryable<T> Queryable<T>::take_random(size_t value) {
       indices.begin(), indices.end(), std::back_inserter(random_items),
       [this](int i) { return std::move(items_[i]); });
 
-  return Queryable<T>(std::move(random_items));
+  Queryable<T> result(std::move(random_items));
+  scope.finish(result.size(), result.profile_);
+  return result;
 }
 
 template <typename T>
-template <typename KeySelector /* = std::function<K(T)>*/>
+template <typename KeySelector /* = std::function<K(const T&)>*/>
 auto Queryable<T>::to_multi_value_map(KeySelector key_selector) {
-  using K = decltype(key_selector(*items_.begin()));
+  static_assert(
+      std::is_invocable_v<KeySelector &, const T &>,
+      "Key selector must be callable on a const reference to an item.");
+  static_assert(
+      !traits::is_copying_selector<KeySelector, T>::value,
+      "Key selector must take items by reference, not copy every item.");
+  using K = traits::key_of_t<KeySelector, T>;
+  auto keyed = detail::group_by_key<K>(items_, key_selector);
   std::map<K, std::vector<T>> mapped;
-  std::for_each(items_.begin(), items_.end(), [&, this](auto &item) {
-    mapped[key_selector(item)].push_back(std::move(item));
-  });
+  while (!keyed.ordinals.empty()) {
+    auto node = keyed.ordinals.extract(keyed.ordinals.begin());
+    mapped.emplace_hint(
+        mapped.end(), std::move(node.key()),
+        std::move(keyed.groups[node.mapped()]));
+  }
   return mapped;
 }
 
 template <typename T>
-template <typename KeySelector /* = std::function<K(T)>*/>
+template <typename KeySelector /* = std::function<K(const T&)>*/>
 auto Queryable<T>::to_single_value_map(KeySelector key_selector) {
-  using K = decltype(key_selector(*items_.begin()));
+  static_assert(
+      std::is_invocable_v<KeySelector &, const T &>,
+      "Key selector must be callable on a const reference to an item.");
+  static_assert(
+      !traits::is_copying_selector<KeySelector, T>::value,
+      "Key selector must take items by reference, not copy every item.");
+  using K = traits::key_of_t<KeySelector, T>;
   static_assert(
       traits::is_less_than_comparable<K>::value,
       "KeySelector return type must be less-than compareable.");
 
   std::map<K, T> mapped;
-  std::for_each(
-      std::make_move_iterator(items_.begin()),
-      std::make_move_iterator(items_.end()), [&, this](auto item) {
-        K key = key_selector(item);
-        auto it = mapped.find(key);
-        if (it == mapped.end()) {
-          mapped.insert({std::move(key), std::move(item)});
-        }
-      });
+  for (T &item : items_) {
+    // Neither the key nor the item are moved if the key is already mapped.
+    mapped.try_emplace(key_selector(std::as_const(item)), std::move(item));
+  }
   return mapped;
 }
 
@@ -1058,8 +1676,12 @@ Queryable<T> Queryable<T>::trim(size_t size) {
       << "Size " << size << " must be less than or equal to sequence size of "
       << this->size() << ".";
 
+  profile::Scope scope(profile_, "trim", items_.size());
   items_.resize(items_.size() - size);
-  return Queryable<T>(std::move(items_));
+  Queryable<T> result(std::move(items_));
+  result.distinct_ = distinct_;
+  scope.finish(result.size(), result.profile_);
+  return result;
 }
 
 template <typename T>
@@ -1067,6 +1689,7 @@ Queryable<T> Queryable<T>::unionize(std::vector<T> rhs_items) {
   static_assert(
       traits::is_less_than_comparable<T>::value,
       "T must be less-than compareable.");
+  profile::Scope scope(profile_, "unionize", items_.size());
 
   std::set<T> unionized(
       std::make_move_iterator(items_.begin()),
@@ -1075,75 +1698,609 @@ Queryable<T> Queryable<T>::unionize(std::vector<T> rhs_items) {
       rhs_items.begin(), rhs_items.end(),
       std::inserter(unionized, unionized.end()));
 
-  return Queryable<T>(transforms::to_vector(std::move(unionized)));
+  Queryable<T> result(transforms::to_vector(std::move(unionized)));
+  result.distinct_ = true;
+  scope.finish(result.size(), result.profile_);
+  return result;
 }
 
 template <typename T>
 template <typename Predicate>
 Queryable<T> Queryable<T>::where(Predicate predicate) {
+  profile::Scope scope(profile_, "where", items_.size());
   std::vector<T> filtered;
   std::copy_if(
       std::make_move_iterator(items_.begin()),
       std::make_move_iterator(items_.end()), std::back_inserter(filtered),
       predicate);
-  return Queryable<T>(std::move(filtered));
+  Queryable<T> result(std::move(filtered));
+  result.distinct_ = distinct_;
+  scope.finish(result.size(), result.profile_);
+  return result;
 }
 
 template <typename T>
 template <typename U>
-Queryable<std::tuple<T, U>>
-Queryable<T>::zip(std::vector<U> rhs_items, bool truncate) {
-  if (!truncate) {
-    static_assert(
-        std::is_default_constructible_v<T>,
-        "T must have a default constructor so default values can "
-        "populate the tuple.");
-    static_assert(
-        std::is_default_constructible_v<U>,
-        "U must have a default constructor so default values can "
-        "populate the tuple.");
-  }
-
-  std::vector<std::tuple<T, U>> zipped;
-  zipped.reserve(
-      truncate ? std::min({items_.size(), rhs_items.size()})
-               : std::max({items_.size(), rhs_items.size()}));
-
-  int i = 0;
-  for (; i < std::min({items_.size(), rhs_items.size()}); i++) {
-    zipped.push_back({std::move(items_[i]), std::move(rhs_items[i])});
-  }
-
-  if (truncate) {
-    return Queryable<std::tuple<T, U>>(std::move(zipped));
-  }
-
-  if (items_.size() > rhs_items.size()) {
-    for (; i < items_.size(); i++) {
-      zipped.push_back({std::move(items_[i]), U()});
-    }
-  } else {
-    for (; i < rhs_items.size(); i++) {
-      zipped.push_back({T(), std::move(rhs_items[i])});
-    }
-  }
-  return Queryable<std::tuple<T, U>>(std::move(zipped));
+Zipped<T, U> Queryable<T>::zip(std::vector<U> rhs_items, bool truncate) {
+  return Zipped<T, U>(std::move(items_), std::move(rhs_items), truncate);
 }
 
 template <typename T>
 template <typename U>
-Queryable<std::tuple<T, U>>
+Zipped<T, U>
 Queryable<T>::zip(std::initializer_list<U> rhs_items, bool truncate) {
   return zip(std::vector<U>(std::move(rhs_items)), truncate);
 }
 
 /**
- * @brief Merge result of both if and else block queries from
- * Queryable<T>::branch method.
+ * @brief Two sequences zipped by position and stored side by side.
  *
- * @tparam FalseT Type of items projected from false / else block query.
- * @tparam TrueT Type of items projected from true / if block query.
- */
+ * Each side is kept in its own vector (struct of arrays) so projecting a
+ * single side is a move of that vector, and @ref where, @ref take and
+ * @ref skip work on both vectors in place. Tuples are only built when the
+ * sequence is materialized through @ref select, @ref to_vector or
+ * @ref materialize, or converted to Queryable<std::tuple<T, U>> for the other
+ * query operations.
+ *
+ * When zipped without truncation, the shorter side has no items at the tail
+ * positions. These are reported through @ref has_first and @ref has_second,
+ * and skipped by @ref first, @ref second and @ref select_present, which need
+ * no default constructor. Operations that build tuples fill them with default
+ * constructed items instead, so they only compile for such types.
+ *
+ * @tparam T Type of items from the left hand side sequence.
+ * @tparam U Type of items from the right hand side sequence.
+ * @tparam MayPad False if both sides always have the same size, like the
+ * matches of a join, so that no position is ever padded.
+ */
+template <typename T, typename U, bool MayPad>
+class Zipped final {
+public:
+  /**
+   * @brief Construct a new Zipped object from both sides of the sequence.
+   *
+   * @param first_items Left hand side items.
+   * @param second_items Right hand side items.
+   * @param truncate Truncate the combined sequence by the minimum size of the
+   * two.
+   */
+  explicit Zipped(
+      std::vector<T> first_items, std::vector<U> second_items, bool truncate)
+      : first_(std::move(first_items)), second_(std::move(second_items)) {
+    size_ = truncate ? std::min(first_.size(), second_.size())
+                     : std::max(first_.size(), second_.size());
+    // Erase instead of resize so truncating doesn't need a default
+    // constructor.
+    first_.erase(first_.begin() + std::min(size_, first_.size()), first_.end());
+    second_.erase(
+        second_.begin() + std::min(size_, second_.size()), second_.end());
+  }
+  Zipped() = delete;
+  virtual ~Zipped() = default;
+  Zipped(Zipped &&) = default;
+  Zipped(const Zipped &) = delete;
+  Zipped &operator=(const Zipped &) = delete;
+
+  /**
+   * @brief Type of items when materialized. Used for type deduction.
+   */
+  typedef std::tuple<T, U> item_type;
+
+  /**
+   * @brief Converts to the sequence of tuples, see @ref materialize.
+   *
+   * @return Queryable<std::tuple<T, U>>
+   */
+  operator Queryable<std::tuple<T, U>>() && { return materialize(); }
+
+  /**
+   * @brief Compares the sequence to tuples by position, padded positions
+   * comparing as default constructed items.
+   *
+   * @param lhs Left hand side zipped sequence.
+   * @param rhs Right hand side tuples.
+   * @return true if the sizes and all of the pairs are equal.
+   * @return false otherwise.
+   */
+  friend bool
+  operator==(const Zipped &lhs, const std::vector<std::tuple<T, U>> &rhs) {
+    if (lhs.size_ != rhs.size()) {
+      return false;
+    }
+    for (size_t i = 0; i < lhs.size_; i++) {
+      if (!equals(lhs.first_, i, std::get<0>(rhs[i])) ||
+          !equals(lhs.second_, i, std::get<1>(rhs[i]))) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /**
+   * @brief Indicates if the sequence is empty.
+   *
+   * @return true if the sequence is empty.
+   * @return false if the sequence is populated.
+   */
+  bool empty() const { return size_ == 0; }
+
+  /**
+   * @brief Gets the size of the zipped sequence.
+   *
+   * @return size_t
+   */
+  size_t size() const { return size_; }
+
+  /**
+   * @brief Indicates if the left hand side has an item at the position.
+   *
+   * @param index Position in the zipped sequence.
+   * @return true if the item came from the left hand side sequence.
+   * @return false if the position would be padded.
+   */
+  bool has_first(size_t index) const { return index < first_.size(); }
+
+  /**
+   * @brief Indicates if the right hand side has an item at the position.
+   *
+   * @param index Position in the zipped sequence.
+   * @return true if the item came from the right hand side sequence.
+   * @return false if the position would be padded.
+   */
+  bool has_second(size_t index) const { return index < second_.size(); }
+
+  /**
+   * @brief Projects the left hand side items without building any tuples.
+   *
+   * @remark Padded positions are skipped, so no default constructor is
+   * needed.
+   *
+   * @return Queryable<T>
+   */
+  Queryable<T> first() { return Queryable<T>(std::move(first_)); }
+
+  /**
+   * @brief Projects the right hand side items without building any tuples.
+   *
+   * @remark Padded positions are skipped, so no default constructor is
+   * needed.
+   *
+   * @return Queryable<U>
+   */
+  Queryable<U> second() { return Queryable<U>(std::move(second_)); }
+
+  /**
+   * @brief Builds the sequence of tuples to continue querying over it.
+   *
+   * @return Queryable<std::tuple<T, U>>
+   */
+  Queryable<std::tuple<T, U>> materialize() {
+    return Queryable<std::tuple<T, U>>(to_vector());
+  }
+
+  /**
+   * @brief Projects each pair of items into a new form.
+   *
+   * The selector is given a std::tuple<T &&, U &&> that refers to the items in
+   * place, so std::get on it doesn't copy the other side.
+   *
+   * @tparam Selector Transform function type. std::function<V(std::tuple<T,
+   * U>)>
+   * @param selector Transform function to apply to each pair.
+   * @return Queryable<V>
+   */
+  template <typename Selector>
+  auto select(Selector selector) {
+    pad(first_);
+    pad(second_);
+    using V = decltype(selector(std::forward_as_tuple(
+        std::move(*first_.begin()), std::move(*second_.begin()))));
+    std::vector<V> selected;
+    selected.reserve(size_);
+    for (size_t i = 0; i < size_; i++) {
+      selected.push_back(selector(std::forward_as_tuple(
+          std::move(first_[i]), std::move(second_[i]))));
+    }
+    return Queryable<V>(std::move(selected));
+  }
+
+  /**
+   * @brief Projects each pair of items into a new form without padding.
+   *
+   * The selector is given a std::tuple<T *, U *> that points to the items in
+   * place, or is nullptr at a padded position, so no default constructor is
+   * needed. The items may be moved from.
+   *
+   * @tparam Selector Transform function type. std::function<V(std::tuple<T *,
+   * U *>)>
+   * @param selector Transform function to apply to each pair.
+   * @return Queryable<V>
+   */
+  template <typename Selector>
+  auto select_present(Selector selector) {
+    using V = std::invoke_result_t<Selector &, std::tuple<T *, U *>>;
+    std::vector<V> selected;
+    selected.reserve(size_);
+    for (size_t i = 0; i < size_; i++) {
+      selected.push_back(selector(std::tuple<T *, U *>(
+          has_first(i) ? &first_[i] : nullptr,
+          has_second(i) ? &second_[i] : nullptr)));
+    }
+    return Queryable<V>(std::move(selected));
+  }
+
+  /**
+   * @brief Keeps the pairs that satisfy the predicate, filtering both sides in
+   * place without building any tuples.
+   *
+   * @tparam Predicate Condition function type. std::function<bool(const
+   * std::tuple<T, U>&)>
+   * @param predicate Function given a std::tuple<const T &, const U &> to
+   * test each pair for a condition.
+   * @return Zipped<T, U, MayPad>
+   */
+  template <typename Predicate>
+  Zipped where(Predicate predicate) {
+    pad(first_);
+    pad(second_);
+    size_t kept = 0;
+    for (size_t i = 0; i < size_; i++) {
+      if (!predicate(std::forward_as_tuple(
+              std::as_const(first_[i]), std::as_const(second_[i])))) {
+        continue;
+      }
+      if (kept != i) {
+        first_[kept] = std::move(first_[i]);
+        second_[kept] = std::move(second_[i]);
+      }
+      kept++;
+    }
+    resize(kept);
+    return std::move(*this);
+  }
+
+  /**
+   * @brief Takes the first pairs of the sequence.
+   *
+   * @param value Number of pairs to take.
+   * @return Zipped<T, U, MayPad>
+   */
+  Zipped take(size_t value) {
+    resize(std::min(value, size_));
+    return std::move(*this);
+  }
+
+  /**
+   * @brief Skips the first pairs of the sequence.
+   *
+   * @param value Number of pairs to skip.
+   * @return Zipped<T, U, MayPad>
+   */
+  Zipped skip(size_t value) {
+    size_t skipped = std::min(value, size_);
+    first_.erase(
+        first_.begin(), first_.begin() + std::min(skipped, first_.size()));
+    second_.erase(
+        second_.begin(), second_.begin() + std::min(skipped, second_.size()));
+    size_ -= skipped;
+    return std::move(*this);
+  }
+
+  /**
+   * @brief Gets the sequence as a vector of tuples.
+   *
+   * @return std::vector<std::tuple<T, U>>
+   */
+  std::vector<std::tuple<T, U>> to_vector() {
+    pad(first_);
+    pad(second_);
+    std::vector<std::tuple<T, U>> zipped;
+    zipped.reserve(size_);
+    for (size_t i = 0; i < size_; i++) {
+      zipped.emplace_back(std::move(first_[i]), std::move(second_[i]));
+    }
+    return zipped;
+  }
+
+  /**
+   * @brief Gets both sides as separate vectors without padding.
+   *
+   * @return std::pair<std::vector<T>, std::vector<U>>
+   */
+  std::pair<std::vector<T>, std::vector<U>> unzip() {
+    return {std::move(first_), std::move(second_)};
+  }
+
+private:
+  template <typename V>
+  static bool equals(const std::vector<V> &items, size_t index, const V &item) {
+    if (index < items.size()) {
+      return items[index] == item;
+    }
+    if constexpr (MayPad) {
+      static_assert(
+          std::is_default_constructible_v<V>,
+          "Zipped items must have a default constructor to pad the shorter "
+          "side. Use first, second or select_present otherwise.");
+      return V() == item;
+    } else {
+      return false;
+    }
+  }
+
+  template <typename V>
+  void pad(std::vector<V> &items) {
+    if constexpr (MayPad) {
+      static_assert(
+          std::is_default_constructible_v<V>,
+          "Zipped items must have a default constructor to pad the shorter "
+          "side. Use first, second or select_present otherwise.");
+      items.resize(size_);
+    }
+  }
+
+  /**
+   * @brief Shrinks the sequence to its first pairs, without padding.
+   */
+  void resize(size_t size) {
+    first_.erase(first_.begin() + std::min(size, first_.size()), first_.end());
+    second_.erase(
+        second_.begin() + std::min(size, second_.size()), second_.end());
+    size_ = size;
+  }
+
+  std::vector<T> first_;
+  std::vector<U> second_;
+  size_t size_;
+};
+
+/**
+ * @brief Read only query over items that are not owned, like a memory mapped
+ * file.
+ *
+ * Operations that only read, or that narrow the range (@ref skip,
+ * @ref take), work on the items in place. Operations that produce new items
+ * copy out only what they keep into a @ref Queryable<T> or @ref Stream<T>.
+ *
+ * @tparam T Type of items to query over.
+ */
+template <typename T>
+class SpanQueryable final {
+public:
+  /**
+   * @brief Construct a new SpanQueryable object over a range of items.
+   *
+   * @param items Items to query over.
+   * @param owner Keeps the memory behind the items alive for as long as the
+   * query and the ones narrowed from it. Null if owned elsewhere.
+   */
+  explicit SpanQueryable(
+      std::span<const T> items, std::shared_ptr<const void> owner = nullptr)
+      : items_(items), owner_(std::move(owner)) {}
+  SpanQueryable() = delete;
+  virtual ~SpanQueryable() = default;
+
+  /**
+   * @brief Type of items to query over. Used for type deduction.
+   */
+  typedef T item_type;
+
+  /**
+   * @brief Sums all the projected values of the sequence into a single value.
+   *
+   * @tparam U Accumulating value type.
+   * @tparam AccumulateFn std::function<U(U, const T &)> Transform function
+   * type.
+   * @param initial Value to start with before iterating sequence.
+   * @param accumulate_func Transform function to apply to each item.
+   * @return U The final accumulated value.
+   */
+  template <typename U, typename AccumulateFn>
+  U accumulate(U initial, AccumulateFn accumulate_func) const {
+    static_assert(
+        traits::is_additive<U>::value, "Initial value type must be additive.");
+    return std::accumulate(
+        items_.begin(), items_.end(), std::move(initial), accumulate_func);
+  }
+
+  /**
+   * @brief Determines whether all items of a sequence satisfy a condition.
+   *
+   * @param predicate Function to test each item for a condition.
+   * @return true if all items satisfy the predicate.
+   * @return false if one of the items doesn't satisfy the predicate.
+   */
+  template <typename Predicate>
+  bool all(Predicate predicate) const {
+    return std::all_of(items_.begin(), items_.end(), predicate);
+  }
+
+  /**
+   * @brief Determines whether a sequence contains any items.
+   *
+   * @param predicate Function to test each item for a condition.
+   * @return true if all of the items satisfy the predicate.
+   * @return false if none of the items satisfy the predicate.
+   */
+  template <typename Predicate>
+  bool any(Predicate predicate) const {
+    return std::any_of(items_.begin(), items_.end(), predicate);
+  }
+
+  /**
+   * @brief Indicates of the sequence is empty.
+   *
+   * @return true if the sequence is empty.
+   * @return false if the sequence is populated.
+   */
+  bool empty() const { return items_.empty(); }
+
+  /**
+   * @brief Gets a copy of the first item of a sequence, or a default value if
+   * no item is found.
+   *
+   * @param predicate Function to test each item for a condition.
+   * @return std::optional<T> Either the satisfying item or the not found item
+   * of std::nullopt
+   */
+  template <typename Predicate>
+  std::optional<T> first_or_default(Predicate predicate) const {
+    auto it = std::find_if(items_.begin(), items_.end(), predicate);
+    return it != items_.end() ? std::make_optional(*it) : std::nullopt;
+  }
+
+  /**
+   * @brief Gets a lazy stream that copies the items out morsel by morsel.
+   *
+   * @param morsel_size Number of items to pull through the stream at a time.
+   * @return Stream<T>
+   */
+  Stream<T> lazy(size_t morsel_size = kDefaultMorselSize) const {
+    auto offset = std::make_shared<size_t>(0);
+    return Stream<T>(
+        [items = items_, owner = owner_,
+         offset](size_t limit) -> std::optional<typename Stream<T>::Task> {
+          size_t begin = *offset;
+          if (begin >= items.size()) {
+            return std::nullopt;
+          }
+          size_t end = std::min(items.size(), begin + limit);
+          *offset = end;
+          return typename Stream<T>::Task([items, owner, begin, end]() {
+            return std::vector<T>(items.begin() + begin, items.begin() + end);
+          });
+        },
+        morsel_size);
+  }
+
+  /**
+   * @brief Gets a copy of the maximum item from the sequence.
+   *
+   * @return T
+   */
+  T max() const {
+    static_assert(
+        traits::is_less_than_comparable<T>::value,
+        "T must be less-than compareable.");
+    asserts::invariant::eval(!items_.empty()) << "Sequence cannot be empty.";
+    return *std::max_element(items_.begin(), items_.end());
+  }
+
+  /**
+   * @brief Gets a copy of the minimum item from the sequence.
+   *
+   * @return T
+   */
+  T min() const {
+    static_assert(
+        traits::is_less_than_comparable<T>::value,
+        "T must be less-than compareable.");
+    asserts::invariant::eval(!items_.empty()) << "Sequence cannot be empty.";
+    return *std::min_element(items_.begin(), items_.end());
+  }
+
+  /**
+   * @brief Projects each item of a sequence into a new form.
+   *
+   * @tparam Selector Transform function type. std::function<U(const T &)>
+   * @param selector Transform function to apply to each item.
+   * @return Queryable<decltype(selector(T))>
+   */
+  template <typename Selector>
+  auto select(Selector selector) const {
+    using U = decltype(selector(*items_.begin()));
+    std::vector<U> selected;
+    selected.reserve(items_.size());
+    std::transform(
+        items_.begin(), items_.end(), std::back_inserter(selected), selector);
+    return Queryable<U>(std::move(selected));
+  }
+
+  /**
+   * @brief Gets the size of the sequence.
+   *
+   * @return size_t
+   */
+  size_t size() const { return items_.size(); }
+
+  /**
+   * @brief Bypasses a specified number of items in the sequence without
+   * copying the remaining items.
+   *
+   * @param value The number of items from the beginning to skip.
+   * @return SpanQueryable<T>
+   */
+  SpanQueryable<T> skip(size_t value) const {
+    asserts::invariant::eval(value <= size())
+        << "Skip value " << value
+        << " must be less than or equal to sequence size of " << size() << ".";
+    return SpanQueryable<T>(items_.subspan(value), owner_);
+  }
+
+  /**
+   * @brief Gets the items in place.
+   *
+   * @return std::span<const T>
+   */
+  std::span<const T> span() const { return items_; }
+
+  /**
+   * @brief Takes a specified number of contiguous items from the start of a
+   * sequence without copying them.
+   *
+   * @param value The number of items from the beginning to keep.
+   * @return SpanQueryable<T>
+   */
+  SpanQueryable<T> take(size_t value) const {
+    asserts::invariant::eval(value <= size())
+        << "Take value " << value
+        << " must be less than or equal to sequence size of " << size() << ".";
+    return SpanQueryable<T>(items_.first(value), owner_);
+  }
+
+  /**
+   * @brief Gets a copy of the sequence to query over it with ownership.
+   *
+   * @return Queryable<T>
+   */
+  Queryable<T> to_queryable() const { return Queryable<T>(to_vector()); }
+
+  /**
+   * @brief Gets a copy of the sequence as a vector.
+   *
+   * @return std::vector<T>
+   */
+  std::vector<T> to_vector() const {
+    return std::vector<T>(items_.begin(), items_.end());
+  }
+
+  /**
+   * @brief Selects a copy of the items in the sequence that satisfy the
+   * predicate / conditional.
+   *
+   * @param predicate Function to test each item for a condition.
+   * @return Queryable<T>
+   */
+  template <typename Predicate>
+  Queryable<T> where(Predicate predicate) const {
+    std::vector<T> filtered;
+    std::copy_if(
+        items_.begin(), items_.end(), std::back_inserter(filtered), predicate);
+    return Queryable<T>(std::move(filtered));
+  }
+
+private:
+  std::span<const T> items_;
+  std::shared_ptr<const void> owner_;
+};
+
+/**
+ * @brief Merge result of both if and else block queries from
+ * Queryable<T>::branch method.
+ *
+ * @tparam FalseT Type of items projected from false / else block query.
+ * @tparam TrueT Type of items projected from true / if block query.
+ */
 template <typename TrueT, typename FalseT>
 class Merge {
 public:
@@ -1157,10 +2314,33 @@ public:
    * branched items of the predicate.
    */
   explicit Merge(Queryable<TrueT> true_queried, Queryable<FalseT> false_queried)
+      : true_queried_(scheduler::make_ready_future(std::move(true_queried))),
+        false_queried_(scheduler::make_ready_future(std::move(false_queried))) {
+  }
+  /**
+   * @brief Construct a new Merge object from the pending transforms of the
+   * true and false branches of the predicate.
+   *
+   * @param true_queried Result of the transformed sequence of true branched
+   * items of the predicate.
+   * @param false_queried Result of the transformed sequence of false branched
+   * items of the predicate.
+   */
+  explicit Merge(
+      std::future<Queryable<TrueT>> true_queried,
+      std::future<Queryable<FalseT>> false_queried)
       : true_queried_(std::move(true_queried)),
         false_queried_(std::move(false_queried)) {}
   Merge() = delete;
-  virtual ~Merge() = default;
+  /**
+   * @brief Waits for block queries still running when the merge is dropped
+   * unmerged, e.g. by an exception, since they may use state the caller
+   * captured by reference.
+   */
+  virtual ~Merge() {
+    scheduler::settle(true_queried_);
+    scheduler::settle(false_queried_);
+  }
   Merge(const Merge &) = delete;
   Merge &operator=(const Merge &) = delete;
 
@@ -1168,17 +2348,22 @@ public:
    * @brief Merges the true and false branch sequences as a zip.
    *
    * @param truncate Truncate the combined sequence by the minimum size of the
-   * two. If false both T and U must have a default constructor so default
-   * values can be provided if one sequence is larger than the other.
-   * @return Queryable<std::tuple<TrueT, FalseT>>
+   * two. If false the shorter side is padded when materialized, see
+   * @ref Zipped.
+   * @return Zipped<TrueT, FalseT>
    */
-  Queryable<std::tuple<TrueT, FalseT>> merge(bool truncate = false) {
-    return true_queried_.zip(std::move(false_queried_.to_vector()), truncate);
+  Zipped<TrueT, FalseT> merge(bool truncate = false) {
+    // Join point of concurrent branches. Waiting threads help the pool so
+    // nested branches cannot starve it.
+    Queryable<TrueT> true_queried = scheduler::await(std::move(true_queried_));
+    Queryable<FalseT> false_queried =
+        scheduler::await(std::move(false_queried_));
+    return true_queried.zip(false_queried.to_vector(), truncate);
   }
 
 private:
-  Queryable<TrueT> true_queried_;
-  Queryable<FalseT> false_queried_;
+  std::future<Queryable<TrueT>> true_queried_;
+  std::future<Queryable<FalseT>> false_queried_;
 };
 
 /**
@@ -1203,10 +2388,33 @@ public:
   explicit WhenFalse(
       Queryable<WhenTrueQueriedT> when_true_queried,
       std::vector<T> when_false_items)
+      : when_true_queried_(
+            scheduler::make_ready_future(std::move(when_true_queried))),
+        when_false_items_(std::move(when_false_items)), concurrent_(false) {}
+  /**
+   * @brief Construct a new WhereFalse object from the pending transform of the
+   * true branch of the predicate and the not yet transformed false branch
+   * sequence.
+   *
+   * @param when_true_queried Result of the transformed sequence of true
+   * branched items of the predicate.
+   * @param when_false_items Sequence of false branched items of the predicate
+   * to query over.
+   * @param concurrent True to run the false block query on the library thread
+   * pool.
+   */
+  explicit WhenFalse(
+      std::future<Queryable<WhenTrueQueriedT>> when_true_queried,
+      std::vector<T> when_false_items, bool concurrent)
       : when_true_queried_(std::move(when_true_queried)),
-        when_false_items_(std::move(when_false_items)) {}
+        when_false_items_(std::move(when_false_items)),
+        concurrent_(concurrent) {}
   WhenFalse() = delete;
-  virtual ~WhenFalse() = default;
+  /**
+   * @brief Waits for the true block query if still running, since it may use
+   * state the caller captured by reference.
+   */
+  virtual ~WhenFalse() { scheduler::settle(when_true_queried_); }
   WhenFalse(const WhenFalse &) = delete;
   WhenFalse &operator=(const WhenFalse &) = delete;
 
@@ -1229,14 +2437,25 @@ public:
           std::invoke_result_t<WhenFalseQuery, Queryable<T>>::item_type>
   Merge<WhenTrueQueriedT, WhenFalseQueriedT>
   when_false(WhenFalseQuery when_false_query) {
+    std::future<Queryable<WhenFalseQueriedT>> when_false_queried;
+    if (concurrent_) {
+      when_false_queried = scheduler::ThreadPool::instance().submit(
+          [query = std::move(when_false_query),
+           items = std::move(when_false_items_)]() mutable {
+            return query(Queryable<T>(std::move(items)));
+          });
+    } else {
+      when_false_queried = scheduler::make_ready_future(
+          when_false_query(Queryable<T>(std::move(when_false_items_))));
+    }
     return Merge<WhenTrueQueriedT, WhenFalseQueriedT>(
-        Queryable<WhenTrueQueriedT>(when_true_queried_.to_vector()),
-        when_false_query(Queryable<T>(std::move(when_false_items_))));
+        std::move(when_true_queried_), std::move(when_false_queried));
   }
 
 private:
-  Queryable<WhenTrueQueriedT> when_true_queried_;
+  std::future<Queryable<WhenTrueQueriedT>> when_true_queried_;
   std::vector<T> when_false_items_;
+  bool concurrent_;
 };
 
 /**
@@ -1255,11 +2474,15 @@ public:
    * predicate.
    * @param when_false_items Sequence of items from the false branch of the
    * predicate. over.
+   * @param concurrent True to run the block queries on the library thread
+   * pool.
    */
   explicit WhenTrue(
-      std::vector<T> when_true_items, std::vector<T> when_false_items)
+      std::vector<T> when_true_items, std::vector<T> when_false_items,
+      bool concurrent = false)
       : when_true_items_(std::move(when_true_items)),
-        when_false_items_(std::move(when_false_items)) {}
+        when_false_items_(std::move(when_false_items)),
+        concurrent_(concurrent) {}
   WhenTrue() = delete;
   virtual ~WhenTrue() = default;
   WhenTrue(const WhenTrue &) = delete;
@@ -1283,19 +2506,32 @@ public:
       typename WhenTrueQueriedT =
           std::invoke_result_t<WhenTrueQuery, Queryable<T>>::item_type>
   WhenFalse<WhenTrueQueriedT, T> when_true(WhenTrueQuery when_true_query) {
+    std::future<Queryable<WhenTrueQueriedT>> when_true_queried;
+    if (concurrent_) {
+      // Starts right away so it overlaps with building the false block query.
+      when_true_queried = scheduler::ThreadPool::instance().submit(
+          [query = std::move(when_true_query),
+           items = std::move(when_true_items_)]() mutable {
+            return query(Queryable<T>(std::move(items)));
+          });
+    } else {
+      when_true_queried = scheduler::make_ready_future(
+          when_true_query(Queryable<T>(std::move(when_true_items_))));
+    }
     return WhenFalse<WhenTrueQueriedT, T>(
-        std::move(when_true_query(Queryable<T>(std::move(when_true_items_)))),
-        std::move(when_false_items_));
+        std::move(when_true_queried), std::move(when_false_items_),
+        concurrent_);
   }
 
 private:
   std::vector<T> when_true_items_;
   std::vector<T> when_false_items_;
+  bool concurrent_;
 };
 
 template <typename T>
 template <typename Predicate>
-WhenTrue<T> Queryable<T>::branch(Predicate predicate) {
+WhenTrue<T> Queryable<T>::branch(Predicate predicate, bool concurrent) {
   std::vector<T> when_true_items;
   std::vector<T> when_false_items;
   std::for_each(
@@ -1308,7 +2544,8 @@ WhenTrue<T> Queryable<T>::branch(Predicate predicate) {
         }
       });
 
-  return WhenTrue<T>(std::move(when_true_items), std::move(when_false_items));
+  return WhenTrue<T>(
+      std::move(when_true_items), std::move(when_false_items), concurrent);
 }
 
 } // namespace fcpp
@@ -0,0 +1,236 @@
+#include "scheduler.h"
+
+#include "asserts.h"
+#include "trace.h"
+
+#include <algorithm>
+
+namespace fcpp::scheduler {
+
+namespace {
+
+// Shared by every task of a TaskGraph::run call so that the last task to
+// finish can still touch it after the caller has been released.
+struct GraphRun {
+  std::vector<std::function<void()>> *tasks;
+  std::vector<std::vector<TaskGraph::TaskId>> *successors;
+  ThreadPool *pool;
+  std::vector<std::atomic<size_t>> pending;
+  std::vector<std::atomic<bool>> skipped;
+  std::atomic<size_t> remaining;
+  std::mutex error_mutex;
+  std::exception_ptr error;
+  std::promise<void> done;
+
+  GraphRun(size_t size) : pending(size), skipped(size), remaining(size) {}
+};
+
+void launch(std::shared_ptr<GraphRun> run, TaskGraph::TaskId id) {
+  run->pool->submit([run, id]() {
+    bool failed = run->skipped[id];
+    if (!failed) {
+      try {
+        (*run->tasks)[id]();
+      } catch (...) {
+        failed = true;
+        std::lock_guard<std::mutex> lock(run->error_mutex);
+        if (!run->error) {
+          run->error = std::current_exception();
+        }
+      }
+    }
+    for (TaskGraph::TaskId successor : (*run->successors)[id]) {
+      if (failed) {
+        run->skipped[successor] = true;
+      }
+      if (--run->pending[successor] == 0) {
+        launch(run, successor);
+      }
+    }
+    if (--run->remaining == 0) {
+      run->done.set_value();
+    }
+  });
+}
+
+} // namespace
+
+ThreadPool::ThreadPool(size_t thread_count) {
+  if (thread_count == 0) {
+    thread_count = std::max(1u, std::thread::hardware_concurrency());
+  }
+  workers_.reserve(thread_count);
+  for (size_t i = 0; i < thread_count; i++) {
+    workers_.emplace_back([this]() { work(); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  ready_.notify_all();
+  for (std::thread &worker : workers_) {
+    worker.join();
+  }
+}
+
+ThreadPool &ThreadPool::instance() {
+  static ThreadPool pool;
+  return pool;
+}
+
+size_t ThreadPool::size() const { return workers_.size(); }
+
+bool ThreadPool::try_run_one() {
+  std::function<void()> task;
+  size_t queued;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (tasks_.empty()) {
+      return false;
+    }
+    task = std::move(tasks_.front());
+    tasks_.pop_front();
+    queued = tasks_.size();
+  }
+  run(task, queued);
+  return true;
+}
+
+void ThreadPool::enqueue(std::function<void()> task) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    asserts::invariant::eval(!stopping_)
+        << "Cannot submit tasks to a stopping thread pool.";
+    tasks_.push_back(std::move(task));
+  }
+  ready_.notify_one();
+  progress_.notify_all();
+}
+
+void ThreadPool::work() {
+  while (true) {
+    std::function<void()> task;
+    size_t queued;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      ready_.wait(lock, [this]() { return stopping_ || !tasks_.empty(); });
+      if (tasks_.empty()) {
+        return;
+      }
+      task = std::move(tasks_.front());
+      tasks_.pop_front();
+      queued = tasks_.size();
+    }
+    run(task, queued);
+  }
+}
+
+void ThreadPool::run(const std::function<void()> &task, size_t queued) {
+  {
+    trace::Span span("task", "pool");
+    span.arg("queued", queued);
+    task();
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    finished_++;
+  }
+  progress_.notify_all();
+}
+
+TaskGraph::TaskId
+TaskGraph::add(std::function<void()> task, std::vector<TaskId> dependencies) {
+  TaskId id = nodes_.size();
+  Node node;
+  node.task = std::move(task);
+  node.dependency_count = dependencies.size();
+  for (TaskId dependency : dependencies) {
+    asserts::invariant::eval(dependency < id)
+        << "Dependency " << dependency << " of task " << id
+        << " must be added to the graph before it.";
+  }
+  nodes_.push_back(std::move(node));
+  for (TaskId dependency : dependencies) {
+    nodes_[dependency].successors.push_back(id);
+  }
+  return id;
+}
+
+size_t TaskGraph::size() const { return nodes_.size(); }
+
+void TaskGraph::run(ThreadPool &pool) {
+  if (nodes_.empty()) {
+    return;
+  }
+
+  std::vector<std::function<void()>> tasks;
+  std::vector<std::vector<TaskId>> successors;
+  tasks.reserve(nodes_.size());
+  successors.reserve(nodes_.size());
+  auto run = std::make_shared<GraphRun>(nodes_.size());
+  for (TaskId id = 0; id < nodes_.size(); id++) {
+    tasks.push_back(nodes_[id].task);
+    successors.push_back(nodes_[id].successors);
+    run->pending[id] = nodes_[id].dependency_count;
+  }
+  run->tasks = &tasks;
+  run->successors = &successors;
+  run->pool = &pool;
+
+  std::future<void> done = run->done.get_future();
+  for (TaskId id = 0; id < nodes_.size(); id++) {
+    if (nodes_[id].dependency_count == 0) {
+      launch(run, id);
+    }
+  }
+  pool.await(std::move(done));
+
+  if (run->error) {
+    std::rethrow_exception(run->error);
+  }
+}
+
+void parallel_for(
+    size_t begin, size_t end, size_t block_size,
+    const std::function<void(size_t, size_t)> &block_func, ThreadPool &pool) {
+  if (end <= begin) {
+    return;
+  }
+  block_size = std::max<size_t>(
+      {block_size, 1, (end - begin + pool.size() * 4 - 1) / (pool.size() * 4)});
+  if (end - begin <= block_size) {
+    block_func(begin, end);
+    return;
+  }
+
+  std::vector<std::future<void>> blocks;
+  for (size_t block = begin + block_size; block < end; block += block_size) {
+    size_t block_end = std::min(end, block + block_size);
+    blocks.push_back(pool.submit(
+        [&block_func, block, block_end]() { block_func(block, block_end); }));
+  }
+
+  std::exception_ptr error;
+  try {
+    block_func(begin, begin + block_size);
+  } catch (...) {
+    error = std::current_exception();
+  }
+  for (std::future<void> &block : blocks) {
+    try {
+      pool.await(std::move(block));
+    } catch (...) {
+      if (!error) {
+        error = std::current_exception();
+      }
+    }
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+} // namespace fcpp::scheduler
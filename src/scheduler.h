@@ -0,0 +1,452 @@
+/**
+ * @file scheduler.h
+ * @author Andrew Walsh (awalsh128@gmail.com)
+ * @brief Thread pool and task graph used to run independent parts of a query
+ * concurrently.
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef FCPP_SCHEDULER_H
+#define FCPP_SCHEDULER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "asserts.h"
+
+namespace fcpp::scheduler {
+
+/**
+ * @brief Fixed size pool of worker threads that runs submitted tasks in FIFO
+ * order.
+ *
+ * Threads that wait on a result of the pool through @ref await will run queued
+ * tasks while waiting. This allows tasks to submit and wait on other tasks
+ * without starving the pool.
+ */
+class ThreadPool final {
+public:
+  /**
+   * @brief Construct a new ThreadPool object and start its workers.
+   *
+   * @param thread_count Number of worker threads. Zero is replaced by the
+   * hardware concurrency of the machine.
+   */
+  explicit ThreadPool(size_t thread_count = 0);
+  /**
+   * @brief Stops accepting tasks, runs the ones already queued and joins all
+   * worker threads.
+   */
+  ~ThreadPool();
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  /**
+   * @brief Library wide pool used when no pool is given explicitly.
+   *
+   * @return ThreadPool&
+   */
+  static ThreadPool &instance();
+
+  /**
+   * @brief Gets the number of worker threads.
+   *
+   * @return size_t
+   */
+  size_t size() const;
+
+  /**
+   * @brief Queues a task to be run on one of the workers.
+   *
+   * @tparam Fn Task function type. std::function<R()>
+   * @param task Task to run. May be move only.
+   * @return std::future<R> Result, or exception, of the task.
+   */
+  template <typename Fn>
+  std::future<std::invoke_result_t<Fn>> submit(Fn task);
+
+  /**
+   * @brief Waits for a result of the pool, running queued tasks on the calling
+   * thread until it is available.
+   *
+   * @tparam R Result type of the task.
+   * @param future Result to wait on.
+   * @return R
+   */
+  template <typename R>
+  R await(std::future<R> future);
+
+  /**
+   * @brief Runs a single queued task on the calling thread, if any.
+   *
+   * @return true if a task was run.
+   * @return false if the queue was empty.
+   */
+  bool try_run_one();
+
+private:
+  void enqueue(std::function<void()> task);
+  void work();
+  /**
+   * @brief Runs a task taken off the queue, traced as a span, and wakes the
+   * threads awaiting a result.
+   *
+   * @param task Task to run.
+   * @param queued Number of tasks left in the queue when it was taken.
+   */
+  void run(const std::function<void()> &task, size_t queued);
+
+  std::vector<std::thread> workers_;
+  std::deque<std::function<void()>> tasks_;
+  mutable std::mutex mutex_;
+  std::condition_variable ready_;
+  // Signaled when a task is queued or finishes, for threads in await.
+  std::condition_variable progress_;
+  size_t finished_ = 0;
+  bool stopping_ = false;
+};
+
+/**
+ * @brief Small directed acyclic graph of tasks that runs every task once all
+ * of its dependencies have finished.
+ *
+ * Tasks without a path between them run concurrently on the pool.
+ *
+ * @code
+ * scheduler::TaskGraph graph;
+ * auto lhs = graph.add([&] { lhs_items = build_lhs(); });
+ * auto rhs = graph.add([&] { rhs_items = build_rhs(); });
+ * graph.add([&] { joined = join(lhs_items, rhs_items); }, {lhs, rhs});
+ * graph.run();
+ * @endcode
+ */
+class TaskGraph final {
+public:
+  /**
+   * @brief Identifier of a task inside the graph, used to declare
+   * dependencies.
+   */
+  typedef size_t TaskId;
+
+  TaskGraph() = default;
+  TaskGraph(const TaskGraph &) = delete;
+  TaskGraph &operator=(const TaskGraph &) = delete;
+
+  /**
+   * @brief Adds a task to the graph.
+   *
+   * @param task Void function to run.
+   * @param dependencies Tasks that must finish before this one starts. They
+   * must have been added before.
+   * @return TaskId Identifier to depend on from tasks added afterwards.
+   */
+  TaskId
+  add(std::function<void()> task, std::vector<TaskId> dependencies = {});
+
+  /**
+   * @brief Gets the number of tasks in the graph.
+   *
+   * @return size_t
+   */
+  size_t size() const;
+
+  /**
+   * @brief Runs all tasks and waits for them to finish.
+   *
+   * If a task throws, the tasks depending on it are skipped and the first
+   * exception is rethrown once everything else has settled.
+   *
+   * @param pool Pool to run the tasks on.
+   */
+  void run(ThreadPool &pool = ThreadPool::instance());
+
+private:
+  struct Node {
+    std::function<void()> task;
+    std::vector<TaskId> successors;
+    size_t dependency_count = 0;
+  };
+
+  std::vector<Node> nodes_;
+};
+
+/**
+ * @brief Bounded lock-free ring buffer between exactly one producer thread and
+ * one consumer thread.
+ *
+ * Pushing to a full queue blocks the producer until the consumer pops
+ * (backpressure) and popping an empty queue blocks the consumer. Blocked
+ * threads sleep on the ring indices through std::atomic::wait rather than
+ * spinning.
+ *
+ * @tparam T Type of items to hand off. May be move only.
+ */
+template <typename T>
+class SpscQueue final {
+public:
+  /**
+   * @brief Construct a new SpscQueue object.
+   *
+   * @param capacity Maximum number of items held at a time.
+   */
+  explicit SpscQueue(size_t capacity);
+  SpscQueue(const SpscQueue &) = delete;
+  SpscQueue &operator=(const SpscQueue &) = delete;
+
+  /**
+   * @brief Gets the maximum number of items held at a time.
+   *
+   * @return size_t
+   */
+  size_t capacity() const;
+
+  /**
+   * @brief Stops the producer from the consumer side. Pushes blocked or made
+   * afterwards return false.
+   */
+  void cancel();
+
+  /**
+   * @brief Marks the end of the items from the producer side. Pops return
+   * std::nullopt once the items already pushed are drained.
+   */
+  void close();
+
+  /**
+   * @brief Takes the oldest item, waiting while the queue is empty. Only
+   * called by the consumer.
+   *
+   * @return std::optional<T> The item or std::nullopt once closed and
+   * drained.
+   */
+  std::optional<T> pop();
+
+  /**
+   * @brief Adds an item, waiting while the queue is full. Only called by the
+   * producer.
+   *
+   * @param item Item to add.
+   * @return true if the item was added.
+   * @return false if the consumer cancelled.
+   */
+  bool push(T item);
+
+private:
+  // Indices count items times two, with the lowest bit marking the side as
+  // done. Changing the watched value is what wakes up a waiting thread, so the
+  // done flag must live in the index the other side waits on.
+  static constexpr size_t kDone = 1;
+
+  std::vector<std::optional<T>> slots_;
+  // Kept on separate cache lines so each side only writes its own line.
+  alignas(64) std::atomic<size_t> head_;
+  alignas(64) std::atomic<size_t> tail_;
+};
+
+/**
+ * @brief Runs a function over consecutive blocks of an index range, in
+ * parallel on the pool.
+ *
+ * The calling thread runs one of the blocks itself. Ranges that are not
+ * larger than a single block run entirely on the calling thread. The first
+ * exception thrown by a block is rethrown after all blocks have finished.
+ *
+ * @param begin First index of the range.
+ * @param end Index past the last index of the range.
+ * @param block_size Minimum number of indices per block.
+ * @param block_func Function given the [begin, end) indices of each block.
+ * @param pool Pool to run the blocks on.
+ */
+void parallel_for(
+    size_t begin, size_t end, size_t block_size,
+    const std::function<void(size_t, size_t)> &block_func,
+    ThreadPool &pool = ThreadPool::instance());
+
+/**
+ * @brief Waits for a result of the library wide pool, helping it run queued
+ * tasks. The pool is not started if the result is already available.
+ *
+ * @tparam R Result type of the task.
+ * @param future Result to wait on.
+ * @return R
+ */
+template <typename R>
+R await(std::future<R> future) {
+  if (future.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+    return future.get();
+  }
+  return ThreadPool::instance().await(std::move(future));
+}
+
+/**
+ * @brief Waits for a result of the library wide pool that is no longer needed,
+ * so that its task does not outlive the state it captured. Any exception of
+ * the task is discarded.
+ *
+ * @tparam R Result type of the task.
+ * @param future Result to wait on, if it is still valid.
+ */
+template <typename R>
+void settle(std::future<R> &future) noexcept {
+  if (!future.valid()) {
+    return;
+  }
+  try {
+    await(std::move(future));
+  } catch (...) {
+    // The result was dropped along with its errors.
+  }
+}
+
+/**
+ * @brief Creates a future that already holds a value.
+ *
+ * @tparam T Type of the value.
+ * @param value Value to hold.
+ * @return std::future<T>
+ */
+template <typename T>
+std::future<T> make_ready_future(T value) {
+  std::promise<T> promise;
+  promise.set_value(std::move(value));
+  return promise.get_future();
+}
+
+} // namespace fcpp::scheduler
+
+/******************************************************************************
+ *
+ * @brief Keep definitions separate to allow the declarations to stay clean and
+ * compact.
+ *
+ *****************************************************************************/
+
+namespace fcpp::scheduler {
+
+template <typename Fn>
+std::future<std::invoke_result_t<Fn>> ThreadPool::submit(Fn task) {
+  using R = std::invoke_result_t<Fn>;
+  // Shared since std::function must be copyable and packaged_task is not.
+  auto packaged = std::make_shared<std::packaged_task<R()>>(std::move(task));
+  std::future<R> result = packaged->get_future();
+  enqueue([packaged]() { (*packaged)(); });
+  return result;
+}
+
+template <typename R>
+R ThreadPool::await(std::future<R> future) {
+  auto ready = [&future]() {
+    return future.wait_for(std::chrono::seconds(0)) ==
+           std::future_status::ready;
+  };
+  while (!ready()) {
+    if (try_run_one()) {
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    // Checked under the lock so that a task finishing in between still
+    // wakes the thread. The timeout covers results set outside the pool.
+    size_t finished = finished_;
+    progress_.wait_for(lock, std::chrono::milliseconds(10), [&]() {
+      return !tasks_.empty() || finished_ != finished || ready();
+    });
+  }
+  return future.get();
+}
+
+template <typename T>
+SpscQueue<T>::SpscQueue(size_t capacity)
+    : slots_(capacity), head_(0), tail_(0) {
+  asserts::invariant::eval(capacity > 0)
+      << "Queue capacity must be greater than zero.";
+}
+
+template <typename T>
+size_t SpscQueue<T>::capacity() const {
+  return slots_.size();
+}
+
+template <typename T>
+void SpscQueue<T>::cancel() {
+  head_.fetch_or(kDone, std::memory_order_release);
+  head_.notify_one();
+}
+
+template <typename T>
+void SpscQueue<T>::close() {
+  tail_.fetch_or(kDone, std::memory_order_release);
+  tail_.notify_one();
+}
+
+template <typename T>
+std::optional<T> SpscQueue<T>::pop() {
+  size_t head = head_.load(std::memory_order_relaxed);
+  for (;;) {
+    size_t tail = tail_.load(std::memory_order_acquire);
+    if (tail / 2 != head / 2) {
+      break;
+    }
+    if (tail & kDone) {
+      return std::nullopt;
+    }
+    tail_.wait(tail, std::memory_order_acquire);
+  }
+  std::optional<T> &slot = slots_[head / 2 % slots_.size()];
+  std::optional<T> item = std::move(slot);
+  slot.reset();
+  head_.store(head + 2, std::memory_order_release);
+  head_.notify_one();
+  return item;
+}
+
+template <typename T>
+bool SpscQueue<T>::push(T item) {
+  size_t tail = tail_.load(std::memory_order_relaxed);
+  for (;;) {
+    size_t head = head_.load(std::memory_order_acquire);
+    if (head & kDone) {
+      return false;
+    }
+    if (tail / 2 - head / 2 < slots_.size()) {
+      break;
+    }
+    head_.wait(head, std::memory_order_acquire);
+  }
+  slots_[tail / 2 % slots_.size()].emplace(std::move(item));
+  tail_.store(tail + 2, std::memory_order_release);
+  tail_.notify_one();
+  return true;
+}
+
+} // namespace fcpp::scheduler
+
+#endif // FCPP_SCHEDULER_H
@@ -0,0 +1,39 @@
+#include "spill.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <system_error>
+#include <unistd.h>
+
+namespace fcpp::spill {
+
+size_t partition_of(size_t hash, size_t level, size_t count) {
+  // splitmix64 finalizer, seeded by the level.
+  uint64_t mixed = hash + (level + 1) * 0x9e3779b97f4a7c15ULL;
+  mixed = (mixed ^ (mixed >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  mixed = (mixed ^ (mixed >> 27)) * 0x94d049bb133111ebULL;
+  mixed ^= mixed >> 31;
+  return mixed % count;
+}
+
+File::File(const std::filesystem::path &directory) {
+  std::string path = (directory / "fcpp-spill-XXXXXX").string();
+  int fd = ::mkstemp(path.data());
+  asserts::invariant::eval(fd != -1)
+      << "Unable to create spill file in " << directory << ": "
+      << std::strerror(errno) << ".";
+  ::close(fd);
+  path_ = path;
+}
+
+File::~File() {
+  // Best effort, a leftover temporary file is not worth failing over.
+  std::error_code error;
+  std::filesystem::remove(path_, error);
+}
+
+const std::filesystem::path &File::path() const { return path_; }
+
+} // namespace fcpp::spill
@@ -0,0 +1,729 @@
+/**
+ * @file spill.h
+ * @author Andrew Walsh (awalsh128@gmail.com)
+ * @brief Spilling of items to temporary files for operations that do not fit
+ * in memory.
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef FCPP_SPILL_H
+#define FCPP_SPILL_H
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <istream>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "asserts.h"
+
+namespace fcpp::spill {
+
+/**
+ * @brief Amount of memory an operation may hold before spilling to disk.
+ */
+struct MemoryBudget {
+  /**
+   * @brief Maximum number of bytes of items held in memory, as estimated by
+   * @ref Serializer<T>::footprint.
+   */
+  size_t bytes;
+  /**
+   * @brief Directory to create the temporary spill files in.
+   */
+  std::filesystem::path temp_dir = std::filesystem::temp_directory_path();
+};
+
+/**
+ * @brief Writes, reads and sizes items that are spilled to disk.
+ *
+ * Trivially copyable types are handled by copying their bytes. Other types
+ * must specialize this template with the same static functions.
+ *
+ * @code
+ * template <>
+ * struct fcpp::spill::Serializer<Trade> {
+ *   static void write(std::ostream &output, const Trade &item);
+ *   static std::optional<Trade> read(std::istream &input);
+ *   static size_t footprint(const Trade &item);
+ * };
+ * @endcode
+ *
+ * @tparam T Type of items to spill.
+ */
+template <typename T>
+struct Serializer {
+  static_assert(
+      std::is_trivially_copyable_v<T>,
+      "T is not trivially copyable, specialize fcpp::spill::Serializer<T> to "
+      "spill it.");
+
+  /**
+   * @brief Writes an item to the end of the output.
+   *
+   * @param output Binary output to write to.
+   * @param item Item to write.
+   */
+  static void write(std::ostream &output, const T &item);
+
+  /**
+   * @brief Reads the next item from the input.
+   *
+   * @param input Binary input to read from.
+   * @return std::optional<T> The item or std::nullopt at the end of the input.
+   */
+  static std::optional<T> read(std::istream &input);
+
+  /**
+   * @brief Estimates the number of bytes of memory held by an item.
+   *
+   * @param item Item to estimate.
+   * @return size_t
+   */
+  static size_t footprint(const T &item);
+};
+
+template <>
+struct Serializer<std::string> {
+  static void write(std::ostream &output, const std::string &item);
+  static std::optional<std::string> read(std::istream &input);
+  static size_t footprint(const std::string &item);
+};
+
+template <typename U>
+struct Serializer<std::vector<U>> {
+  static void write(std::ostream &output, const std::vector<U> &item);
+  static std::optional<std::vector<U>> read(std::istream &input);
+  static size_t footprint(const std::vector<U> &item);
+};
+
+template <typename U, typename V>
+struct Serializer<std::pair<U, V>> {
+  static void write(std::ostream &output, const std::pair<U, V> &item);
+  static std::optional<std::pair<U, V>> read(std::istream &input);
+  static size_t footprint(const std::pair<U, V> &item);
+};
+
+/**
+ * @brief Number of partitions items are hashed into when spilled by key.
+ */
+constexpr size_t kPartitionCount = 32;
+
+/**
+ * @brief Gets the partition of a key hash.
+ *
+ * The hash is remixed per level so that repartitioning a partition spreads
+ * its keys again, and so that identity hashes of integers spread at all.
+ *
+ * @param hash Hash of the key.
+ * @param level Number of times the items were partitioned before.
+ * @param count Number of partitions.
+ * @return size_t Partition in [0, count).
+ */
+size_t partition_of(size_t hash, size_t level, size_t count);
+
+/**
+ * @brief Temporary file that is removed once no longer used.
+ */
+class File final {
+public:
+  /**
+   * @brief Construct a new File object by creating an empty file with a
+   * unique name.
+   *
+   * @param directory Directory to create the file in.
+   */
+  explicit File(const std::filesystem::path &directory);
+  /**
+   * @brief Removes the file.
+   */
+  ~File();
+  File() = delete;
+  File(const File &) = delete;
+  File &operator=(const File &) = delete;
+
+  /**
+   * @brief Gets the path of the file.
+   *
+   * @return const std::filesystem::path&
+   */
+  const std::filesystem::path &path() const;
+
+private:
+  std::filesystem::path path_;
+};
+
+/**
+ * @brief Appends items to a spill file.
+ *
+ * @tparam T Type of items to write.
+ */
+template <typename T>
+class Writer final {
+public:
+  /**
+   * @brief Construct a new Writer object that truncates the file.
+   *
+   * @param file File to write to.
+   */
+  explicit Writer(const File &file);
+
+  /**
+   * @brief Writes an item to the end of the file.
+   *
+   * @param item Item to write.
+   */
+  void write(const T &item);
+
+  /**
+   * @brief Flushes and closes the file so that it can be read.
+   */
+  void close();
+
+private:
+  std::filesystem::path path_;
+  std::ofstream output_;
+};
+
+/**
+ * @brief Reads back the items of a spill file in the order they were written.
+ *
+ * @tparam T Type of items to read.
+ */
+template <typename T>
+class Reader final {
+public:
+  /**
+   * @brief Construct a new Reader object at the start of the file.
+   *
+   * @param file File to read from.
+   */
+  explicit Reader(const File &file);
+
+  /**
+   * @brief Reads the next item.
+   *
+   * @return std::optional<T> The item or std::nullopt once all are read.
+   */
+  std::optional<T> next();
+
+private:
+  std::ifstream input_;
+};
+
+/**
+ * @brief Set of spill files that items are distributed over, usually by the
+ * hash of a key.
+ *
+ * @tparam T Type of items to spill.
+ */
+template <typename T>
+class Partitions final {
+public:
+  /**
+   * @brief Construct a new Partitions object with empty files.
+   *
+   * @param count Number of partitions.
+   * @param directory Directory to create the files in.
+   */
+  Partitions(size_t count, const std::filesystem::path &directory);
+  Partitions(const Partitions &) = delete;
+  Partitions &operator=(const Partitions &) = delete;
+
+  /**
+   * @brief Writes an item to the end of a partition.
+   *
+   * @param partition Partition to write to.
+   * @param item Item to write.
+   */
+  void write(size_t partition, const T &item);
+
+  /**
+   * @brief Closes all partitions so that they can be read.
+   */
+  void close();
+
+  /**
+   * @brief Gets the number of partitions.
+   *
+   * @return size_t
+   */
+  size_t size() const;
+
+  /**
+   * @brief Gets the file of a partition.
+   *
+   * @param partition Partition to get.
+   * @return const File&
+   */
+  const File &file(size_t partition) const;
+
+  /**
+   * @brief Gets the estimated memory the items of a partition hold once read
+   * back.
+   *
+   * @param partition Partition to get.
+   * @return size_t
+   */
+  size_t bytes(size_t partition) const;
+
+private:
+  std::vector<std::unique_ptr<File>> files_;
+  std::vector<std::unique_ptr<Writer<T>>> writers_;
+  std::vector<size_t> bytes_;
+};
+
+/**
+ * @brief Sorts items under a memory budget.
+ *
+ * Items are gathered into runs that fit the budget. Full runs are sorted and
+ * spilled to temporary files, which are merged back k ways at a time as the
+ * sorted items are taken. Nothing touches disk if all items fit the budget.
+ * The sort is stable, equal items come out in the order they were pushed.
+ *
+ * @tparam T Type of items to sort. Must have a @ref Serializer.
+ * @tparam Less Comparison function type. std::function<bool(const T&, const
+ * T&)>
+ */
+template <typename T, typename Less>
+class ExternalSorter final {
+public:
+  /**
+   * @brief Maximum number of runs merged at once. More runs are merged in
+   * multiple passes to bound the number of open files.
+   */
+  static constexpr size_t kMaxMergeWidth = 64;
+
+  /**
+   * @brief Construct a new ExternalSorter object.
+   *
+   * @param less Strict weak ordering of the items.
+   * @param budget Memory the items of a run may hold.
+   */
+  ExternalSorter(Less less, MemoryBudget budget);
+  ExternalSorter(const ExternalSorter &) = delete;
+  ExternalSorter &operator=(const ExternalSorter &) = delete;
+
+  /**
+   * @brief Adds an item to sort. Spills the current run if it exceeds the
+   * budget.
+   *
+   * @param item Item to add.
+   */
+  void push(T item);
+
+  /**
+   * @brief Sorts the last run and prepares the merge. Must be called once,
+   * after all items are pushed and before any are taken.
+   */
+  void finish();
+
+  /**
+   * @brief Takes the next sorted items.
+   *
+   * @param limit Maximum number of items to take.
+   * @return std::vector<T> Empty once all items are taken.
+   */
+  std::vector<T> next(size_t limit);
+
+  /**
+   * @brief Gets the number of runs spilled to disk so far.
+   *
+   * @return size_t
+   */
+  size_t spilled_runs() const;
+
+private:
+  /**
+   * @brief Merges sorted runs by keeping the head of every run in a heap.
+   */
+  class Merge final {
+  public:
+    Merge(const Less &less, const std::vector<std::unique_ptr<File>> &runs);
+    std::optional<T> pop();
+
+  private:
+    bool after(size_t lhs, size_t rhs) const;
+
+    const Less &less_;
+    std::vector<std::unique_ptr<Reader<T>>> readers_;
+    std::vector<std::optional<T>> heads_;
+    std::vector<size_t> heap_;
+  };
+
+  void spill_run();
+
+  Less less_;
+  MemoryBudget budget_;
+  std::vector<T> run_;
+  size_t run_bytes_;
+  size_t run_offset_;
+  size_t spilled_runs_;
+  std::vector<std::unique_ptr<File>> runs_;
+  std::unique_ptr<Merge> merge_;
+};
+
+} // namespace fcpp::spill
+
+/******************************************************************************
+ *
+ * @brief Keep definitions separate to allow the declarations to stay clean and
+ * compact.
+ *
+ *****************************************************************************/
+
+namespace fcpp::spill {
+
+namespace detail {
+
+inline void check_read(std::istream &input, size_t expected) {
+  asserts::invariant::eval(static_cast<size_t>(input.gcount()) == expected)
+      << "Spill file ended in the middle of an item.";
+}
+
+} // namespace detail
+
+template <typename T>
+void Serializer<T>::write(std::ostream &output, const T &item) {
+  output.write(reinterpret_cast<const char *>(&item), sizeof(T));
+}
+
+template <typename T>
+std::optional<T> Serializer<T>::read(std::istream &input) {
+  std::array<char, sizeof(T)> bytes;
+  input.read(bytes.data(), bytes.size());
+  if (input.gcount() == 0 && input.eof()) {
+    return std::nullopt;
+  }
+  detail::check_read(input, bytes.size());
+  // Reconstructed from its bytes so T needs no default constructor.
+  return std::bit_cast<T>(bytes);
+}
+
+template <typename T>
+size_t Serializer<T>::footprint([[maybe_unused]] const T &item) {
+  return sizeof(T);
+}
+
+inline void
+Serializer<std::string>::write(std::ostream &output, const std::string &item) {
+  Serializer<size_t>::write(output, item.size());
+  output.write(item.data(), item.size());
+}
+
+inline std::optional<std::string>
+Serializer<std::string>::read(std::istream &input) {
+  std::optional<size_t> size = Serializer<size_t>::read(input);
+  if (!size) {
+    return std::nullopt;
+  }
+  std::string item(*size, '\0');
+  input.read(item.data(), *size);
+  detail::check_read(input, *size);
+  return item;
+}
+
+inline size_t Serializer<std::string>::footprint(const std::string &item) {
+  return sizeof(std::string) + item.capacity();
+}
+
+template <typename U>
+void Serializer<std::vector<U>>::write(
+    std::ostream &output, const std::vector<U> &item) {
+  Serializer<size_t>::write(output, item.size());
+  for (const U &element : item) {
+    Serializer<U>::write(output, element);
+  }
+}
+
+template <typename U>
+std::optional<std::vector<U>>
+Serializer<std::vector<U>>::read(std::istream &input) {
+  std::optional<size_t> size = Serializer<size_t>::read(input);
+  if (!size) {
+    return std::nullopt;
+  }
+  std::vector<U> item;
+  item.reserve(*size);
+  for (size_t i = 0; i < *size; i++) {
+    std::optional<U> element = Serializer<U>::read(input);
+    asserts::invariant::eval(element.has_value())
+        << "Spill file ended in the middle of an item.";
+    item.push_back(std::move(*element));
+  }
+  return item;
+}
+
+template <typename U>
+size_t Serializer<std::vector<U>>::footprint(const std::vector<U> &item) {
+  size_t bytes = sizeof(std::vector<U>) +
+                 (item.capacity() - item.size()) * sizeof(U);
+  for (const U &element : item) {
+    bytes += Serializer<U>::footprint(element);
+  }
+  return bytes;
+}
+
+template <typename U, typename V>
+void Serializer<std::pair<U, V>>::write(
+    std::ostream &output, const std::pair<U, V> &item) {
+  Serializer<U>::write(output, item.first);
+  Serializer<V>::write(output, item.second);
+}
+
+template <typename U, typename V>
+std::optional<std::pair<U, V>>
+Serializer<std::pair<U, V>>::read(std::istream &input) {
+  std::optional<U> first = Serializer<U>::read(input);
+  if (!first) {
+    return std::nullopt;
+  }
+  std::optional<V> second = Serializer<V>::read(input);
+  asserts::invariant::eval(second.has_value())
+      << "Spill file ended in the middle of an item.";
+  return std::pair<U, V>(std::move(*first), std::move(*second));
+}
+
+template <typename U, typename V>
+size_t Serializer<std::pair<U, V>>::footprint(const std::pair<U, V> &item) {
+  return Serializer<U>::footprint(item.first) +
+         Serializer<V>::footprint(item.second);
+}
+
+template <typename T>
+Writer<T>::Writer(const File &file)
+    : path_(file.path()),
+      output_(file.path(), std::ios::binary | std::ios::trunc) {
+  asserts::invariant::eval(output_.is_open())
+      << "Unable to open spill file " << path_ << " for writing.";
+}
+
+template <typename T>
+void Writer<T>::write(const T &item) {
+  Serializer<T>::write(output_, item);
+}
+
+template <typename T>
+void Writer<T>::close() {
+  output_.close();
+  asserts::invariant::eval(!output_.fail())
+      << "Unable to write spill file " << path_ << ".";
+}
+
+template <typename T>
+Reader<T>::Reader(const File &file) : input_(file.path(), std::ios::binary) {
+  asserts::invariant::eval(input_.is_open())
+      << "Unable to open spill file " << file.path() << " for reading.";
+}
+
+template <typename T>
+std::optional<T> Reader<T>::next() {
+  return Serializer<T>::read(input_);
+}
+
+template <typename T>
+Partitions<T>::Partitions(size_t count, const std::filesystem::path &directory)
+    : bytes_(count, 0) {
+  files_.reserve(count);
+  writers_.reserve(count);
+  for (size_t i = 0; i < count; i++) {
+    files_.push_back(std::make_unique<File>(directory));
+    writers_.push_back(std::make_unique<Writer<T>>(*files_.back()));
+  }
+}
+
+template <typename T>
+void Partitions<T>::write(size_t partition, const T &item) {
+  bytes_[partition] += Serializer<T>::footprint(item);
+  writers_[partition]->write(item);
+}
+
+template <typename T>
+void Partitions<T>::close() {
+  for (std::unique_ptr<Writer<T>> &writer : writers_) {
+    writer->close();
+  }
+  writers_.clear();
+}
+
+template <typename T>
+size_t Partitions<T>::size() const {
+  return files_.size();
+}
+
+template <typename T>
+const File &Partitions<T>::file(size_t partition) const {
+  return *files_[partition];
+}
+
+template <typename T>
+size_t Partitions<T>::bytes(size_t partition) const {
+  return bytes_[partition];
+}
+
+template <typename T, typename Less>
+ExternalSorter<T, Less>::ExternalSorter(Less less, MemoryBudget budget)
+    : less_(std::move(less)), budget_(std::move(budget)), run_bytes_(0),
+      run_offset_(0), spilled_runs_(0) {
+  asserts::invariant::eval(budget_.bytes > 0)
+      << "Memory budget must be greater than zero bytes.";
+}
+
+template <typename T, typename Less>
+void ExternalSorter<T, Less>::push(T item) {
+  run_bytes_ += Serializer<T>::footprint(item);
+  run_.push_back(std::move(item));
+  if (run_bytes_ >= budget_.bytes) {
+    spill_run();
+  }
+}
+
+template <typename T, typename Less>
+void ExternalSorter<T, Less>::finish() {
+  if (runs_.empty()) {
+    std::stable_sort(run_.begin(), run_.end(), less_);
+    return;
+  }
+  if (!run_.empty()) {
+    spill_run();
+  }
+
+  // Merge the oldest runs into one until a single pass can merge the rest.
+  // The merged run takes their place at the front so runs stay in push
+  // order.
+  while (runs_.size() > kMaxMergeWidth) {
+    std::vector<std::unique_ptr<File>> merged_runs(
+        std::make_move_iterator(runs_.begin()),
+        std::make_move_iterator(runs_.begin() + kMaxMergeWidth));
+    runs_.erase(runs_.begin(), runs_.begin() + kMaxMergeWidth);
+
+    auto file = std::make_unique<File>(budget_.temp_dir);
+    Writer<T> writer(*file);
+    Merge merge(less_, merged_runs);
+    while (std::optional<T> item = merge.pop()) {
+      writer.write(*item);
+    }
+    writer.close();
+    runs_.insert(runs_.begin(), std::move(file));
+  }
+  merge_ = std::make_unique<Merge>(less_, runs_);
+}
+
+template <typename T, typename Less>
+std::vector<T> ExternalSorter<T, Less>::next(size_t limit) {
+  std::vector<T> items;
+  if (merge_ == nullptr) {
+    size_t end = std::min(run_.size(), run_offset_ + limit);
+    items.reserve(end - run_offset_);
+    std::move(
+        run_.begin() + run_offset_, run_.begin() + end,
+        std::back_inserter(items));
+    run_offset_ = end;
+    return items;
+  }
+  items.reserve(limit);
+  while (items.size() < limit) {
+    std::optional<T> item = merge_->pop();
+    if (!item) {
+      break;
+    }
+    items.push_back(std::move(*item));
+  }
+  return items;
+}
+
+template <typename T, typename Less>
+size_t ExternalSorter<T, Less>::spilled_runs() const {
+  return spilled_runs_;
+}
+
+template <typename T, typename Less>
+void ExternalSorter<T, Less>::spill_run() {
+  std::stable_sort(run_.begin(), run_.end(), less_);
+  auto file = std::make_unique<File>(budget_.temp_dir);
+  Writer<T> writer(*file);
+  for (const T &item : run_) {
+    writer.write(item);
+  }
+  writer.close();
+  runs_.push_back(std::move(file));
+  spilled_runs_++;
+
+  // Release the memory of the run rather than keeping its capacity.
+  std::vector<T>().swap(run_);
+  run_bytes_ = 0;
+}
+
+template <typename T, typename Less>
+ExternalSorter<T, Less>::Merge::Merge(
+    const Less &less, const std::vector<std::unique_ptr<File>> &runs)
+    : less_(less) {
+  readers_.reserve(runs.size());
+  heads_.reserve(runs.size());
+  for (const std::unique_ptr<File> &run : runs) {
+    readers_.push_back(std::make_unique<Reader<T>>(*run));
+    heads_.push_back(readers_.back()->next());
+    if (heads_.back()) {
+      heap_.push_back(heads_.size() - 1);
+    }
+  }
+  std::make_heap(heap_.begin(), heap_.end(), [this](size_t lhs, size_t rhs) {
+    return after(lhs, rhs);
+  });
+}
+
+template <typename T, typename Less>
+std::optional<T> ExternalSorter<T, Less>::Merge::pop() {
+  if (heap_.empty()) {
+    return std::nullopt;
+  }
+  auto compare = [this](size_t lhs, size_t rhs) { return after(lhs, rhs); };
+  std::pop_heap(heap_.begin(), heap_.end(), compare);
+  size_t run = heap_.back();
+  std::optional<T> item = std::move(heads_[run]);
+  heads_[run] = readers_[run]->next();
+  if (heads_[run]) {
+    std::push_heap(heap_.begin(), heap_.end(), compare);
+  } else {
+    heap_.pop_back();
+  }
+  return item;
+}
+
+template <typename T, typename Less>
+bool ExternalSorter<T, Less>::Merge::after(size_t lhs, size_t rhs) const {
+  // Equal items come out in run order so that merges are deterministic.
+  if (less_(*heads_[rhs], *heads_[lhs])) {
+    return true;
+  }
+  return !less_(*heads_[lhs], *heads_[rhs]) && rhs < lhs;
+}
+
+} // namespace fcpp::spill
+
+#endif // FCPP_SPILL_H
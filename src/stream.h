@@ -0,0 +1,2051 @@
+/**
+ * @file stream.h
+ * @author Andrew Walsh (awalsh128@gmail.com)
+ * @brief Lazy sequences that are pulled and transformed in morsels instead of
+ * being materialized as a whole.
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef FCPP_STREAM_H
+#define FCPP_STREAM_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <istream>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "asserts.h"
+#include "scheduler.h"
+#include "spill.h"
+#include "trace.h"
+#include "traits.h"
+#include "transforms.h"
+#include "window.h"
+
+namespace fcpp {
+
+/**
+ * @brief Default number of items pulled through a stream at a time. Small
+ * enough for a morsel of fundamental types to stay in L2 cache.
+ */
+constexpr size_t kDefaultMorselSize = 16384;
+
+/**
+ * @brief Default number of morsels buffered between pipelined stages.
+ */
+constexpr size_t kDefaultPipelineCapacity = 4;
+
+namespace detail {
+
+/**
+ * @brief How the morsels of a stream are evaluated. Shared by every operation
+ * of a stream so it applies to the whole chain.
+ */
+struct StreamExecution {
+  /**
+   * @brief Maximum number of morsels evaluated at the same time. One
+   * evaluates them sequentially on the pulling thread.
+   */
+  size_t max_in_flight = 1;
+  /**
+   * @brief Pool to evaluate morsels on when more than one is in flight.
+   */
+  scheduler::ThreadPool *pool = nullptr;
+};
+
+/**
+ * @brief Pulls morsel tasks from a source and evaluates them, concurrently if
+ * the execution allows it, while still yielding the morsels in order.
+ *
+ * @tparam T Type of items in the morsels.
+ */
+template <typename T>
+class MorselEvaluator final {
+public:
+  typedef std::function<std::vector<T>()> Task;
+  typedef std::function<std::optional<Task>(size_t)> Source;
+
+  MorselEvaluator(Source source, std::shared_ptr<StreamExecution> execution)
+      : source_(std::move(source)), execution_(std::move(execution)) {}
+  MorselEvaluator(const MorselEvaluator &) = delete;
+  MorselEvaluator &operator=(const MorselEvaluator &) = delete;
+  /**
+   * @brief Waits for morsels still in flight so that none of them outlives
+   * what they refer to.
+   */
+  ~MorselEvaluator() {
+    for (std::future<std::vector<T>> &pending : pending_) {
+      try {
+        execution_->pool->await(std::move(pending));
+      } catch (...) {
+        // Abandoned, only the first error matters.
+      }
+    }
+  }
+
+  /**
+   * @brief Gets the next evaluated morsel in source order.
+   *
+   * @param limit Number of items still needed downstream.
+   * @return std::optional<std::vector<T>> The morsel or std::nullopt once
+   * exhausted.
+   */
+  std::optional<std::vector<T>> next(size_t limit) {
+    if (execution_->max_in_flight <= 1) {
+      std::optional<Task> task = source_(limit);
+      if (!task) {
+        return std::nullopt;
+      }
+      return evaluate(*task);
+    }
+
+    // Keep the pool busy with the morsels that come next, so a slow morsel
+    // only holds back its own slot.
+    while (!exhausted_ && pending_.size() < execution_->max_in_flight) {
+      std::optional<Task> task = source_(limit);
+      if (!task) {
+        exhausted_ = true;
+        break;
+      }
+      pending_.push_back(execution_->pool->submit(
+          [task = std::move(*task)]() { return evaluate(task); }));
+    }
+    if (pending_.empty()) {
+      return std::nullopt;
+    }
+    std::future<std::vector<T>> pending = std::move(pending_.front());
+    pending_.pop_front();
+    return execution_->pool->await(std::move(pending));
+  }
+
+private:
+  static std::vector<T> evaluate(const Task &task) {
+    trace::Span span("morsel", "stream");
+    std::vector<T> morsel = task();
+    span.arg("items", morsel.size());
+    return morsel;
+  }
+
+  Source source_;
+  std::shared_ptr<StreamExecution> execution_;
+  std::deque<std::future<std::vector<T>>> pending_;
+  bool exhausted_ = false;
+};
+
+/**
+ * @brief Evaluates the morsels of a stream on a dedicated thread, handing
+ * them off to the pulling thread through a bounded queue.
+ *
+ * @tparam T Type of items in the morsels.
+ */
+template <typename T>
+class PipelineStage final {
+public:
+  typedef std::function<std::vector<T>()> Task;
+  typedef std::function<std::optional<Task>(size_t)> Source;
+
+  PipelineStage(
+      Source source, std::shared_ptr<StreamExecution> execution,
+      size_t morsel_size, size_t capacity)
+      : upstream_(std::move(source), std::move(execution)),
+        queue_(capacity), morsel_size_(morsel_size) {}
+  PipelineStage(const PipelineStage &) = delete;
+  PipelineStage &operator=(const PipelineStage &) = delete;
+  /**
+   * @brief Stops the thread, which finishes the morsel it is evaluating.
+   */
+  ~PipelineStage() {
+    queue_.cancel();
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+  }
+
+  /**
+   * @brief Gets the next evaluated morsel in source order. The thread is
+   * started by the first call.
+   *
+   * @return std::optional<std::vector<T>> The morsel or std::nullopt once
+   * exhausted.
+   */
+  std::optional<std::vector<T>> next() {
+    if (!thread_.joinable()) {
+      thread_ = std::thread([this]() { run(); });
+    }
+    std::optional<std::vector<T>> morsel = queue_.pop();
+    if (!morsel && error_) {
+      std::rethrow_exception(std::exchange(error_, nullptr));
+    }
+    return morsel;
+  }
+
+private:
+  void run() {
+    try {
+      while (std::optional<std::vector<T>> morsel =
+                 upstream_.next(morsel_size_)) {
+        if (!queue_.push(std::move(*morsel))) {
+          break;
+        }
+      }
+    } catch (...) {
+      // Published to the puller by closing the queue.
+      error_ = std::current_exception();
+    }
+    queue_.close();
+  }
+
+  MorselEvaluator<T> upstream_;
+  scheduler::SpscQueue<std::vector<T>> queue_;
+  size_t morsel_size_;
+  std::exception_ptr error_;
+  std::thread thread_;
+};
+
+} // namespace detail
+
+template <typename T, typename TimestampSelector,
+          typename KeySelector = window::NoKey>
+class Windowed;
+
+/**
+ * @brief Lazy sequence of items that is pulled through its operations one
+ * morsel (chunk of items) at a time.
+ *
+ * Nothing is evaluated until a terminal operation like @ref to_vector is
+ * called. Memory use is then bounded by the morsel size rather than the size
+ * of the sequence, as long as only streaming operations are used.
+ *
+ * Pulling from the source yields a task that computes the morsel. Operations
+ * that work item by item (@ref where, @ref select, @ref flatten,
+ * @ref select_many) are fused into that task, so each morsel goes through all
+ * of them while it is still hot in cache.
+ *
+ * Since the chain is captured before it is evaluated, it is also rewritten
+ * as it is built when the result is the same. A @ref take after an
+ * @ref order_by, even through @ref select, only keeps the first items while
+ * sorting (top-k). A @ref where after an @ref order_by filters the items
+ * before they are sorted. The predicates of a @ref where_all are reordered
+ * by their measured cost and selectivity.
+ *
+ * Like @ref Queryable<T>, operations move the state into the returned stream.
+ *
+ * @tparam T Type of items to stream over.
+ */
+template <typename T>
+class Stream final {
+public:
+  /**
+   * @brief Deferred computation of a single morsel.
+   */
+  typedef std::function<std::vector<T>()> Task;
+  /**
+   * @brief Gets the task of the next morsel or std::nullopt once exhausted.
+   *
+   * The argument is the number of items still needed downstream. Sources
+   * should not produce much more than that but are not required to be exact.
+   */
+  typedef std::function<std::optional<Task>(size_t)> Source;
+
+  /**
+   * @brief Construct a new Stream object from a source of morsels.
+   *
+   * @param source Function that produces the morsel tasks.
+   * @param morsel_size Number of items to pull from the source at a time.
+   */
+  explicit Stream(Source source, size_t morsel_size = kDefaultMorselSize);
+  /**
+   * @brief Empty constructor.
+   * @remark Removed since no-op state is unusable.
+   */
+  Stream() = delete;
+  virtual ~Stream() = default;
+  /**
+   * @brief Move constructor.
+   */
+  Stream(Stream &&) = default;
+  /**
+   * @brief Copy constructor.
+   * @remark Not allowed since sources can only be pulled once.
+   */
+  Stream(const Stream &) = delete;
+  /**
+   * @brief Copy assignment operator.
+   * @remark Not allowed since sources can only be pulled once.
+   * @return Stream&
+   */
+  Stream &operator=(const Stream &) = delete;
+
+  /**
+   * @brief Streams over the items of a vector, moving them out morsel by
+   * morsel.
+   *
+   * @param items Items to stream over.
+   * @param morsel_size Number of items to pull at a time.
+   * @return Stream<T>
+   */
+  static Stream<T>
+  from_vector(std::vector<T> items, size_t morsel_size = kDefaultMorselSize);
+
+  /**
+   * @brief Creates a task for a morsel that has already been evaluated, as
+   * done by sources that must be read sequentially.
+   *
+   * @param morsel Evaluated morsel.
+   * @return Task
+   */
+  static Task ready(std::vector<T> morsel);
+
+  /**
+   * @brief Type of items to stream over. Used for type deduction.
+   */
+  typedef T item_type;
+
+  /**
+   * @brief Sums all the projected values of the stream into a single value.
+   *
+   * @tparam U Accumulating value type.
+   * @tparam AccumulateFn std::function<U(U, T)> Transform function type.
+   * @param initial Value to start with before iterating the stream.
+   * @param accumulate_func Transform function to apply to each item.
+   * @return U The final accumulated value.
+   */
+  template <typename U, typename AccumulateFn>
+  U accumulate(U initial, AccumulateFn accumulate_func);
+
+  /**
+   * @brief Determines whether any item of the stream satisfies a condition.
+   * Stops pulling from the source once one is found.
+   *
+   * @param predicate Function to test each item for a condition.
+   * @return true if any of the items satisfy the predicate.
+   * @return false if none of the items satisfy the predicate.
+   */
+  template <typename Predicate>
+  bool any(Predicate predicate);
+
+  /**
+   * @brief Gets the first item of the stream that satisfies a condition, or a
+   * default value if no item is found. Stops pulling from the source once one
+   * is found.
+   *
+   * @param predicate Function to test each item for a condition.
+   * @return std::optional<T> Either the satisfying item or the not found item
+   * of std::nullopt
+   */
+  template <typename Predicate>
+  std::optional<T> first_or_default(Predicate predicate);
+
+  /**
+   * @brief Flattens a stream of sequences into a stream of their items (i.e.
+   * Stream<vector<T>> -> Stream<T>) without materializing the whole sequence.
+   *
+   * @return Stream<U = T::value_type>
+   */
+  auto flatten();
+
+  /**
+   * @brief Groups the items of the stream by key without holding more than a
+   * memory budget of items.
+   *
+   * @remark See @ref keyed_group_by.
+   *
+   * @tparam KeySelector Transform to key function type.
+   * std::function<K(const T&)>
+   * @param key_selector Transform to key function to apply to each item.
+   * @param budget Memory the groups may hold and where to spill them.
+   * @return Stream<std::vector<T>>
+   */
+  template <typename KeySelector>
+  Stream<std::vector<T>>
+  group_by(KeySelector key_selector, spill::MemoryBudget budget);
+
+  /**
+   * @brief Correlates the items of two streams based on matching keys,
+   * without holding more than a memory budget of the right hand side.
+   *
+   * The right hand side is consumed once the first item is pulled. If it fits
+   * the budget, it is kept in memory and the left hand side is streamed
+   * against it in order. Otherwise both sides are partitioned to temporary
+   * files by key hash (grace hash join) and the partition pairs are joined
+   * concurrently on the pool, each under an equal share of the budget.
+   * Partitions that are still too large are partitioned again.
+   *
+   * @remark Items of a partitioned join come out grouped by partition rather
+   * than in left hand side order. Key selectors must be safe to call
+   * concurrently.
+   *
+   * @tparam U Type of the right hand side stream.
+   * @tparam LhsKeySelector Transform to key function type.
+   * std::function<K(const T&)>
+   * @tparam RhsKeySelector Transform to key function type.
+   * std::function<K(const U&)>
+   * @param rhs The right hand side stream to join against.
+   * @param lhs_key_selector Transform to key function to apply to each item in
+   * this / left hand side stream.
+   * @param rhs_key_selector Transform to key function to apply to each item in
+   * the right hand side stream.
+   * @param budget Memory the right hand side may hold and where to spill
+   * partitions. T and U must have a spill::Serializer.
+   * @param pool Pool to join partitions on.
+   * @return Stream<std::pair<T, U>> Matched pairs.
+   */
+  template <typename U, typename LhsKeySelector, typename RhsKeySelector>
+  Stream<std::pair<T, U>> join(
+      Stream<U> rhs, LhsKeySelector lhs_key_selector,
+      RhsKeySelector rhs_key_selector, spill::MemoryBudget budget,
+      scheduler::ThreadPool &pool = scheduler::ThreadPool::instance());
+
+  /**
+   * @brief Groups the items of the stream by key and produces them as a
+   * stream of key-group pairs, without holding more than a memory budget of
+   * items.
+   *
+   * The stream is consumed once the first group is pulled. Groups are kept in
+   * memory until they exceed the budget. From then on all items are
+   * partitioned to temporary files by key hash, and the partitions are
+   * grouped one at a time as the groups are pulled. Partitions that are
+   * still too large are partitioned again.
+   *
+   * @remark Groups come out in key order if nothing was spilled, otherwise in
+   * key order within each partition. Items of a group keep their order.
+   *
+   * @tparam KeySelector Transform to key function type.
+   * std::function<K(const T&)>
+   * @param key_selector Transform to key function to apply to each item.
+   * @param budget Memory the groups may hold and where to spill them. T must
+   * have a spill::Serializer.
+   * @return Stream<std::pair<K, std::vector<T>>>
+   */
+  template <typename KeySelector>
+  auto keyed_group_by(KeySelector key_selector, spill::MemoryBudget budget);
+
+  /**
+   * @brief Gets the number of items pulled from the source at a time.
+   *
+   * @return size_t
+   */
+  size_t morsel_size() const;
+
+  /**
+   * @brief Orders the stream by the selected value without holding more than
+   * a memory budget of items.
+   *
+   * The stream is consumed once the first item is pulled. Runs of items that
+   * fit the budget are sorted and spilled to temporary files, then merged
+   * back as the ordered items are pulled. The files are removed along with
+   * the stream. Nothing is spilled if the stream fits the budget.
+   *
+   * Followed by a @ref take, only that many items are kept in a heap instead
+   * (top-k), as long as they fit the budget. Followed by a @ref where, the
+   * items are filtered before they are sorted.
+   *
+   * @tparam ValueSelector Transform to value function type.
+   * std::function<V(const T&)>
+   * @param value_selector Transform to value function to apply to each item.
+   * @param descending True if to order by greater to smaller values, otherwise
+   * smaller to greater.
+   * @param budget Memory the items may hold and where to spill them. T must
+   * have a spill::Serializer.
+   * @return Stream<T>
+   */
+  template <typename ValueSelector>
+  Stream<T> order_by(
+      ValueSelector value_selector, bool descending,
+      spill::MemoryBudget budget);
+
+  /**
+   * @brief Evaluates the morsels of the stream concurrently on a thread pool.
+   *
+   * Applies to the whole chain, including operations added before. Morsels
+   * are handed out one at a time, so skewed morsels don't hold back the other
+   * workers, and results are still produced in order. Sources are always
+   * pulled from a single thread.
+   *
+   * @remark Functions given to the operations of the stream must be safe to
+   * call concurrently.
+   *
+   * @param max_in_flight Maximum number of morsels evaluated or buffered at
+   * the same time. Zero uses twice the number of pool threads.
+   * @param pool Pool to evaluate the morsels on.
+   * @return Stream<T>
+   */
+  Stream<T> parallel(
+      size_t max_in_flight = 0,
+      scheduler::ThreadPool &pool = scheduler::ThreadPool::instance());
+
+  /**
+   * @brief Ends a pipeline stage, so the operations before run on their own
+   * thread while the operations after run on the pulling thread.
+   *
+   * Chaining several stages overlaps them, e.g. parsing, filtering and
+   * writing each on their own thread. Evaluated morsels are handed off
+   * through a bounded lock-free queue. The stage stops evaluating morsels
+   * while the queue is full, so a slow stage holds back the ones before it
+   * rather than buffering without bound.
+   *
+   * @code
+   * fcpp::query_lines(path)
+   *     .select(parse)
+   *     .pipelined()
+   *     .where(is_valid)
+   *     .pipelined()
+   *     .select(format)
+   *     .to_vector();
+   * @endcode
+   *
+   * @remark The stage runs ahead of what is needed downstream by up to the
+   * capacity, so a following @ref take may read a few morsels more than it
+   * keeps. The thread starts when the first morsel is pulled and is joined
+   * along with the stream.
+   *
+   * @param capacity Maximum number of morsels buffered between the stages.
+   * @return Stream<T>
+   */
+  Stream<T> pipelined(size_t capacity = kDefaultPipelineCapacity);
+
+  /**
+   * @brief Projects each item of the stream into a new form.
+   *
+   * @tparam Selector Transform function type. std::function<U(T)>
+   * @param selector Transform function to apply to each item.
+   * @return Stream<decltype(selector(T))>
+   */
+  template <typename Selector>
+  auto select(Selector selector);
+
+  /**
+   * @brief Projects each item into a sequence and flattens the sequences as
+   * they are produced.
+   *
+   * @tparam Selector Transform to sequence function type.
+   * std::function<Range<U>(T)>
+   * @param selector Transform to sequence function to apply to each item.
+   * @return Stream<U>
+   */
+  template <typename Selector>
+  auto select_many(Selector selector);
+
+  /**
+   * @brief Assigns the items of the stream to session windows, which extend
+   * while items keep arriving within a gap of each other.
+   *
+   * @remark Items of a key are expected in roughly timestamp order. An item
+   * older than the session of its key by more than the gap is dropped as
+   * late.
+   *
+   * @tparam TimestampSelector Transform to timestamp function type.
+   * std::function<Ts(const T&)> where Ts is an integer, std::chrono::duration
+   * or std::chrono::time_point.
+   * @tparam Duration Type convertible to the difference of two timestamps.
+   * @param timestamp_selector Transform to timestamp function to apply to each
+   * item.
+   * @param gap Time without items that ends a session.
+   * @return Windowed<T, TimestampSelector>
+   */
+  template <typename TimestampSelector, typename Duration>
+  auto session_by(TimestampSelector timestamp_selector, Duration gap);
+
+  /**
+   * @brief Takes up to a specified number of items from the start of the
+   * stream. Nothing past them is pulled from the source.
+   *
+   * @remark Unlike @ref Queryable<T>::take, streams shorter than the value are
+   * not an error since their size is unknown up front.
+   *
+   * @param value The number of items from the beginning to keep.
+   * @return Stream<T>
+   */
+  Stream<T> take(size_t value);
+
+  /**
+   * @brief Gets the stream as a vector, evaluating all of it.
+   *
+   * @return std::vector<T>
+   */
+  std::vector<T> to_vector();
+
+  /**
+   * @brief Selects items in the stream that satisfy the predicate /
+   * conditional.
+   *
+   * Chained filters keep their written order, so a predicate may rely on
+   * the ones before it having passed (e.g. checking for null first).
+   *
+   * @param predicate Function to test each item for a condition.
+   * @return Stream<T>
+   */
+  template <typename Predicate>
+  Stream<T> where(Predicate predicate);
+
+  /**
+   * @brief Selects items in the stream that satisfy all of the predicates,
+   * evaluating the cheapest and most selective first.
+   *
+   * The cost and selectivity of each predicate are measured on the first
+   * morsels (and every so often after), evaluating them in the current order
+   * and stopping at the first that fails. The predicates must therefore be
+   * independent of each other, defined on every item and free of side
+   * effects; chain @ref where calls otherwise.
+   *
+   * @code
+   * stream.where_all({is_recent, is_valid_checksum});
+   * @endcode
+   *
+   * @param predicates Functions to test each item for a condition.
+   * @return Stream<T>
+   */
+  Stream<T> where_all(std::vector<std::function<bool(const T &)>> predicates);
+
+  /**
+   * @brief Assigns the items of the stream to tumbling windows of a fixed
+   * size by timestamp, to be aggregated as the stream is pulled.
+   *
+   * @code
+   * auto per_minute = stream
+   *     .window_by([](const Event &e) { return e.time; }, 1min)
+   *     .allowed_lateness(10s)
+   *     .aggregate(0, [](int n, const Event &) { return n + 1; })
+   *     .to_vector();
+   * @endcode
+   *
+   * @remark Windows start at multiples of the size since the epoch (or zero).
+   * See @ref Windowed for sliding windows, per key windows and lateness.
+   *
+   * @tparam TimestampSelector Transform to timestamp function type.
+   * std::function<Ts(const T&)> where Ts is an integer, std::chrono::duration
+   * or std::chrono::time_point.
+   * @tparam Duration Type convertible to the difference of two timestamps.
+   * @param timestamp_selector Transform to timestamp function to apply to each
+   * item.
+   * @param size Size of the windows.
+   * @return Windowed<T, TimestampSelector>
+   */
+  template <typename TimestampSelector, typename Duration>
+  auto window_by(TimestampSelector timestamp_selector, Duration size);
+
+private:
+  template <typename U>
+  friend class Stream;
+  template <typename U, typename TimestampSelector, typename KeySelector>
+  friend class Windowed;
+
+  /**
+   * @brief Construct a new Stream object that shares the execution of the
+   * stream it was derived from.
+   *
+   * @param source Function that produces the morsel tasks.
+   * @param morsel_size Number of items to pull from the source at a time.
+   * @param execution Execution of the chain.
+   */
+  Stream(
+      Source source, size_t morsel_size,
+      std::shared_ptr<detail::StreamExecution> execution);
+
+  /**
+   * @brief Wraps each morsel task of this stream with a transform of the
+   * morsel.
+   *
+   * @tparam U Type of items produced by the transform.
+   * @tparam MorselFn Transform function type. std::function<vector<U>(vector<T>)>
+   * @param morsel_func Transform to apply to every morsel.
+   * @param forward_limit True if the number of items needed downstream is
+   * also the number needed from this stream.
+   * @return Stream<U>
+   */
+  template <typename U, typename MorselFn>
+  Stream<U> fuse(MorselFn morsel_func, bool forward_limit);
+
+  /**
+   * @brief Pulls and evaluates morsels in order until exhausted or the
+   * consumer asks to stop.
+   *
+   * @tparam Consumer Function type. std::function<bool(vector<T>&)> that
+   * returns false to stop.
+   * @param consumer Function given each evaluated morsel.
+   */
+  template <typename Consumer>
+  void consume(Consumer consumer);
+
+  /**
+   * @brief Rewrites of the plan that the operation producing the stream
+   * accepts from the operations chained after it. Applied as the chain is
+   * built, before anything is pulled.
+   */
+  struct Rewrites {
+    /**
+     * @brief Lowers the number of items needed from the operation, e.g. so
+     * that a sort only keeps the first items.
+     */
+    std::function<void(size_t)> bound;
+    /**
+     * @brief Applies an operation to the input of the operation rather than
+     * its output, e.g. so that a sort only sorts the items kept by a filter.
+     */
+    std::function<void(std::function<Stream<T>(Stream<T>)>)> below;
+  };
+
+  Source source_;
+  size_t morsel_size_;
+  std::shared_ptr<detail::StreamExecution> execution_;
+  Rewrites rewrites_;
+};
+
+/**
+ * @brief Stream whose items are assigned to time windows, waiting for an
+ * aggregation.
+ *
+ * Windows are aggregated as the stream is pulled and only windows that are
+ * still open are held in memory. The watermark trails the latest timestamp
+ * seen by the allowed lateness. Once it passes the end of a window, the
+ * window is emitted and later items that would have fallen into it are
+ * dropped. The remaining windows are emitted when the stream ends.
+ *
+ * @tparam T Type of items to aggregate.
+ * @tparam TimestampSelector Transform to timestamp function type.
+ * std::function<Ts(const T&)>
+ * @tparam KeySelector Transform to key function type. std::function<K(const
+ * T&)>
+ */
+template <typename T, typename TimestampSelector, typename KeySelector>
+class Windowed final {
+public:
+  /**
+   * @brief Type of the timestamps.
+   */
+  typedef std::decay_t<decltype(std::declval<TimestampSelector &>()(
+      std::declval<const T &>()))>
+      timestamp_type;
+  /**
+   * @brief Type of the difference between two timestamps.
+   */
+  typedef typename window::duration_of<timestamp_type>::type duration_type;
+  /**
+   * @brief Type of the key the windows are separated by.
+   */
+  typedef std::decay_t<decltype(std::declval<KeySelector &>()(
+      std::declval<const T &>()))>
+      key_type;
+
+  /**
+   * @brief Move constructor.
+   */
+  Windowed(Windowed &&) = default;
+  Windowed(const Windowed &) = delete;
+  Windowed &operator=(const Windowed &) = delete;
+
+  /**
+   * @brief Aggregates the items of each window into a single value.
+   *
+   * @tparam A Accumulating value type.
+   * @tparam AccumulateFn std::function<A(A, const T&)> Transform function type.
+   * @param initial Value every window starts with.
+   * @param accumulate_func Transform function to apply to each item of a
+   * window.
+   * @return Stream<window::Window<timestamp_type, A, key_type>> Windows
+   * ordered by end, then key.
+   */
+  template <typename A, typename AccumulateFn>
+  Stream<window::Window<timestamp_type, A, key_type>>
+  aggregate(A initial, AccumulateFn accumulate_func);
+
+  /**
+   * @brief Keeps windows open for items that arrive out of order, up to the
+   * given time behind the latest timestamp seen.
+   *
+   * @param lateness Time the watermark trails the latest timestamp.
+   * @return Windowed
+   */
+  Windowed allowed_lateness(duration_type lateness);
+
+  /**
+   * @brief Separates the windows by key, so every key has its own windows.
+   *
+   * @tparam NewKeySelector Transform to key function type.
+   * std::function<K(const T&)>
+   * @param key_selector Transform to key function to apply to each item.
+   * @return Windowed<T, TimestampSelector, NewKeySelector>
+   */
+  template <typename NewKeySelector>
+  Windowed<T, TimestampSelector, NewKeySelector>
+  by(NewKeySelector key_selector);
+
+  /**
+   * @brief Starts a window every slide rather than every size, making them
+   * sliding windows that overlap when the slide is smaller than the size.
+   *
+   * @param slide Time between the starts of windows.
+   * @return Windowed
+   */
+  Windowed every(duration_type slide);
+
+private:
+  friend class Stream<T>;
+  template <typename U, typename OtherTimestampSelector,
+            typename OtherKeySelector>
+  friend class Windowed;
+
+  Windowed(
+      Stream<T> upstream, TimestampSelector timestamp_selector,
+      KeySelector key_selector, window::Spec<duration_type> spec);
+
+  Stream<T> upstream_;
+  TimestampSelector timestamp_selector_;
+  KeySelector key_selector_;
+  window::Spec<duration_type> spec_;
+};
+
+/**
+ * @brief Streams over the lines of an input stream, parsing each line into an
+ * item.
+ *
+ * Lines are read sequentially as morsels are pulled, so only a morsel of lines
+ * is held in memory at a time. Parsing is fused with the operations that
+ * follow.
+ *
+ * @tparam Parser Line parsing function type. std::function<T(std::string)>
+ * @param input Input stream of newline delimited items. Must outlive the
+ * stream.
+ * @param parser Function to parse each line into an item.
+ * @param morsel_size Number of lines to read at a time.
+ * @return Stream<T>
+ */
+template <typename Parser>
+auto query_stream(
+    std::istream &input, Parser parser,
+    size_t morsel_size = kDefaultMorselSize);
+
+/**
+ * @brief Streams over the lines of a file.
+ *
+ * @param path Path to the newline delimited file.
+ * @param morsel_size Number of lines to read at a time.
+ * @return Stream<std::string>
+ */
+inline Stream<std::string> query_lines(
+    const std::filesystem::path &path, size_t morsel_size = kDefaultMorselSize);
+
+} // namespace fcpp
+
+/******************************************************************************
+ *
+ * @brief Keep definitions separate to allow the declarations to stay clean and
+ * compact.
+ *
+ *****************************************************************************/
+
+namespace fcpp {
+
+namespace detail {
+
+/**
+ * @brief Right hand side of a join grouped by key, probed by left hand side
+ * items.
+ *
+ * @tparam K Type of the join key.
+ * @tparam U Type of the right hand side items.
+ */
+template <typename K, typename U>
+class JoinTable final {
+public:
+  void insert(K key, U item) {
+    groups_[std::move(key)].items.push_back(std::move(item));
+  }
+
+  template <typename T>
+  void probe(const K &key, T &item, std::vector<std::pair<T, U>> &joined) {
+    auto it = groups_.find(key);
+    if (it == groups_.end()) {
+      return;
+    }
+    Group &group = it->second;
+    for (size_t i = 0; i < group.items.size(); i++) {
+      // Non-copyable right hand items can be moved to their first match only.
+      joined.emplace_back(
+          transforms::move_or_copy(item, i + 1 == group.items.size()),
+          transforms::move_or_copy(
+              group.items[i],
+              !std::is_copy_constructible_v<U> && !group.taken));
+    }
+    group.taken = true;
+  }
+
+private:
+  struct Group {
+    std::vector<U> items;
+    bool taken = false;
+  };
+
+  std::map<K, Group> groups_;
+};
+
+/**
+ * @brief Number of times partitions of a join are partitioned again before
+ * they are joined in memory regardless of the budget, such as when most
+ * items share a key.
+ */
+constexpr size_t kMaxPartitionLevel = 3;
+
+/**
+ * @brief Distributes the items of a spill file over partitions by key hash.
+ */
+template <typename T, typename KeySelector>
+void repartition(
+    const spill::File &file, KeySelector &key_selector, size_t level,
+    spill::Partitions<T> &partitions) {
+  using K = std::decay_t<decltype(key_selector(std::declval<const T &>()))>;
+  spill::Reader<T> reader(file);
+  while (std::optional<T> item = reader.next()) {
+    size_t hash = std::hash<K>()(key_selector(std::as_const(*item)));
+    partitions.write(
+        spill::partition_of(hash, level, partitions.size()), *item);
+  }
+  partitions.close();
+}
+
+/**
+ * @brief Joins a pair of partitions with the same keys in memory, or
+ * partitions them again if the right hand side exceeds the budget.
+ */
+template <typename T, typename U, typename LhsKeySelector,
+          typename RhsKeySelector>
+void join_partitions(
+    const spill::File &lhs_file, const spill::File &rhs_file,
+    size_t rhs_bytes, LhsKeySelector &lhs_key_selector,
+    RhsKeySelector &rhs_key_selector, const spill::MemoryBudget &budget,
+    size_t level, std::vector<std::pair<T, U>> &joined) {
+  if (rhs_bytes > budget.bytes && level < kMaxPartitionLevel) {
+    spill::Partitions<T> lhs_partitions(
+        spill::kPartitionCount, budget.temp_dir);
+    spill::Partitions<U> rhs_partitions(
+        spill::kPartitionCount, budget.temp_dir);
+    repartition(lhs_file, lhs_key_selector, level, lhs_partitions);
+    repartition(rhs_file, rhs_key_selector, level, rhs_partitions);
+    for (size_t i = 0; i < spill::kPartitionCount; i++) {
+      join_partitions(
+          lhs_partitions.file(i), rhs_partitions.file(i),
+          rhs_partitions.bytes(i), lhs_key_selector, rhs_key_selector, budget,
+          level + 1, joined);
+    }
+    return;
+  }
+
+  using K = std::decay_t<decltype(rhs_key_selector(std::declval<const U &>()))>;
+  JoinTable<K, U> table;
+  spill::Reader<U> rhs_reader(rhs_file);
+  while (std::optional<U> item = rhs_reader.next()) {
+    K key = rhs_key_selector(std::as_const(*item));
+    table.insert(std::move(key), std::move(*item));
+  }
+  spill::Reader<T> lhs_reader(lhs_file);
+  while (std::optional<T> item = lhs_reader.next()) {
+    table.probe(lhs_key_selector(std::as_const(*item)), *item, joined);
+  }
+}
+
+/**
+ * @brief Groups items by key in memory until a budget is exceeded, then by
+ * partitions of key hashes spilled to disk, one partition at a time.
+ *
+ * @tparam T Type of items to group.
+ * @tparam KeySelector Transform to key function type.
+ * std::function<K(const T&)>
+ */
+template <typename T, typename KeySelector>
+class SpillingGroups final {
+public:
+  using K = std::decay_t<decltype(std::declval<KeySelector &>()(
+      std::declval<const T &>()))>;
+  typedef std::pair<K, std::vector<T>> Group;
+
+  SpillingGroups(KeySelector key_selector, spill::MemoryBudget budget)
+      : key_selector_(std::move(key_selector)), budget_(std::move(budget)),
+        bytes_(0) {}
+
+  void add(T item) {
+    if (spilled_ != nullptr) {
+      spill(item);
+      return;
+    }
+    K key = key_selector_(std::as_const(item));
+    bytes_ += spill::Serializer<T>::footprint(item);
+    auto it = groups_.find(key);
+    if (it == groups_.end()) {
+      bytes_ += sizeof(typename std::map<K, std::vector<T>>::value_type);
+      it = groups_.emplace(std::move(key), std::vector<T>()).first;
+    }
+    it->second.push_back(std::move(item));
+    if (bytes_ <= budget_.bytes) {
+      return;
+    }
+
+    // Over budget, so move everything held so far to disk in group order,
+    // which keeps the items of every group in order.
+    spilled_ = std::make_shared<spill::Partitions<T>>(
+        spill::kPartitionCount, budget_.temp_dir);
+    for (auto &group : groups_) {
+      for (const T &held : group.second) {
+        spill(held);
+      }
+    }
+    groups_.clear();
+    bytes_ = 0;
+  }
+
+  void finish() {
+    if (spilled_ == nullptr) {
+      return;
+    }
+    spilled_->close();
+    for (size_t i = 0; i < spilled_->size(); i++) {
+      pending_.push_back({spilled_, i, /*level=*/1});
+    }
+    spilled_.reset();
+  }
+
+  std::vector<Group> next(size_t limit) {
+    while (groups_.empty() && !pending_.empty()) {
+      Partition partition = std::move(pending_.front());
+      pending_.pop_front();
+      load(partition);
+    }
+    std::vector<Group> groups;
+    while (!groups_.empty() && groups.size() < limit) {
+      auto node = groups_.extract(groups_.begin());
+      groups.emplace_back(std::move(node.key()), std::move(node.mapped()));
+    }
+    return groups;
+  }
+
+private:
+  struct Partition {
+    std::shared_ptr<spill::Partitions<T>> partitions;
+    size_t index;
+    size_t level;
+  };
+
+  void spill(const T &item) {
+    size_t hash = std::hash<K>()(key_selector_(item));
+    spilled_->write(spill::partition_of(hash, 0, spilled_->size()), item);
+  }
+
+  void load(const Partition &partition) {
+    const spill::File &file = partition.partitions->file(partition.index);
+    if (partition.partitions->bytes(partition.index) > budget_.bytes &&
+        partition.level < kMaxPartitionLevel) {
+      auto partitions = std::make_shared<spill::Partitions<T>>(
+          spill::kPartitionCount, budget_.temp_dir);
+      repartition(file, key_selector_, partition.level, *partitions);
+      for (size_t i = partitions->size(); i > 0; i--) {
+        pending_.push_front({partitions, i - 1, partition.level + 1});
+      }
+      return;
+    }
+    spill::Reader<T> reader(file);
+    while (std::optional<T> item = reader.next()) {
+      K key = key_selector_(std::as_const(*item));
+      groups_[std::move(key)].push_back(std::move(*item));
+    }
+  }
+
+  KeySelector key_selector_;
+  spill::MemoryBudget budget_;
+  size_t bytes_;
+  std::map<K, std::vector<T>> groups_;
+  std::shared_ptr<spill::Partitions<T>> spilled_;
+  std::deque<Partition> pending_;
+};
+
+/**
+ * @brief Sorts items with an external sorter, unless bounded to the first
+ * items, which are then kept in a heap while the rest are dropped (top-k).
+ * Falls back to the external sorter if the kept items exceed the budget.
+ *
+ * @tparam T Type of items to sort.
+ * @tparam Less Strict weak ordering of the items.
+ */
+template <typename T, typename Less>
+class BoundedSorter final {
+public:
+  BoundedSorter(Less less, spill::MemoryBudget budget)
+      : less_(less), budget_bytes_(budget.bytes),
+        sorter_(std::move(less), std::move(budget)) {}
+  BoundedSorter(const BoundedSorter &) = delete;
+  BoundedSorter &operator=(const BoundedSorter &) = delete;
+
+  /**
+   * @brief Lowers the number of sorted items needed. Must be called before
+   * any item is pushed.
+   */
+  void bound(size_t count) { bound_ = std::min(bound_, count); }
+
+  void push(T item) {
+    if (bound_ == kUnbounded) {
+      sorter_.push(std::move(item));
+      return;
+    }
+    if (heap_.size() < bound_) {
+      bytes_ += spill::Serializer<T>::footprint(item);
+      heap_.push_back({std::move(item), order_++});
+      std::push_heap(heap_.begin(), heap_.end(), before());
+      if (bytes_ > budget_bytes_) {
+        // Too large to hold, so sort the kept items and the rest externally,
+        // pushed in their original order for the stable sort.
+        std::sort(
+            heap_.begin(), heap_.end(),
+            [](const Entry &lhs, const Entry &rhs) {
+              return lhs.order < rhs.order;
+            });
+        for (Entry &entry : heap_) {
+          sorter_.push(std::move(entry.item));
+        }
+        std::vector<Entry>().swap(heap_);
+        bound_ = kUnbounded;
+      }
+      return;
+    }
+    // Only replace the last kept item if strictly before it, so equal items
+    // keep their order.
+    if (heap_.empty() || !less_(item, heap_.front().item)) {
+      return;
+    }
+    std::pop_heap(heap_.begin(), heap_.end(), before());
+    bytes_ -= spill::Serializer<T>::footprint(heap_.back().item);
+    bytes_ += spill::Serializer<T>::footprint(item);
+    heap_.back() = {std::move(item), order_++};
+    std::push_heap(heap_.begin(), heap_.end(), before());
+  }
+
+  void finish() {
+    if (bound_ == kUnbounded) {
+      sorter_.finish();
+      return;
+    }
+    std::sort_heap(heap_.begin(), heap_.end(), before());
+  }
+
+  std::vector<T> next(size_t limit) {
+    if (bound_ == kUnbounded) {
+      return sorter_.next(limit);
+    }
+    size_t end = std::min(heap_.size(), taken_ + limit);
+    std::vector<T> items;
+    items.reserve(end - taken_);
+    for (; taken_ < end; taken_++) {
+      items.push_back(std::move(heap_[taken_].item));
+    }
+    return items;
+  }
+
+private:
+  static constexpr size_t kUnbounded = std::numeric_limits<size_t>::max();
+
+  struct Entry {
+    T item;
+    size_t order;
+  };
+
+  /**
+   * @brief Orders entries by item, then by push order.
+   */
+  auto before() const {
+    return [this](const Entry &lhs, const Entry &rhs) {
+      if (less_(lhs.item, rhs.item)) {
+        return true;
+      }
+      return !less_(rhs.item, lhs.item) && lhs.order < rhs.order;
+    };
+  }
+
+  Less less_;
+  size_t budget_bytes_;
+  spill::ExternalSorter<T, Less> sorter_;
+  size_t bound_ = kUnbounded;
+  std::vector<Entry> heap_;
+  size_t bytes_ = 0;
+  size_t order_ = 0;
+  size_t taken_ = 0;
+};
+
+/**
+ * @brief Number of first morsels a conjunction of predicates is measured on
+ * before it is reordered.
+ */
+constexpr size_t kSampledMorsels = 4;
+
+/**
+ * @brief Interval in morsels at which a conjunction of predicates is measured
+ * again after the first morsels, so the order follows changes in the data.
+ */
+constexpr size_t kResampleInterval = 64;
+
+/**
+ * @brief Conjunction of predicates that evaluates the cheapest and most
+ * selective first, as measured on the morsels it filters.
+ *
+ * Every morsel evaluates the predicates by ascending cost per item dropped,
+ * stopping at the first that fails. Sampled morsels evaluate them one at a
+ * time over the items still kept, measuring the cost of each and the ratio
+ * of those items it passes.
+ *
+ * @tparam T Type of items to filter.
+ */
+template <typename T>
+class AdaptiveFilter final {
+public:
+  typedef std::function<bool(const T &)> Predicate;
+
+  explicit AdaptiveFilter(std::vector<Predicate> predicates)
+      : predicates_(std::move(predicates)), stats_(predicates_.size()),
+        order_(predicates_.size()) {
+    std::iota(order_.begin(), order_.end(), 0);
+  }
+  AdaptiveFilter(const AdaptiveFilter &) = delete;
+  AdaptiveFilter &operator=(const AdaptiveFilter &) = delete;
+
+  void apply(std::vector<T> &morsel) {
+    bool sampled;
+    std::vector<size_t> order;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      sampled = morsels_ < kSampledMorsels ||
+                morsels_ % kResampleInterval == 0;
+      morsels_++;
+      order = order_;
+    }
+    if (!sampled) {
+      morsel.erase(
+          std::remove_if(
+              morsel.begin(), morsel.end(),
+              [this, &order](const T &item) {
+                for (size_t i : order) {
+                  if (!predicates_[i](item)) {
+                    return true;
+                  }
+                }
+                return false;
+              }),
+          morsel.end());
+      return;
+    }
+
+    // Each predicate only sees the items the ones before it passed, so its
+    // ratio is conditioned on them as it is when evaluated in this order.
+    std::vector<Stats> measured(predicates_.size());
+    for (size_t i : order) {
+      size_t items = morsel.size();
+      auto start = std::chrono::steady_clock::now();
+      morsel.erase(
+          std::remove_if(
+              morsel.begin(), morsel.end(),
+              [this, i](const T &item) { return !predicates_[i](item); }),
+          morsel.end());
+      std::chrono::duration<double, std::nano> elapsed =
+          std::chrono::steady_clock::now() - start;
+      measured[i] = {elapsed.count(), static_cast<double>(items),
+                     static_cast<double>(morsel.size())};
+    }
+    reorder(measured);
+  }
+
+private:
+  struct Stats {
+    double nanoseconds = 0;
+    double items = 0;
+    double passed = 0;
+  };
+
+  void reorder(const std::vector<Stats> &measured) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Past the first morsels, older measurements fade so the order follows
+    // the data.
+    double decay = morsels_ > kSampledMorsels ? 0.5 : 1.0;
+    std::vector<double> rank(stats_.size());
+    for (size_t i = 0; i < stats_.size(); i++) {
+      Stats &stats = stats_[i];
+      stats.nanoseconds = stats.nanoseconds * decay + measured[i].nanoseconds;
+      stats.items = stats.items * decay + measured[i].items;
+      stats.passed = stats.passed * decay + measured[i].passed;
+      double dropped = stats.items - stats.passed;
+      rank[i] = dropped > 0 ? stats.nanoseconds / dropped
+                            : std::numeric_limits<double>::infinity();
+    }
+    std::stable_sort(
+        order_.begin(), order_.end(),
+        [&rank](size_t lhs, size_t rhs) { return rank[lhs] < rank[rhs]; });
+  }
+
+  std::vector<Predicate> predicates_;
+  std::mutex mutex_;
+  std::vector<Stats> stats_;
+  std::vector<size_t> order_;
+  size_t morsels_ = 0;
+};
+
+} // namespace detail
+
+template <typename T>
+Stream<T>::Stream(Source source, size_t morsel_size)
+    : Stream(
+          std::move(source), morsel_size,
+          std::make_shared<detail::StreamExecution>()) {}
+
+template <typename T>
+Stream<T>::Stream(
+    Source source, size_t morsel_size,
+    std::shared_ptr<detail::StreamExecution> execution)
+    : source_(std::move(source)), morsel_size_(morsel_size),
+      execution_(std::move(execution)) {
+  asserts::invariant::eval(morsel_size_ > 0)
+      << "Morsel size must be greater than zero.";
+}
+
+template <typename T>
+Stream<T> Stream<T>::from_vector(std::vector<T> items, size_t morsel_size) {
+  // Shared between the tasks that each move out a disjoint range.
+  auto shared = std::make_shared<std::vector<T>>(std::move(items));
+  auto offset = std::make_shared<size_t>(0);
+  return Stream<T>(
+      [shared, offset](size_t limit) -> std::optional<Task> {
+        size_t begin = *offset;
+        if (begin >= shared->size()) {
+          return std::nullopt;
+        }
+        size_t end = std::min(shared->size(), begin + limit);
+        *offset = end;
+        return Task([shared, begin, end]() {
+          return std::vector<T>(
+              std::make_move_iterator(shared->begin() + begin),
+              std::make_move_iterator(shared->begin() + end));
+        });
+      },
+      morsel_size);
+}
+
+template <typename T>
+template <typename U, typename AccumulateFn>
+U Stream<T>::accumulate(U initial, AccumulateFn accumulate_func) {
+  static_assert(
+      traits::is_additive<U>::value, "Initial value type must be additive.");
+  U accumulated = std::move(initial);
+  consume([&](std::vector<T> &morsel) {
+    accumulated = std::accumulate(
+        std::make_move_iterator(morsel.begin()),
+        std::make_move_iterator(morsel.end()), std::move(accumulated),
+        accumulate_func);
+    return true;
+  });
+  return accumulated;
+}
+
+template <typename T>
+template <typename Predicate>
+bool Stream<T>::any(Predicate predicate) {
+  bool found = false;
+  consume([&](std::vector<T> &morsel) {
+    found = std::any_of(morsel.begin(), morsel.end(), predicate);
+    return !found;
+  });
+  return found;
+}
+
+template <typename T>
+template <typename Predicate>
+std::optional<T> Stream<T>::first_or_default(Predicate predicate) {
+  std::optional<T> found;
+  consume([&](std::vector<T> &morsel) {
+    auto it = std::find_if(morsel.begin(), morsel.end(), predicate);
+    if (it != morsel.end()) {
+      found.emplace(std::move(*it));
+    }
+    return !found;
+  });
+  return found;
+}
+
+template <typename T>
+auto Stream<T>::flatten() {
+  // @todo asserts::invariant T is a vector.
+  using U = typename T::value_type;
+  return fuse<U>(
+      [](std::vector<T> morsel) {
+        size_t size = 0;
+        for (const T &item : morsel) {
+          size += item.size();
+        }
+        std::vector<U> flattened;
+        flattened.reserve(size);
+        for (T &item : morsel) {
+          std::move(item.begin(), item.end(), std::back_inserter(flattened));
+        }
+        return flattened;
+      },
+      /*forward_limit=*/true);
+}
+
+template <typename T>
+template <typename KeySelector>
+Stream<std::vector<T>>
+Stream<T>::group_by(KeySelector key_selector, spill::MemoryBudget budget) {
+  using K = std::decay_t<decltype(key_selector(std::declval<const T &>()))>;
+  return keyed_group_by(std::move(key_selector), std::move(budget))
+      .select([](std::pair<K, std::vector<T>> &&group) {
+        return std::move(group.second);
+      });
+}
+
+template <typename T>
+template <typename U, typename LhsKeySelector, typename RhsKeySelector>
+Stream<std::pair<T, U>> Stream<T>::join(
+    Stream<U> rhs, LhsKeySelector lhs_key_selector,
+    RhsKeySelector rhs_key_selector, spill::MemoryBudget budget,
+    scheduler::ThreadPool &pool) {
+  static_assert(
+      !traits::is_copying_selector<LhsKeySelector, T>::value &&
+          !traits::is_copying_selector<RhsKeySelector, U>::value,
+      "Key selectors must take items by reference, not copy every item.");
+  using KT = traits::key_of_t<LhsKeySelector, T>;
+  using KU = traits::key_of_t<RhsKeySelector, U>;
+  static_assert(
+      std::is_same<KU, KT>::value,
+      "Left and right hand key selectors must produce the same type.");
+  using K = KT;
+  static_assert(
+      traits::is_less_than_comparable<K>::value,
+      "Key selectors must produce a type that is less-than compareable.");
+  static_assert(
+      traits::is_hashable<K>::value,
+      "Key selectors must produce a type that is hashable with std::hash.");
+  using V = std::pair<T, U>;
+  asserts::invariant::eval(budget.bytes > 0)
+      << "Memory budget must be greater than zero bytes.";
+
+  struct Join {
+    std::optional<Stream<T>> lhs;
+    std::optional<Stream<U>> rhs;
+    LhsKeySelector lhs_key_selector;
+    RhsKeySelector rhs_key_selector;
+    spill::MemoryBudget budget;
+    scheduler::ThreadPool *pool;
+    std::optional<typename Stream<V>::Source> joined;
+  };
+  size_t morsel_size = morsel_size_;
+  std::shared_ptr<detail::StreamExecution> execution = execution_;
+  auto join = std::make_shared<Join>(Join{
+      std::move(*this), std::move(rhs), std::move(lhs_key_selector),
+      std::move(rhs_key_selector), std::move(budget), &pool, std::nullopt});
+
+  auto start = [](Join &join) -> typename Stream<V>::Source {
+    const size_t count = spill::kPartitionCount;
+    std::vector<U> rhs_items;
+    size_t rhs_bytes = 0;
+    std::shared_ptr<spill::Partitions<U>> rhs_partitions;
+    join.rhs->consume([&](std::vector<U> &morsel) {
+      for (U &item : morsel) {
+        if (rhs_partitions == nullptr) {
+          rhs_bytes += spill::Serializer<U>::footprint(item);
+          rhs_items.push_back(std::move(item));
+          if (rhs_bytes <= join.budget.bytes) {
+            continue;
+          }
+          // Over budget, so move everything held so far to disk.
+          rhs_partitions = std::make_shared<spill::Partitions<U>>(
+              count, join.budget.temp_dir);
+          for (const U &held : rhs_items) {
+            rhs_partitions->write(
+                spill::partition_of(
+                    std::hash<K>()(join.rhs_key_selector(held)), 0, count),
+                held);
+          }
+          std::vector<U>().swap(rhs_items);
+        } else {
+          rhs_partitions->write(
+              spill::partition_of(
+                  std::hash<K>()(join.rhs_key_selector(item)), 0, count),
+              item);
+        }
+      }
+      return true;
+    });
+    join.rhs.reset();
+
+    if (rhs_partitions == nullptr) {
+      // Probe the left hand side as it streams, fused with the operations
+      // before the join.
+      auto table = std::make_shared<detail::JoinTable<K, U>>();
+      for (U &item : rhs_items) {
+        K key = join.rhs_key_selector(std::as_const(item));
+        table->insert(std::move(key), std::move(item));
+      }
+      Stream<V> probed = join.lhs->template fuse<V>(
+          [table, lhs_key_selector = join.lhs_key_selector](
+              std::vector<T> morsel) {
+            std::vector<V> joined;
+            for (T &item : morsel) {
+              table->probe(
+                  lhs_key_selector(std::as_const(item)), item, joined);
+            }
+            return joined;
+          },
+          /*forward_limit=*/false);
+      join.lhs.reset();
+      return std::move(probed.source_);
+    }
+
+    auto lhs_partitions =
+        std::make_shared<spill::Partitions<T>>(count, join.budget.temp_dir);
+    join.lhs->consume([&](std::vector<T> &morsel) {
+      for (const T &item : morsel) {
+        lhs_partitions->write(
+            spill::partition_of(
+                std::hash<K>()(join.lhs_key_selector(item)), 0, count),
+            item);
+      }
+      return true;
+    });
+    join.lhs.reset();
+    lhs_partitions->close();
+    rhs_partitions->close();
+
+    // Every partition pair is a task, so pairs are joined concurrently while
+    // their results are still handed out in order.
+    size_t concurrency = join.pool->size();
+    spill::MemoryBudget partition_budget{
+        std::max<size_t>(1, join.budget.bytes / concurrency),
+        join.budget.temp_dir};
+    auto next_partition = std::make_shared<size_t>(0);
+    auto partitions = std::make_shared<detail::MorselEvaluator<V>>(
+        [=, lhs_key_selector = join.lhs_key_selector,
+         rhs_key_selector = join.rhs_key_selector](
+            size_t) -> std::optional<typename Stream<V>::Task> {
+          size_t partition = (*next_partition)++;
+          if (partition >= count) {
+            return std::nullopt;
+          }
+          return typename Stream<V>::Task(
+              [=]() mutable {
+                std::vector<V> joined;
+                detail::join_partitions(
+                    lhs_partitions->file(partition),
+                    rhs_partitions->file(partition),
+                    rhs_partitions->bytes(partition), lhs_key_selector,
+                    rhs_key_selector, partition_budget, /*level=*/1, joined);
+                return joined;
+              });
+        },
+        std::make_shared<detail::StreamExecution>(
+            detail::StreamExecution{concurrency, join.pool}));
+    return [partitions](
+               size_t limit) -> std::optional<typename Stream<V>::Task> {
+      std::optional<std::vector<V>> morsel = partitions->next(limit);
+      if (!morsel) {
+        return std::nullopt;
+      }
+      return Stream<V>::ready(std::move(*morsel));
+    };
+  };
+
+  return Stream<V>(
+      [join, start](size_t limit) -> std::optional<typename Stream<V>::Task> {
+        if (!join->joined) {
+          join->joined = start(*join);
+        }
+        return (*join->joined)(limit);
+      },
+      morsel_size, std::move(execution));
+}
+
+template <typename T>
+template <typename KeySelector>
+auto Stream<T>::keyed_group_by(
+    KeySelector key_selector, spill::MemoryBudget budget) {
+  static_assert(
+      !traits::is_copying_selector<KeySelector, T>::value,
+      "Key selector must take items by reference, not copy every item.");
+  using Groups = detail::SpillingGroups<T, KeySelector>;
+  using K = typename Groups::K;
+  using V = typename Groups::Group;
+  static_assert(
+      traits::is_less_than_comparable<K>::value,
+      "Key selector must produce a value that is less-than comparable.");
+  static_assert(
+      traits::is_hashable<K>::value,
+      "Key selector must produce a type that is hashable with std::hash.");
+  asserts::invariant::eval(budget.bytes > 0)
+      << "Memory budget must be greater than zero bytes.";
+
+  struct Group {
+    std::optional<Stream<T>> upstream;
+    Groups groups;
+  };
+  size_t morsel_size = morsel_size_;
+  std::shared_ptr<detail::StreamExecution> execution = execution_;
+  auto group = std::make_shared<Group>(Group{
+      std::move(*this), Groups(std::move(key_selector), std::move(budget))});
+  return Stream<V>(
+      [group](size_t limit) -> std::optional<typename Stream<V>::Task> {
+        if (group->upstream) {
+          group->upstream->consume([&group](std::vector<T> &morsel) {
+            for (T &item : morsel) {
+              group->groups.add(std::move(item));
+            }
+            return true;
+          });
+          group->upstream.reset();
+          group->groups.finish();
+        }
+        std::vector<V> groups = group->groups.next(limit);
+        if (groups.empty()) {
+          return std::nullopt;
+        }
+        return Stream<V>::ready(std::move(groups));
+      },
+      morsel_size, std::move(execution));
+}
+
+template <typename T>
+size_t Stream<T>::morsel_size() const {
+  return morsel_size_;
+}
+
+template <typename T>
+template <typename ValueSelector>
+Stream<T> Stream<T>::order_by(
+    ValueSelector value_selector, bool descending,
+    spill::MemoryBudget budget) {
+  static_assert(
+      !traits::is_copying_selector<ValueSelector, T>::value,
+      "Value selector must take items by reference, not copy every item.");
+  using V = decltype(value_selector(std::declval<const T &>()));
+  static_assert(
+      traits::is_less_than_comparable<std::decay_t<V>>::value,
+      "ValueSelector return type must be less-than compareable.");
+
+  auto less = [value_selector, descending](const T &lhs, const T &rhs) {
+    const auto &lhs_value = value_selector(lhs);
+    const auto &rhs_value = value_selector(rhs);
+    return descending ? rhs_value < lhs_value : lhs_value < rhs_value;
+  };
+  struct Sort {
+    std::optional<Stream<T>> upstream;
+    detail::BoundedSorter<T, decltype(less)> sorter;
+  };
+  size_t morsel_size = morsel_size_;
+  std::shared_ptr<detail::StreamExecution> execution = execution_;
+  // Built in place since the sorter cannot be moved.
+  std::shared_ptr<Sort> sort(
+      new Sort{std::move(*this), {std::move(less), std::move(budget)}});
+  Stream<T> sorted(
+      [sort](size_t limit) -> std::optional<Task> {
+        if (sort->upstream) {
+          sort->upstream->consume([&sort](std::vector<T> &morsel) {
+            for (T &item : morsel) {
+              sort->sorter.push(std::move(item));
+            }
+            return true;
+          });
+          sort->upstream.reset();
+          sort->sorter.finish();
+        }
+        std::vector<T> morsel = sort->sorter.next(limit);
+        if (morsel.empty()) {
+          return std::nullopt;
+        }
+        return ready(std::move(morsel));
+      },
+      morsel_size, std::move(execution));
+  // Both only apply while nothing has been pulled, which is the case while
+  // the chain is built.
+  sorted.rewrites_.bound = [sort](size_t count) {
+    if (sort->upstream) {
+      sort->sorter.bound(count);
+    }
+  };
+  sorted.rewrites_.below = [sort](std::function<Stream<T>(Stream<T>)> op) {
+    if (sort->upstream) {
+      Stream<T> upstream = op(std::move(*sort->upstream));
+      sort->upstream.emplace(std::move(upstream));
+    }
+  };
+  return sorted;
+}
+
+template <typename T>
+Stream<T>
+Stream<T>::parallel(size_t max_in_flight, scheduler::ThreadPool &pool) {
+  execution_->max_in_flight =
+      max_in_flight > 0 ? max_in_flight : 2 * pool.size();
+  execution_->pool = &pool;
+  Stream<T> parallel(std::move(source_), morsel_size_, std::move(execution_));
+  parallel.rewrites_ = std::move(rewrites_);
+  return parallel;
+}
+
+template <typename T>
+Stream<T> Stream<T>::pipelined(size_t capacity) {
+  auto stage = std::make_shared<detail::PipelineStage<T>>(
+      std::move(source_), execution_, morsel_size_, capacity);
+  return Stream<T>(
+      [stage](size_t) -> std::optional<Task> {
+        std::optional<std::vector<T>> morsel = stage->next();
+        if (!morsel) {
+          return std::nullopt;
+        }
+        return ready(std::move(*morsel));
+      },
+      morsel_size_, execution_);
+}
+
+template <typename T>
+template <typename Selector>
+auto Stream<T>::select(Selector selector) {
+  using U = decltype(selector(std::declval<T>()));
+  Stream<U> selected = fuse<U>(
+      [selector](std::vector<T> morsel) {
+        std::vector<U> selected;
+        selected.reserve(morsel.size());
+        std::transform(
+            std::make_move_iterator(morsel.begin()),
+            std::make_move_iterator(morsel.end()),
+            std::back_inserter(selected), selector);
+        return selected;
+      },
+      /*forward_limit=*/true);
+  // Item for item, so a bound passes through.
+  selected.rewrites_.bound = std::move(rewrites_.bound);
+  return selected;
+}
+
+template <typename T>
+template <typename Selector>
+auto Stream<T>::select_many(Selector selector) {
+  using Range = decltype(selector(std::declval<T>()));
+  using U = std::decay_t<decltype(*std::begin(std::declval<Range &>()))>;
+  return fuse<U>(
+      [selector](std::vector<T> morsel) {
+        std::vector<U> selected;
+        selected.reserve(morsel.size());
+        for (T &item : morsel) {
+          // Consumed right away so sub sequences of all items are never
+          // alive at the same time.
+          Range range = selector(std::move(item));
+          std::move(
+              std::begin(range), std::end(range),
+              std::back_inserter(selected));
+        }
+        return selected;
+      },
+      /*forward_limit=*/true);
+}
+
+template <typename T>
+template <typename TimestampSelector, typename Duration>
+auto Stream<T>::session_by(TimestampSelector timestamp_selector, Duration gap) {
+  using W = Windowed<T, TimestampSelector>;
+  using D = typename W::duration_type;
+  return W(
+      std::move(*this), std::move(timestamp_selector), window::NoKey(),
+      window::Spec<D>{window::Kind::kSession, D(gap), D(gap), D{}});
+}
+
+template <typename T>
+Stream<T> Stream<T>::take(size_t value) {
+  if (rewrites_.bound) {
+    rewrites_.bound(value);
+  }
+  auto remaining = std::make_shared<size_t>(value);
+  // Upstream morsels are evaluated when pulled since their count decides
+  // whether the source is pulled again.
+  auto evaluator = std::make_shared<detail::MorselEvaluator<T>>(
+      std::move(source_), execution_);
+  return Stream<T>(
+      [evaluator, remaining](size_t limit) -> std::optional<Task> {
+        if (*remaining == 0) {
+          return std::nullopt;
+        }
+        std::optional<std::vector<T>> morsel =
+            evaluator->next(std::min(limit, *remaining));
+        if (!morsel) {
+          return std::nullopt;
+        }
+        if (morsel->size() > *remaining) {
+          morsel->erase(morsel->begin() + *remaining, morsel->end());
+        }
+        *remaining -= morsel->size();
+        return ready(std::move(*morsel));
+      },
+      morsel_size_, execution_);
+}
+
+template <typename T>
+std::vector<T> Stream<T>::to_vector() {
+  std::vector<T> items;
+  consume([&items](std::vector<T> &morsel) {
+    if (items.empty()) {
+      items = std::move(morsel);
+    } else {
+      std::move(morsel.begin(), morsel.end(), std::back_inserter(items));
+    }
+    return true;
+  });
+  return items;
+}
+
+template <typename T>
+template <typename Predicate>
+Stream<T> Stream<T>::where(Predicate predicate) {
+  if (rewrites_.below) {
+    rewrites_.below([predicate](Stream<T> upstream) {
+      return upstream.where(predicate);
+    });
+    return std::move(*this);
+  }
+  return fuse<T>(
+      [predicate](std::vector<T> morsel) {
+        morsel.erase(
+            std::remove_if(
+                morsel.begin(), morsel.end(),
+                [&predicate](const T &item) { return !predicate(item); }),
+            morsel.end());
+        return morsel;
+      },
+      // Selectivity is unknown so pull full morsels.
+      /*forward_limit=*/false);
+}
+
+template <typename T>
+Stream<T>
+Stream<T>::where_all(std::vector<std::function<bool(const T &)>> predicates) {
+  if (rewrites_.below) {
+    rewrites_.below([predicates](Stream<T> upstream) {
+      return upstream.where_all(predicates);
+    });
+    return std::move(*this);
+  }
+  auto filter =
+      std::make_shared<detail::AdaptiveFilter<T>>(std::move(predicates));
+  return fuse<T>(
+      [filter](std::vector<T> morsel) {
+        filter->apply(morsel);
+        return morsel;
+      },
+      // Selectivity is unknown so pull full morsels.
+      /*forward_limit=*/false);
+}
+
+template <typename T>
+template <typename TimestampSelector, typename Duration>
+auto Stream<T>::window_by(TimestampSelector timestamp_selector, Duration size) {
+  using W = Windowed<T, TimestampSelector>;
+  using D = typename W::duration_type;
+  return W(
+      std::move(*this), std::move(timestamp_selector), window::NoKey(),
+      window::Spec<D>{window::Kind::kTumbling, D(size), D(size), D{}});
+}
+
+template <typename T>
+typename Stream<T>::Task Stream<T>::ready(std::vector<T> morsel) {
+  // Shared since tasks must be copyable and T may not be.
+  auto shared = std::make_shared<std::vector<T>>(std::move(morsel));
+  return Task([shared]() { return std::move(*shared); });
+}
+
+template <typename T>
+template <typename U, typename MorselFn>
+Stream<U> Stream<T>::fuse(MorselFn morsel_func, bool forward_limit) {
+  size_t morsel_size = morsel_size_;
+  return Stream<U>(
+      [source = std::move(source_), morsel_func, forward_limit,
+       morsel_size](size_t limit) -> std::optional<typename Stream<U>::Task> {
+        std::optional<Task> task = source(forward_limit ? limit : morsel_size);
+        if (!task) {
+          return std::nullopt;
+        }
+        return typename Stream<U>::Task(
+            [task = std::move(*task), morsel_func]() {
+              return morsel_func(task());
+            });
+      },
+      morsel_size_, execution_);
+}
+
+template <typename T>
+template <typename Consumer>
+void Stream<T>::consume(Consumer consumer) {
+  detail::MorselEvaluator<T> evaluator(std::move(source_), execution_);
+  while (std::optional<std::vector<T>> morsel = evaluator.next(morsel_size_)) {
+    if (!consumer(*morsel)) {
+      return;
+    }
+  }
+}
+
+template <typename T, typename TimestampSelector, typename KeySelector>
+Windowed<T, TimestampSelector, KeySelector>::Windowed(
+    Stream<T> upstream, TimestampSelector timestamp_selector,
+    KeySelector key_selector, window::Spec<duration_type> spec)
+    : upstream_(std::move(upstream)),
+      timestamp_selector_(std::move(timestamp_selector)),
+      key_selector_(std::move(key_selector)), spec_(std::move(spec)) {}
+
+template <typename T, typename TimestampSelector, typename KeySelector>
+template <typename A, typename AccumulateFn>
+Stream<window::Window<
+    typename Windowed<T, TimestampSelector, KeySelector>::timestamp_type, A,
+    typename Windowed<T, TimestampSelector, KeySelector>::key_type>>
+Windowed<T, TimestampSelector, KeySelector>::aggregate(
+    A initial, AccumulateFn accumulate_func) {
+  static_assert(
+      std::is_convertible_v<
+          std::invoke_result_t<AccumulateFn &, A, const T &>, A>,
+      "AccumulateFn must return a value convertible to A.");
+  using Aggregator = window::Aggregator<
+      T, timestamp_type, key_type, A, AccumulateFn>;
+  using Result = typename Aggregator::Result;
+
+  struct State {
+    detail::MorselEvaluator<T> upstream;
+    TimestampSelector timestamp_selector;
+    KeySelector key_selector;
+    Aggregator aggregator;
+    bool exhausted;
+  };
+  size_t morsel_size = upstream_.morsel_size_;
+  std::shared_ptr<detail::StreamExecution> execution = upstream_.execution_;
+  // Built in place since the evaluator cannot be moved.
+  std::shared_ptr<State> state(new State{
+      {std::move(upstream_.source_), execution},
+      std::move(timestamp_selector_),
+      std::move(key_selector_),
+      {std::move(spec_), std::move(initial), std::move(accumulate_func)},
+      false});
+  return Stream<Result>(
+      [state, morsel_size](
+          size_t) -> std::optional<typename Stream<Result>::Task> {
+        // Windows only close as the watermark advances, so keep pulling
+        // until some do.
+        std::vector<Result> windows;
+        while (windows.empty() && !state->exhausted) {
+          std::optional<std::vector<T>> morsel =
+              state->upstream.next(morsel_size);
+          if (!morsel) {
+            state->aggregator.flush(windows);
+            state->exhausted = true;
+            break;
+          }
+          for (const T &item : *morsel) {
+            state->aggregator.add(
+                state->timestamp_selector(item), state->key_selector(item),
+                item);
+          }
+          state->aggregator.emit(windows);
+        }
+        if (windows.empty()) {
+          return std::nullopt;
+        }
+        return Stream<Result>::ready(std::move(windows));
+      },
+      morsel_size, std::move(execution));
+}
+
+template <typename T, typename TimestampSelector, typename KeySelector>
+Windowed<T, TimestampSelector, KeySelector>
+Windowed<T, TimestampSelector, KeySelector>::allowed_lateness(
+    duration_type lateness) {
+  spec_.lateness = lateness;
+  return std::move(*this);
+}
+
+template <typename T, typename TimestampSelector, typename KeySelector>
+template <typename NewKeySelector>
+Windowed<T, TimestampSelector, NewKeySelector>
+Windowed<T, TimestampSelector, KeySelector>::by(NewKeySelector key_selector) {
+  return Windowed<T, TimestampSelector, NewKeySelector>(
+      std::move(upstream_), std::move(timestamp_selector_),
+      std::move(key_selector), std::move(spec_));
+}
+
+template <typename T, typename TimestampSelector, typename KeySelector>
+Windowed<T, TimestampSelector, KeySelector>
+Windowed<T, TimestampSelector, KeySelector>::every(duration_type slide) {
+  asserts::invariant::eval(spec_.kind != window::Kind::kSession)
+      << "Session windows cannot slide.";
+  spec_.kind = window::Kind::kSliding;
+  spec_.slide = slide;
+  return std::move(*this);
+}
+
+namespace detail {
+
+inline Stream<std::string> query_lines(
+    std::shared_ptr<std::istream> input, size_t morsel_size) {
+  return Stream<std::string>(
+      [input](size_t limit) -> std::optional<Stream<std::string>::Task> {
+        std::vector<std::string> lines;
+        lines.reserve(std::min(limit, kDefaultMorselSize));
+        std::string line;
+        while (lines.size() < limit && std::getline(*input, line)) {
+          lines.push_back(std::move(line));
+        }
+        if (lines.empty()) {
+          return std::nullopt;
+        }
+        return Stream<std::string>::ready(std::move(lines));
+      },
+      morsel_size);
+}
+
+} // namespace detail
+
+template <typename Parser>
+auto query_stream(std::istream &input, Parser parser, size_t morsel_size) {
+  // Not owned, so the deleter is a no-op.
+  std::shared_ptr<std::istream> unowned(&input, [](std::istream *) {});
+  return detail::query_lines(std::move(unowned), morsel_size)
+      .select([parser](std::string line) { return parser(std::move(line)); });
+}
+
+inline Stream<std::string>
+query_lines(const std::filesystem::path &path, size_t morsel_size) {
+  auto input = std::make_shared<std::ifstream>(path);
+  asserts::invariant::eval(input->is_open())
+      << "Unable to open file " << path << ".";
+  return detail::query_lines(std::move(input), morsel_size);
+}
+
+} // namespace fcpp
+
+#endif // FCPP_STREAM_H
@@ -0,0 +1,89 @@
+#include "trace.h"
+
+#include "asserts.h"
+
+#include <atomic>
+#include <iomanip>
+#include <mutex>
+#include <vector>
+
+namespace fcpp::trace {
+
+namespace {
+
+#ifdef FCPP_TRACING
+std::atomic<bool> active{false};
+std::mutex mutex;
+std::vector<Span::Event> events;
+std::chrono::steady_clock::time_point epoch;
+std::atomic<size_t> thread_count{0};
+#endif
+
+} // namespace
+
+void start() {
+  asserts::invariant::eval(kEnabled)
+      << "Tracing must be compiled in by defining FCPP_TRACING.";
+#ifdef FCPP_TRACING
+  std::lock_guard<std::mutex> lock(mutex);
+  events.clear();
+  epoch = std::chrono::steady_clock::now();
+  active.store(true, std::memory_order_release);
+#endif
+}
+
+void stop() {
+#ifdef FCPP_TRACING
+  active.store(false, std::memory_order_release);
+#endif
+}
+
+void write(std::ostream &out) {
+  out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+#ifdef FCPP_TRACING
+  auto microseconds = [](std::chrono::nanoseconds duration) {
+    return std::chrono::duration<double, std::micro>(duration).count();
+  };
+  std::lock_guard<std::mutex> lock(mutex);
+  std::ios_base::fmtflags flags = out.flags();
+  out << std::fixed << std::setprecision(3);
+  for (size_t i = 0; i < events.size(); i++) {
+    const Span::Event &event = events[i];
+    out << (i > 0 ? "," : "") << "\n{\"name\":\"" << event.name
+        << "\",\"cat\":\"" << event.category
+        << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread
+        << ",\"ts\":" << microseconds(event.start - epoch)
+        << ",\"dur\":" << microseconds(event.duration) << ",\"args\":{";
+    for (size_t j = 0; j < event.arg_count; j++) {
+      out << (j > 0 ? "," : "") << "\"" << event.args[j].first
+          << "\":" << event.args[j].second;
+    }
+    out << "}}";
+  }
+  out.flags(flags);
+#endif
+  out << "\n]}\n";
+}
+
+namespace detail {
+
+#ifdef FCPP_TRACING
+
+bool recording() { return active.load(std::memory_order_acquire); }
+
+void record(const Span::Event &event) {
+  std::lock_guard<std::mutex> lock(mutex);
+  events.push_back(event);
+}
+
+size_t thread_id() {
+  thread_local size_t id =
+      thread_count.fetch_add(1, std::memory_order_relaxed) + 1;
+  return id;
+}
+
+#endif
+
+} // namespace detail
+
+} // namespace fcpp::trace
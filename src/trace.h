@@ -0,0 +1,234 @@
+/**
+ * @file trace.h
+ * @author Andrew Walsh (awalsh128@gmail.com)
+ * @brief Chrome trace event recording of query execution.
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * @copyright Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef FCPP_TRACE_H
+#define FCPP_TRACE_H
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <ostream>
+#include <utility>
+
+namespace fcpp::trace {
+
+/**
+ * @brief True if tracing is compiled in, by defining FCPP_TRACING (e.g.
+ * through the CMake option of the same name). It must be defined the same way
+ * for the library and everything including it.
+ *
+ * Without it, spans compile away. With it, spans cost an atomic load while
+ * not recording.
+ */
+#ifdef FCPP_TRACING
+constexpr bool kEnabled = true;
+#else
+constexpr bool kEnabled = false;
+#endif
+
+/**
+ * @brief Clears the events recorded so far and starts recording spans of
+ * every thread.
+ *
+ * Spans are recorded for each invocation of a Queryable operator, each
+ * evaluated Stream morsel and each thread pool task.
+ *
+ * @throws std::invalid_argument Tracing is not compiled in.
+ */
+void start();
+
+/**
+ * @brief Stops recording spans. Spans already open are still recorded when
+ * they end.
+ */
+void stop();
+
+/**
+ * @brief Writes the recorded events as Chrome trace event JSON, which
+ * chrome://tracing and Perfetto load.
+ *
+ * @param out Stream to write to.
+ */
+void write(std::ostream &out);
+
+/**
+ * @brief Span of time on the calling thread, recorded as a complete event if
+ * recording when it began.
+ */
+class Span final {
+public:
+  /**
+   * @brief Construct a new Span object that has not begun.
+   */
+  Span() = default;
+  /**
+   * @brief Construct a new Span object that begins right away.
+   *
+   * @param name Name of the span, which must outlive the recording.
+   * @param category Category of the span, which must outlive the recording.
+   */
+  Span(const char *name, const char *category);
+  /**
+   * @brief Ends the span if it has not ended.
+   */
+  ~Span();
+  Span(const Span &) = delete;
+  Span &operator=(const Span &) = delete;
+
+  /**
+   * @brief Begins the span.
+   *
+   * @param name Name of the span, which must outlive the recording.
+   * @param category Category of the span, which must outlive the recording.
+   */
+  void begin(const char *name, const char *category);
+
+  /**
+   * @brief Adds an argument shown with the span. Arguments past @ref kMaxArgs
+   * are dropped.
+   *
+   * @param key Name of the argument, which must outlive the recording.
+   * @param value Value of the argument, e.g. a number of items.
+   */
+  void arg(const char *key, size_t value);
+
+  /**
+   * @brief Ends the span and records it.
+   */
+  void end();
+
+  /**
+   * @brief Maximum number of arguments of a span.
+   */
+  static constexpr size_t kMaxArgs = 2;
+
+#ifdef FCPP_TRACING
+  /**
+   * @brief Recorded span.
+   */
+  struct Event {
+    const char *name;
+    const char *category;
+    size_t thread;
+    std::chrono::steady_clock::time_point start;
+    std::chrono::nanoseconds duration;
+    std::array<std::pair<const char *, size_t>, kMaxArgs> args;
+    size_t arg_count;
+  };
+
+private:
+  bool recording_ = false;
+  Event event_;
+#endif
+};
+
+namespace detail {
+
+#ifdef FCPP_TRACING
+/**
+ * @brief Indicates if spans are being recorded.
+ *
+ * @return true Recording.
+ * @return false Not recording.
+ */
+bool recording();
+
+/**
+ * @brief Records an ended span.
+ *
+ * @param event Span to record.
+ */
+void record(const Span::Event &event);
+
+/**
+ * @brief Gets a small number that identifies the calling thread in traces.
+ *
+ * @return size_t
+ */
+size_t thread_id();
+#endif
+
+} // namespace detail
+
+} // namespace fcpp::trace
+
+/******************************************************************************
+ *
+ * @brief Keep definitions separate to allow the declarations to stay clean and
+ * compact.
+ *
+ *****************************************************************************/
+
+namespace fcpp::trace {
+
+#ifdef FCPP_TRACING
+
+inline Span::Span(const char *name, const char *category) {
+  begin(name, category);
+}
+
+inline Span::~Span() { end(); }
+
+inline void Span::begin(const char *name, const char *category) {
+  recording_ = detail::recording();
+  if (recording_) {
+    event_.name = name;
+    event_.category = category;
+    event_.arg_count = 0;
+    event_.start = std::chrono::steady_clock::now();
+  }
+}
+
+inline void Span::arg(const char *key, size_t value) {
+  if (recording_ && event_.arg_count < kMaxArgs) {
+    event_.args[event_.arg_count++] = {key, value};
+  }
+}
+
+inline void Span::end() {
+  if (!recording_) {
+    return;
+  }
+  recording_ = false;
+  event_.duration = std::chrono::steady_clock::now() - event_.start;
+  event_.thread = detail::thread_id();
+  detail::record(event_);
+}
+
+#else
+
+inline Span::Span(const char *, const char *) {}
+
+inline Span::~Span() {}
+
+inline void Span::begin(const char *, const char *) {}
+
+inline void Span::arg(const char *, size_t) {}
+
+inline void Span::end() {}
+
+#endif
+
+} // namespace fcpp::trace
+
+#endif // FCPP_TRACE_H
@@ -24,6 +24,7 @@
 #ifndef FCPP_TRAITS_H
 #define FCPP_TRAITS_H
 
+#include <functional>
 #include <iterator>
 #include <type_traits>
 
@@ -57,6 +58,113 @@ struct is_less_than_comparable<
                                               (void)0)>::type>
     : std::true_type {};
 
+template <typename T, typename = void>
+struct is_hashable : std::false_type {};
+
+template <typename T>
+struct is_hashable<
+    T, typename std::enable_if<true, decltype(std::hash<T>()(
+                                                  std::declval<const T &>()),
+                                              (void)0)>::type>
+    : std::true_type {};
+
+/**
+ * @brief True if copies of T cost about as much as references to it, i.e. it
+ * is trivially copyable and no larger than two pointers.
+ */
+template <typename T>
+struct is_cheap_to_copy
+    : std::bool_constant<
+          std::is_trivially_copyable_v<T> && sizeof(T) <= 2 * sizeof(void *)> {
+};
+
+namespace detail {
+
+template <typename F> struct first_parameter {};
+
+template <typename R, typename A, typename... Args>
+struct first_parameter<R (*)(A, Args...)> {
+  typedef A type;
+};
+
+template <typename R, typename C, typename A, typename... Args>
+struct first_parameter<R (C::*)(A, Args...)> {
+  typedef A type;
+};
+
+template <typename R, typename C, typename A, typename... Args>
+struct first_parameter<R (C::*)(A, Args...) const> {
+  typedef A type;
+};
+
+template <typename R, typename C, typename A, typename... Args>
+struct first_parameter<R (C::*)(A, Args...) const noexcept> {
+  typedef A type;
+};
+
+// Parameter of a generic lambda called on a T, e.g. T for (auto x) and
+// const T & for (const auto &x).
+template <typename Selector, typename T, typename = void>
+struct generic_parameter {};
+
+template <typename Selector, typename T>
+struct generic_parameter<
+    Selector, T,
+    std::void_t<typename first_parameter<decltype(
+        &Selector::template operator()<T>)>::type>>
+    : first_parameter<decltype(&Selector::template operator()<T>)> {};
+
+// Parameter a selector is called with, if it has a single call operator.
+template <typename Selector, typename T, typename = void>
+struct selector_parameter : generic_parameter<Selector, T> {};
+
+template <typename Selector, typename T>
+struct selector_parameter<
+    Selector, T,
+    std::void_t<
+        typename first_parameter<decltype(&Selector::operator())>::type>>
+    : first_parameter<decltype(&Selector::operator())> {};
+
+template <typename R, typename A, typename T>
+struct selector_parameter<R (*)(A), T, void> {
+  typedef A type;
+};
+
+} // namespace detail
+
+/**
+ * @brief True if calling the selector on an item copies it, since it takes
+ * the item by value and the item is not cheap to copy. Selectors whose
+ * parameter cannot be told, like those with overloaded call operators, are
+ * assumed not to copy.
+ *
+ * @tparam Selector Selector function type.
+ * @tparam T Type of items the selector is called on.
+ */
+template <typename Selector, typename T, typename = void>
+struct is_copying_selector : std::false_type {};
+
+template <typename Selector, typename T>
+struct is_copying_selector<
+    Selector, T,
+    std::void_t<typename detail::selector_parameter<Selector, T>::type>>
+    : std::bool_constant<
+          !std::is_reference_v<
+              typename detail::selector_parameter<Selector, T>::type> &&
+          !is_cheap_to_copy<std::decay_t<
+              typename detail::selector_parameter<Selector, T>::type>>::value> {
+};
+
+/**
+ * @brief Type of the keys a selector produces from a const reference to an
+ * item, to be stored.
+ *
+ * @tparam Selector Selector function type.
+ * @tparam T Type of items the selector is called on.
+ */
+template <typename Selector, typename T>
+using key_of_t = std::decay_t<std::invoke_result_t<Selector &, const T &>>;
+
 } // namespace fcpp::traits
 
 #endif // FCPP_TRAITS_H
\ No newline at end of file
@@ -1,8 +1,26 @@
+#ifndef FCPP_TRANSFORMS_H
+#define FCPP_TRANSFORMS_H
+
 #include <set>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
+#include "asserts.h"
+
 namespace fcpp::transforms {
 
+template <typename T>
+T move_or_copy(T &item, bool last_use) {
+  if constexpr (std::is_copy_constructible_v<T>) {
+    return last_use ? std::move(item) : T(item);
+  } else {
+    asserts::invariant::eval(last_use)
+        << "Item of a non-copyable type cannot be used more than once.";
+    return std::move(item);
+  }
+}
+
 template <typename T>
 std::vector<T> to_vector(std::set<T> items) {
   std::vector<T> result;
@@ -13,4 +31,6 @@ std::vector<T> to_vector(std::set<T> items) {
   return result;
 }
 
-} // namespace fcpp::transforms
\ No newline at end of file
+} // namespace fcpp::transforms
+
+#endif // FCPP_TRANSFORMS_H
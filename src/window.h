@@ -0,0 +1,421 @@
+/**
+ * @file window.h
+ * @author Andrew Walsh (awalsh128@gmail.com)
+ * @brief Time windows that aggregate items of unbounded streams with bounded
+ * state.
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef FCPP_WINDOW_H
+#define FCPP_WINDOW_H
+
+#include <algorithm>
+#include <cstddef>
+#include <map>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "asserts.h"
+#include "traits.h"
+
+namespace fcpp::window {
+
+/**
+ * @brief How items are assigned to windows.
+ */
+enum class Kind {
+  /**
+   * @brief Consecutive windows of a fixed size that do not overlap.
+   */
+  kTumbling,
+  /**
+   * @brief Windows of a fixed size that start every slide and overlap when
+   * the slide is smaller than the size.
+   */
+  kSliding,
+  /**
+   * @brief Windows that extend while items keep arriving within a gap of
+   * each other.
+   */
+  kSession,
+};
+
+/**
+ * @brief Shape of the windows and how long to wait for late items.
+ *
+ * @tparam Duration Type of the difference between two timestamps.
+ */
+template <typename Duration>
+struct Spec {
+  Kind kind;
+  /**
+   * @brief Size of tumbling and sliding windows, or the gap that ends a
+   * session.
+   */
+  Duration size;
+  /**
+   * @brief Time between the starts of sliding windows.
+   */
+  Duration slide;
+  /**
+   * @brief How far behind the latest timestamp seen the watermark trails.
+   * Windows are emitted once the watermark passes their end.
+   */
+  Duration lateness;
+};
+
+/**
+ * @brief Key of windows that are not separated by key.
+ */
+struct NoKey {
+  template <typename T>
+  std::monostate operator()(const T &) const {
+    return {};
+  }
+};
+
+/**
+ * @brief Aggregated value of the items of a window.
+ *
+ * @tparam Ts Type of the timestamps.
+ * @tparam A Type of the aggregated value.
+ * @tparam K Type of the key the windows are separated by.
+ */
+template <typename Ts, typename A, typename K = std::monostate>
+struct Window {
+  K key;
+  /**
+   * @brief Timestamp of the start of the window, inclusive.
+   */
+  Ts start;
+  /**
+   * @brief Timestamp of the end of the window, exclusive.
+   */
+  Ts end;
+  A value;
+  /**
+   * @brief Number of items aggregated into the window.
+   */
+  size_t count;
+
+  bool operator==(const Window &) const = default;
+};
+
+/**
+ * @brief Gets the type of the difference between two timestamps: the
+ * duration of a std::chrono::time_point, otherwise the timestamp type itself
+ * (integers and std::chrono::duration).
+ */
+template <typename Ts, typename = void>
+struct duration_of {
+  typedef Ts type;
+};
+
+template <typename Ts>
+struct duration_of<Ts, std::void_t<typename Ts::clock>> {
+  typedef typename Ts::duration type;
+};
+
+/**
+ * @brief Assigns items to windows and aggregates them, keeping only the
+ * windows the watermark has not passed yet.
+ *
+ * @tparam T Type of items to aggregate.
+ * @tparam Ts Type of the timestamps.
+ * @tparam K Type of the key the windows are separated by.
+ * @tparam A Type of the aggregated value.
+ * @tparam AccumulateFn std::function<A(A, const T&)> Transform function type.
+ */
+template <typename T, typename Ts, typename K, typename A,
+          typename AccumulateFn>
+class Aggregator final {
+public:
+  typedef typename duration_of<Ts>::type Duration;
+  typedef Window<Ts, A, K> Result;
+
+  Aggregator(Spec<Duration> spec, A initial, AccumulateFn accumulate_func);
+
+  /**
+   * @brief Adds an item to its windows and advances the watermark. Items
+   * whose windows were already emitted are dropped.
+   *
+   * @param timestamp Timestamp of the item.
+   * @param key Key of the item.
+   * @param item Item to aggregate.
+   */
+  void add(const Ts &timestamp, const K &key, const T &item);
+
+  /**
+   * @brief Moves the windows the watermark has passed to the output, ordered
+   * by end.
+   *
+   * @param windows Output to append to.
+   */
+  void emit(std::vector<Result> &windows);
+
+  /**
+   * @brief Moves all open windows to the output, ordered by end. Used once
+   * the stream ends.
+   *
+   * @param windows Output to append to.
+   */
+  void flush(std::vector<Result> &windows);
+
+  /**
+   * @brief Gets the number of windows still open.
+   *
+   * @return size_t
+   */
+  size_t open() const;
+
+  /**
+   * @brief Gets the number of items dropped for arriving after their windows
+   * were emitted.
+   *
+   * @return size_t
+   */
+  size_t late() const;
+
+private:
+  struct Open {
+    Ts start;
+    A value;
+    size_t count;
+  };
+  struct Session {
+    Ts start;
+    Ts last;
+    A value;
+    size_t count;
+  };
+
+  Ts align(const Ts &timestamp) const;
+  void emit_until(const std::optional<Ts> &watermark,
+                  std::vector<Result> &windows);
+
+  Spec<Duration> spec_;
+  A initial_;
+  AccumulateFn accumulate_func_;
+  std::optional<Ts> latest_;
+  std::optional<Ts> emitted_;
+  size_t late_;
+  // Tumbling and sliding windows by end and key, the order they close in.
+  std::map<std::pair<Ts, K>, Open> windows_;
+  // Open session of every key.
+  std::map<K, Session> sessions_;
+  // Sessions closed by a later item of their key, waiting to be emitted.
+  std::vector<Result> closed_;
+};
+
+} // namespace fcpp::window
+
+/******************************************************************************
+ *
+ * @brief Keep definitions separate to allow the declarations to stay clean and
+ * compact.
+ *
+ *****************************************************************************/
+
+namespace fcpp::window {
+
+template <typename T, typename Ts, typename K, typename A,
+          typename AccumulateFn>
+Aggregator<T, Ts, K, A, AccumulateFn>::Aggregator(
+    Spec<Duration> spec, A initial, AccumulateFn accumulate_func)
+    : spec_(std::move(spec)), initial_(std::move(initial)),
+      accumulate_func_(std::move(accumulate_func)), late_(0) {
+  static_assert(
+      traits::is_less_than_comparable<K>::value,
+      "Key selector must produce a value that is less-than comparable.");
+  asserts::invariant::eval(spec_.size > Duration{})
+      << "Window size must be greater than zero.";
+  asserts::invariant::eval(spec_.slide > Duration{})
+      << "Window slide must be greater than zero.";
+  asserts::invariant::eval(spec_.lateness >= Duration{})
+      << "Window lateness must not be negative.";
+}
+
+template <typename T, typename Ts, typename K, typename A,
+          typename AccumulateFn>
+void Aggregator<T, Ts, K, A, AccumulateFn>::add(
+    const Ts &timestamp, const K &key, const T &item) {
+  if (!latest_ || *latest_ < timestamp) {
+    latest_ = timestamp;
+  }
+
+  if (spec_.kind == Kind::kSession) {
+    auto it = sessions_.find(key);
+    if (it == sessions_.end()) {
+      if (emitted_ && !(*emitted_ < timestamp + spec_.size)) {
+        late_++;
+        return;
+      }
+      sessions_.emplace(
+          key, Session{timestamp, timestamp,
+                       accumulate_func_(initial_, item), 1});
+      return;
+    }
+    Session &session = it->second;
+    if (session.last + spec_.size < timestamp) {
+      // Gap exceeded, so the session is over and a new one starts.
+      closed_.push_back(Result{
+          key, session.start, session.last + spec_.size,
+          std::move(session.value), session.count});
+      session = Session{
+          timestamp, timestamp, accumulate_func_(initial_, item), 1};
+    } else if (timestamp + spec_.size < session.start) {
+      // Belongs to an earlier session of the key that has already ended.
+      late_++;
+    } else {
+      session.start = std::min(session.start, timestamp);
+      session.last = std::max(session.last, timestamp);
+      session.value = accumulate_func_(std::move(session.value), item);
+      session.count++;
+    }
+    return;
+  }
+
+  bool added = false;
+  for (Ts start = align(timestamp); timestamp < start + spec_.size;
+       start = start - spec_.slide) {
+    Ts end = start + spec_.size;
+    if (emitted_ && !(*emitted_ < end)) {
+      break;
+    }
+    auto window =
+        windows_.try_emplace({end, key}, Open{start, initial_, 0}).first;
+    window->second.value =
+        accumulate_func_(std::move(window->second.value), item);
+    window->second.count++;
+    added = true;
+    if constexpr (std::is_unsigned_v<Ts>) {
+      // Earlier windows would start before zero and wrap around.
+      if (start < spec_.slide) {
+        break;
+      }
+    }
+  }
+  if (!added) {
+    late_++;
+  }
+}
+
+template <typename T, typename Ts, typename K, typename A,
+          typename AccumulateFn>
+void Aggregator<T, Ts, K, A, AccumulateFn>::emit(
+    std::vector<Result> &windows) {
+  if (!latest_) {
+    return;
+  }
+  if constexpr (std::is_unsigned_v<Ts>) {
+    // The watermark would be before zero and wrap around, so nothing can
+    // have passed it yet.
+    if (*latest_ < spec_.lateness) {
+      return;
+    }
+  }
+  emit_until(*latest_ - spec_.lateness, windows);
+}
+
+template <typename T, typename Ts, typename K, typename A,
+          typename AccumulateFn>
+void Aggregator<T, Ts, K, A, AccumulateFn>::flush(
+    std::vector<Result> &windows) {
+  emit_until(std::nullopt, windows);
+}
+
+template <typename T, typename Ts, typename K, typename A,
+          typename AccumulateFn>
+size_t Aggregator<T, Ts, K, A, AccumulateFn>::open() const {
+  return windows_.size() + sessions_.size() + closed_.size();
+}
+
+template <typename T, typename Ts, typename K, typename A,
+          typename AccumulateFn>
+size_t Aggregator<T, Ts, K, A, AccumulateFn>::late() const {
+  return late_;
+}
+
+template <typename T, typename Ts, typename K, typename A,
+          typename AccumulateFn>
+Ts Aggregator<T, Ts, K, A, AccumulateFn>::align(const Ts &timestamp) const {
+  Duration offset;
+  if constexpr (std::is_same_v<Ts, Duration>) {
+    offset = timestamp % spec_.slide;
+  } else {
+    offset = timestamp.time_since_epoch() % spec_.slide;
+  }
+  if (offset < Duration{}) {
+    offset = offset + spec_.slide;
+  }
+  return timestamp - offset;
+}
+
+template <typename T, typename Ts, typename K, typename A,
+          typename AccumulateFn>
+void Aggregator<T, Ts, K, A, AccumulateFn>::emit_until(
+    const std::optional<Ts> &watermark, std::vector<Result> &windows) {
+  auto passed = [&watermark](const Ts &end) {
+    return !watermark || !(*watermark < end);
+  };
+  size_t emitted = windows.size();
+
+  while (!windows_.empty() && passed(windows_.begin()->first.first)) {
+    auto node = windows_.extract(windows_.begin());
+    windows.push_back(Result{
+        std::move(node.key().second), node.mapped().start,
+        node.key().first, std::move(node.mapped().value),
+        node.mapped().count});
+  }
+
+  if (spec_.kind == Kind::kSession) {
+    for (Result &session : closed_) {
+      windows.push_back(std::move(session));
+    }
+    closed_.clear();
+    for (auto it = sessions_.begin(); it != sessions_.end();) {
+      Ts end = it->second.last + spec_.size;
+      if (!passed(end)) {
+        ++it;
+        continue;
+      }
+      windows.push_back(Result{
+          it->first, it->second.start, end, std::move(it->second.value),
+          it->second.count});
+      it = sessions_.erase(it);
+    }
+    std::stable_sort(
+        windows.begin() + emitted, windows.end(),
+        [](const Result &lhs, const Result &rhs) {
+          return std::tie(lhs.end, lhs.key) < std::tie(rhs.end, rhs.key);
+        });
+  }
+
+  if (watermark && (!emitted_ || *emitted_ < *watermark)) {
+    emitted_ = watermark;
+  }
+}
+
+} // namespace fcpp::window
+
+#endif // FCPP_WINDOW_H
@@ -0,0 +1,284 @@
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <malloc.h>
+#include <memory>
+#include <new>
+
+#include "profile.h"
+
+// Counts the heap allocations of the process so tests can pin how often an
+// operator allocates and benchmarks can report it. Include from a single
+// translation unit per program, since it replaces the global allocation
+// functions.
+//
+// The allocations are also recorded for profiled queries, see
+// fcpp::profile::record_allocation.
+
+namespace fcpp::tests {
+
+struct Allocations {
+  size_t count = 0;
+  size_t bytes = 0;
+
+  Allocations operator-(const Allocations &rhs) const {
+    return {count - rhs.count, bytes - rhs.bytes};
+  }
+};
+
+namespace detail {
+
+std::atomic<size_t> allocation_count{0};
+std::atomic<size_t> allocation_bytes{0};
+std::atomic<size_t> uncounted_count{0};
+std::atomic<size_t> uncounted_bytes{0};
+std::atomic<size_t> live_bytes{0};
+std::atomic<size_t> peak_bytes{0};
+
+Allocations RawAllocations() {
+  return {
+      allocation_count.load(std::memory_order_relaxed),
+      allocation_bytes.load(std::memory_order_relaxed)};
+}
+
+} // namespace detail
+
+// Allocations made by the process so far, except the ones made inside an
+// UncountedScope.
+Allocations TotalAllocations() {
+  return detail::RawAllocations() -
+         Allocations{
+             detail::uncounted_count.load(std::memory_order_relaxed),
+             detail::uncounted_bytes.load(std::memory_order_relaxed)};
+}
+
+// Counts the allocations made from its construction on.
+class AllocationCounter {
+public:
+  AllocationCounter() : start_(TotalAllocations()) {}
+
+  Allocations Get() const { return TotalAllocations() - start_; }
+  size_t Count() const { return Get().count; }
+  size_t Bytes() const { return Get().bytes; }
+  void Reset() { start_ = TotalAllocations(); }
+
+private:
+  Allocations start_;
+};
+
+// Leaves the allocations made while alive out of every count, e.g. creating
+// the input of a benchmark while its timing is paused.
+class UncountedScope {
+public:
+  UncountedScope() : start_(detail::RawAllocations()) {}
+  ~UncountedScope() {
+    Allocations uncounted = detail::RawAllocations() - start_;
+    detail::uncounted_count.fetch_add(
+        uncounted.count, std::memory_order_relaxed);
+    detail::uncounted_bytes.fetch_add(
+        uncounted.bytes, std::memory_order_relaxed);
+  }
+  UncountedScope(const UncountedScope &) = delete;
+  UncountedScope &operator=(const UncountedScope &) = delete;
+
+private:
+  Allocations start_;
+};
+
+// Heap bytes in use by the process, by usable size of the allocations.
+size_t LiveBytes() {
+  return detail::live_bytes.load(std::memory_order_relaxed);
+}
+
+// Tracks the peak heap usage above the usage at its construction or last
+// reset, e.g. how much an operator needs on top of its input.
+class HeapPeak {
+public:
+  HeapPeak() { Reset(); }
+
+  size_t Get() const {
+    size_t peak = detail::peak_bytes.load(std::memory_order_relaxed);
+    return peak > base_ ? peak - base_ : 0;
+  }
+  void Reset() {
+    base_ = LiveBytes();
+    detail::peak_bytes.store(base_, std::memory_order_relaxed);
+  }
+
+private:
+  size_t base_;
+};
+
+// Allocator that also counts into the given allocations, for containers of
+// hand-written baselines that should be counted apart from everything else.
+template <typename T>
+class CountingAllocator {
+public:
+  typedef T value_type;
+
+  explicit CountingAllocator(Allocations *allocations)
+      : allocations_(allocations) {}
+  template <typename U>
+  CountingAllocator(const CountingAllocator<U> &other)
+      : allocations_(other.allocations_) {}
+
+  T *allocate(size_t n) {
+    allocations_->count++;
+    allocations_->bytes += n * sizeof(T);
+    return std::allocator<T>().allocate(n);
+  }
+  void deallocate(T *items, size_t n) {
+    std::allocator<T>().deallocate(items, n);
+  }
+
+  template <typename U>
+  bool operator==(const CountingAllocator<U> &rhs) const {
+    return allocations_ == rhs.allocations_;
+  }
+
+private:
+  template <typename U>
+  friend class CountingAllocator;
+
+  Allocations *allocations_;
+};
+
+} // namespace fcpp::tests
+
+namespace fcpp::tests::detail {
+
+// Allocates and counts, returning nullptr if out of memory.
+void *Allocate(size_t size, size_t alignment) noexcept {
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  allocation_bytes.fetch_add(size, std::memory_order_relaxed);
+  profile::record_allocation(size);
+  // Zero sized allocations must still return a unique pointer.
+  size = size > 0 ? size : 1;
+  void *memory =
+      alignment > alignof(std::max_align_t)
+          ? std::aligned_alloc(
+                alignment, (size + alignment - 1) / alignment * alignment)
+          : std::malloc(size);
+  if (memory == nullptr) {
+    return nullptr;
+  }
+  // Usable size, since that is what delete can tell about an allocation.
+  size_t usable = malloc_usable_size(memory);
+  size_t live =
+      live_bytes.fetch_add(usable, std::memory_order_relaxed) + usable;
+  size_t peak = peak_bytes.load(std::memory_order_relaxed);
+  while (live > peak && !peak_bytes.compare_exchange_weak(
+                            peak, live, std::memory_order_relaxed)) {
+  }
+  return memory;
+}
+
+void *AllocateOrThrow(size_t size, size_t alignment) {
+  void *memory = Allocate(size, alignment);
+  if (memory == nullptr) {
+    throw std::bad_alloc();
+  }
+  return memory;
+}
+
+// Frees memory of Allocate, given the requested size if known or else 0.
+void Deallocate(void *memory, size_t size) noexcept {
+  if (memory == nullptr) {
+    return;
+  }
+  size_t usable = malloc_usable_size(memory);
+  live_bytes.fetch_sub(usable, std::memory_order_relaxed);
+  profile::record_deallocation(size > 0 ? size : usable);
+  std::free(memory);
+}
+
+} // namespace fcpp::tests::detail
+
+// Replaces every form of the global allocation functions, so that nothing
+// allocated here is freed by the default ones or the other way around.
+
+void *operator new(size_t size) {
+  return fcpp::tests::detail::AllocateOrThrow(size, 0);
+}
+
+void *operator new[](size_t size) {
+  return fcpp::tests::detail::AllocateOrThrow(size, 0);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+  return fcpp::tests::detail::Allocate(size, 0);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+  return fcpp::tests::detail::Allocate(size, 0);
+}
+
+void *operator new(size_t size, std::align_val_t alignment) {
+  return fcpp::tests::detail::AllocateOrThrow(
+      size, static_cast<size_t>(alignment));
+}
+
+void *operator new[](size_t size, std::align_val_t alignment) {
+  return fcpp::tests::detail::AllocateOrThrow(
+      size, static_cast<size_t>(alignment));
+}
+
+void *operator new(
+    size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+  return fcpp::tests::detail::Allocate(size, static_cast<size_t>(alignment));
+}
+
+void *operator new[](
+    size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+  return fcpp::tests::detail::Allocate(size, static_cast<size_t>(alignment));
+}
+
+void operator delete(void *memory) noexcept {
+  fcpp::tests::detail::Deallocate(memory, 0);
+}
+
+void operator delete[](void *memory) noexcept {
+  fcpp::tests::detail::Deallocate(memory, 0);
+}
+
+void operator delete(void *memory, size_t size) noexcept {
+  fcpp::tests::detail::Deallocate(memory, size);
+}
+
+void operator delete[](void *memory, size_t size) noexcept {
+  fcpp::tests::detail::Deallocate(memory, size);
+}
+
+void operator delete(void *memory, const std::nothrow_t &) noexcept {
+  fcpp::tests::detail::Deallocate(memory, 0);
+}
+
+void operator delete[](void *memory, const std::nothrow_t &) noexcept {
+  fcpp::tests::detail::Deallocate(memory, 0);
+}
+
+void operator delete(void *memory, std::align_val_t) noexcept {
+  fcpp::tests::detail::Deallocate(memory, 0);
+}
+
+void operator delete[](void *memory, std::align_val_t) noexcept {
+  fcpp::tests::detail::Deallocate(memory, 0);
+}
+
+void operator delete(void *memory, size_t size, std::align_val_t) noexcept {
+  fcpp::tests::detail::Deallocate(memory, size);
+}
+
+void operator delete[](void *memory, size_t size, std::align_val_t) noexcept {
+  fcpp::tests::detail::Deallocate(memory, size);
+}
+
+void operator delete(
+    void *memory, std::align_val_t, const std::nothrow_t &) noexcept {
+  fcpp::tests::detail::Deallocate(memory, 0);
+}
+
+void operator delete[](
+    void *memory, std::align_val_t, const std::nothrow_t &) noexcept {
+  fcpp::tests::detail::Deallocate(memory, 0);
+}
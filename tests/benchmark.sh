@@ -2,15 +2,35 @@
 
 set -e
 
-./benchmarks_baseline --benchmark_out=benchmarks_baseline.json --benchmark_out_format=json
+# Set FCPP_PERF_COUNTERS=1 to also report hardware counters per item.
+#
+# Repetitions give every benchmark a sample of timings to compare with, and
+# interleaving them spreads out noise from the machine.
+REPETITIONS=${REPETITIONS:-10}
+FLAGS="--benchmark_repetitions=$REPETITIONS --benchmark_enable_random_interleaving=true --benchmark_out_format=json"
+
+./benchmarks_baseline --benchmark_out=benchmarks_baseline.json $FLAGS
 sleep 5
 printf "\n"
-./benchmarks --benchmark_out=benchmarks.json --benchmark_out_format=json
+if [ -f benchmarks.json ]; then
+  mv benchmarks.json benchmarks_previous.json
+fi
+./benchmarks --benchmark_out=benchmarks.json $FLAGS
+printf "\n"
+# Pipelines compare their implementations side by side in the output.
+./benchmarks_pipelines --benchmark_out=benchmarks_pipelines.json $FLAGS
 printf "\n"
 
-mkdir ../../tests/reports
+mkdir -p ../../tests/reports
 LOG=../../tests/reports/$(date +"%Y-%m-%d-benchmark_deltas").log
-./benchmarks_report.py benchmarks.json benchmarks_baseline.json > $LOG
+PREVIOUS=""
+if [ -f benchmarks_previous.json ]; then
+  PREVIOUS="--previous benchmarks_previous.json"
+fi
+# Fails the script on significant regressions against the previous run.
+STATUS=0
+./benchmarks_report.py benchmarks.json benchmarks_baseline.json $PREVIOUS > $LOG || STATUS=$?
 
 printf "\n"
 cat $LOG
+exit $STATUS
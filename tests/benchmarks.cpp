@@ -2,31 +2,267 @@
 #include "query.h"
 
 #include <benchmark/benchmark.h>
-#include <chrono>
-#include <random>
 #include <string>
-#include <thread>
+#include <utility>
 #include <vector>
 
 namespace fcpp::benchmarks {
 
 namespace {
 
-static void BM_Select_int(benchmark::State &state) {
+template <typename T>
+static void BM_Select(benchmark::State &state) {
+  fcpp::tests::AllocationCounter allocations;
   for (auto _ : state) {
-    CREATE_ITEMS(int, state)
-    fcpp::query(std::move(items)).select([](auto x) { return x + 1; });
+    CREATE_ITEMS(T, state)
+    auto result = fcpp::query(std::move(items))
+                      .select([](const T &x) { return Key(x); })
+                      .to_vector();
+    benchmark::DoNotOptimize(result);
   }
+  ReportCounters(state, allocations);
 }
-BENCHMARK(BM_Select_int)->Range(INT_RANGE_LOW, INT_RANGE_HIGH);
+BENCHMARK_TYPES(BM_Select, "Select");
 
-static void BM_Select_string(benchmark::State &state) {
+template <typename T>
+static void BM_Where(benchmark::State &state) {
+  fcpp::tests::AllocationCounter allocations;
   for (auto _ : state) {
-    CREATE_ITEMS(std::string, state)
-    fcpp::query(std::move(items)).select([](auto x) { return x + x; });
+    CREATE_ITEMS(T, state)
+    auto result = fcpp::query(std::move(items))
+                      .where([](const T &x) { return Value(x) % 2 == 0; })
+                      .to_vector();
+    benchmark::DoNotOptimize(result);
   }
+  ReportCounters(state, allocations);
 }
-BENCHMARK(BM_Select_string)->Range(STRING_RANGE_LOW, STRING_RANGE_HIGH);
+BENCHMARK_TYPES(BM_Where, "Where");
+
+template <typename T>
+static void BM_OrderBy(benchmark::State &state) {
+  fcpp::tests::AllocationCounter allocations;
+  for (auto _ : state) {
+    CREATE_ITEMS(T, state)
+    auto result = fcpp::query(std::move(items))
+                      .order_by([](const T &x) { return Key(x); })
+                      .to_vector();
+    benchmark::DoNotOptimize(result);
+  }
+  ReportCounters(state, allocations);
+}
+BENCHMARK_TYPES_DISTRIBUTED(BM_OrderBy, "OrderBy");
+
+template <typename T>
+static void BM_Distinct(benchmark::State &state) {
+  fcpp::tests::AllocationCounter allocations;
+  for (auto _ : state) {
+    CREATE_ITEMS(T, state)
+    auto result = fcpp::query(std::move(items)).distinct().to_vector();
+    benchmark::DoNotOptimize(result);
+  }
+  ReportCounters(state, allocations);
+}
+BENCHMARK_TYPES_DISTRIBUTED(BM_Distinct, "Distinct");
+
+template <typename T>
+static void BM_GroupBy(benchmark::State &state) {
+  fcpp::tests::AllocationCounter allocations;
+  for (auto _ : state) {
+    CREATE_ITEMS(T, state)
+    auto result = fcpp::query(std::move(items))
+                      .group_by([](const T &x) { return Key(x); })
+                      .to_vector();
+    benchmark::DoNotOptimize(result);
+  }
+  ReportCounters(state, allocations);
+}
+BENCHMARK_TYPES_DISTRIBUTED(BM_GroupBy, "GroupBy");
+
+template <typename T>
+static void BM_Join(benchmark::State &state) {
+  fcpp::tests::AllocationCounter allocations;
+  for (auto _ : state) {
+    auto [items, rhs_items] = CreateJoinSides<T>(state);
+    auto key = [](const T &x) { return Key(x); };
+    auto result =
+        fcpp::query(std::move(items)).join(std::move(rhs_items), key, key);
+    auto joined = result.to_vector();
+    benchmark::DoNotOptimize(joined);
+  }
+  ReportCounters(state, allocations);
+}
+BENCHMARK_TYPES_DISTRIBUTED(BM_Join, "Join");
+
+template <typename T>
+static void BM_Difference(benchmark::State &state) {
+  fcpp::tests::AllocationCounter allocations;
+  for (auto _ : state) {
+    auto [lhs, rhs] = CreateSortedSides<T>(state);
+    auto result =
+        fcpp::query(std::move(lhs)).difference(std::move(rhs)).to_vector();
+    benchmark::DoNotOptimize(result);
+  }
+  ReportCounters(state, allocations);
+}
+BENCHMARK_TYPES_DISTRIBUTED(BM_Difference, "Difference");
+
+template <typename T>
+static void BM_Intersect(benchmark::State &state) {
+  fcpp::tests::AllocationCounter allocations;
+  for (auto _ : state) {
+    auto [lhs, rhs] = CreateSortedSides<T>(state);
+    auto result = fcpp::query(std::move(lhs)).intersect(rhs).to_vector();
+    benchmark::DoNotOptimize(result);
+  }
+  ReportCounters(state, allocations);
+}
+BENCHMARK_TYPES_DISTRIBUTED(BM_Intersect, "Intersect");
+
+template <typename T>
+static void BM_Union(benchmark::State &state) {
+  fcpp::tests::AllocationCounter allocations;
+  for (auto _ : state) {
+    auto [lhs, rhs] = CreateSortedSides<T>(state);
+    auto result =
+        fcpp::query(std::move(lhs)).unionize(std::move(rhs)).to_vector();
+    benchmark::DoNotOptimize(result);
+  }
+  ReportCounters(state, allocations);
+}
+BENCHMARK_TYPES_DISTRIBUTED(BM_Union, "Union");
+
+template <typename T>
+static void BM_Zip(benchmark::State &state) {
+  fcpp::tests::AllocationCounter allocations;
+  for (auto _ : state) {
+    CREATE_ITEMS(T, state)
+    auto rhs_items = Untimed(
+        state, [&state]() { return CreateSequence<T>(state.range(0)); });
+    auto result = fcpp::query(std::move(items))
+                      .zip(std::move(rhs_items), /*truncate=*/true)
+                      .to_vector();
+    benchmark::DoNotOptimize(result);
+  }
+  ReportCounters(state, allocations);
+}
+BENCHMARK_TYPES(BM_Zip, "Zip");
+
+template <typename T>
+static void BM_Branch(benchmark::State &state) {
+  fcpp::tests::AllocationCounter allocations;
+  for (auto _ : state) {
+    CREATE_ITEMS(T, state)
+    auto select_key = [](auto queried) {
+      return queried.select([](const T &x) { return Key(x); });
+    };
+    auto result = fcpp::query(std::move(items))
+                      .branch([](const T &x) { return Value(x) % 2 == 0; })
+                      .when_true(select_key)
+                      .when_false(select_key)
+                      .merge(/*truncate=*/true)
+                      .to_vector();
+    benchmark::DoNotOptimize(result);
+  }
+  ReportCounters(state, allocations);
+}
+BENCHMARK_TYPES(BM_Branch, "Branch");
+
+template <typename T>
+static void BM_TakeRandom(benchmark::State &state) {
+  fcpp::tests::AllocationCounter allocations;
+  for (auto _ : state) {
+    CREATE_ITEMS(T, state)
+    size_t half = items.size() / 2;
+    auto result = fcpp::query(std::move(items)).take_random(half).to_vector();
+    benchmark::DoNotOptimize(result);
+  }
+  ReportCounters(state, allocations);
+}
+BENCHMARK_TYPES(BM_TakeRandom, "TakeRandom");
+
+template <typename T>
+static void BM_Flatten(benchmark::State &state) {
+  fcpp::tests::AllocationCounter allocations;
+  for (auto _ : state) {
+    auto chunks = Untimed(state, [&state]() {
+      return Chunk(CreateSequence<T>(state.range(0)), 16);
+    });
+    auto result = fcpp::query(std::move(chunks)).flatten().to_vector();
+    benchmark::DoNotOptimize(result);
+  }
+  ReportCounters(state, allocations);
+}
+BENCHMARK_TYPES(BM_Flatten, "Flatten");
+
+template <typename T>
+static void BM_Accumulate(benchmark::State &state) {
+  fcpp::tests::AllocationCounter allocations;
+  for (auto _ : state) {
+    CREATE_ITEMS(T, state)
+    auto result = fcpp::query(std::move(items))
+                      .accumulate(int64_t{0}, [](int64_t sum, const T &x) {
+                        return sum + Value(x);
+                      });
+    benchmark::DoNotOptimize(result);
+  }
+  ReportCounters(state, allocations);
+}
+BENCHMARK_TYPES(BM_Accumulate, "Accumulate");
+
+template <typename T>
+static void BM_Max(benchmark::State &state) {
+  fcpp::tests::AllocationCounter allocations;
+  for (auto _ : state) {
+    CREATE_ITEMS(T, state)
+    auto result = fcpp::query(std::move(items)).max([](const T &x) {
+      return Value(x);
+    });
+    benchmark::DoNotOptimize(result);
+  }
+  ReportCounters(state, allocations);
+}
+BENCHMARK_TYPES(BM_Max, "Max");
+
+template <typename T>
+static void BM_ToSet(benchmark::State &state) {
+  fcpp::tests::AllocationCounter allocations;
+  for (auto _ : state) {
+    CREATE_ITEMS(T, state)
+    auto result = fcpp::query(std::move(items)).to_set();
+    benchmark::DoNotOptimize(result);
+  }
+  ReportCounters(state, allocations);
+}
+BENCHMARK_TYPES_DISTRIBUTED(BM_ToSet, "ToSet");
+
+// Never matches, so every item is visited.
+template <typename T>
+static void BM_FirstOrDefault(benchmark::State &state) {
+  fcpp::tests::AllocationCounter allocations;
+  for (auto _ : state) {
+    CREATE_ITEMS(T, state)
+    auto result =
+        fcpp::query(std::move(items)).first_or_default([](const T &x) {
+          return Value(x) < 0;
+        });
+    benchmark::DoNotOptimize(result);
+  }
+  ReportCounters(state, allocations);
+}
+BENCHMARK_TYPES(BM_FirstOrDefault, "FirstOrDefault");
+
+template <typename T>
+static void BM_ToMultiValueMap(benchmark::State &state) {
+  fcpp::tests::AllocationCounter allocations;
+  for (auto _ : state) {
+    CREATE_ITEMS(T, state)
+    auto result = fcpp::query(std::move(items))
+                      .to_multi_value_map([](const T &x) { return Key(x); });
+    benchmark::DoNotOptimize(result);
+  }
+  ReportCounters(state, allocations);
+}
+BENCHMARK_TYPES_DISTRIBUTED(BM_ToMultiValueMap, "ToMultiValueMap");
 
 } // namespace
 
@@ -1,38 +1,334 @@
 #include "benchmarks_common.h"
-#include "query.h"
 
+#include <algorithm>
 #include <benchmark/benchmark.h>
+#include <iterator>
+#include <map>
+#include <numeric>
+#include <optional>
 #include <random>
+#include <set>
 #include <string>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 namespace fcpp::benchmarks::baseline {
 
 namespace {
 
-static void BM_Select_int(benchmark::State &state) {
+template <typename T>
+using KeyType = std::decay_t<decltype(Key(std::declval<const T &>()))>;
+
+template <typename T>
+static void BM_Select(benchmark::State &state) {
+  fcpp::tests::AllocationCounter allocations;
   for (auto _ : state) {
-    CREATE_ITEMS(int, state)
-    std::vector<int> result;
+    CREATE_ITEMS(T, state)
+    std::vector<KeyType<T>> result;
     result.reserve(items.size());
     std::transform(
         items.begin(), items.end(), std::back_inserter(result),
-        [](auto x) { return x + 1; });
+        [](const T &x) { return Key(x); });
+    benchmark::DoNotOptimize(result);
   }
+  ReportCounters(state, allocations);
 }
-BENCHMARK(BM_Select_int)->Range(INT_RANGE_LOW, INT_RANGE_HIGH);
+BENCHMARK_TYPES(BM_Select, "Select");
 
-static void BM_Select_string(benchmark::State &state) {
+template <typename T>
+static void BM_Where(benchmark::State &state) {
+  fcpp::tests::AllocationCounter allocations;
   for (auto _ : state) {
-    CREATE_ITEMS(std::string, state)
-    std::vector<std::string> result;
-    result.reserve(items.size());
-    std::transform(
-        items.begin(), items.end(), std::back_inserter(result),
-        [](auto x) { return x + x; });
+    CREATE_ITEMS(T, state)
+    std::vector<T> result;
+    std::copy_if(
+        std::make_move_iterator(items.begin()),
+        std::make_move_iterator(items.end()), std::back_inserter(result),
+        [](const T &x) { return Value(x) % 2 == 0; });
+    benchmark::DoNotOptimize(result);
+  }
+  ReportCounters(state, allocations);
+}
+BENCHMARK_TYPES(BM_Where, "Where");
+
+template <typename T>
+static void BM_OrderBy(benchmark::State &state) {
+  fcpp::tests::AllocationCounter allocations;
+  for (auto _ : state) {
+    CREATE_ITEMS(T, state)
+    std::sort(items.begin(), items.end(), [](const T &lhs, const T &rhs) {
+      return Key(lhs) < Key(rhs);
+    });
+    benchmark::DoNotOptimize(items);
+  }
+  ReportCounters(state, allocations);
+}
+BENCHMARK_TYPES_DISTRIBUTED(BM_OrderBy, "OrderBy");
+
+template <typename T>
+static void BM_Distinct(benchmark::State &state) {
+  fcpp::tests::AllocationCounter allocations;
+  for (auto _ : state) {
+    CREATE_ITEMS(T, state)
+    std::sort(items.begin(), items.end());
+    items.erase(std::unique(items.begin(), items.end()), items.end());
+    benchmark::DoNotOptimize(items);
+  }
+  ReportCounters(state, allocations);
+}
+BENCHMARK_TYPES_DISTRIBUTED(BM_Distinct, "Distinct");
+
+template <typename T>
+static void BM_GroupBy(benchmark::State &state) {
+  fcpp::tests::AllocationCounter allocations;
+  for (auto _ : state) {
+    CREATE_ITEMS(T, state)
+    std::unordered_map<KeyType<T>, std::vector<T>> groups;
+    for (T &item : items) {
+      groups[Key(item)].push_back(std::move(item));
+    }
+    std::vector<std::vector<T>> result;
+    result.reserve(groups.size());
+    for (auto &[key, group] : groups) {
+      result.push_back(std::move(group));
+    }
+    benchmark::DoNotOptimize(result);
+  }
+  ReportCounters(state, allocations);
+}
+BENCHMARK_TYPES_DISTRIBUTED(BM_GroupBy, "GroupBy");
+
+template <typename T>
+static void BM_Join(benchmark::State &state) {
+  fcpp::tests::AllocationCounter allocations;
+  for (auto _ : state) {
+    auto [items, rhs_items] = CreateJoinSides<T>(state);
+    std::unordered_multimap<KeyType<T>, T> rhs_mapped;
+    for (T &rhs_item : rhs_items) {
+      KeyType<T> key = Key(rhs_item);
+      rhs_mapped.emplace(std::move(key), std::move(rhs_item));
+    }
+    std::vector<std::tuple<T, T>> result;
+    for (const T &lhs_item : items) {
+      auto [begin, end] = rhs_mapped.equal_range(Key(lhs_item));
+      for (auto it = begin; it != end; ++it) {
+        result.emplace_back(lhs_item, it->second);
+      }
+    }
+    benchmark::DoNotOptimize(result);
+  }
+  ReportCounters(state, allocations);
+}
+BENCHMARK_TYPES_DISTRIBUTED(BM_Join, "Join");
+
+template <typename T>
+static void BM_Difference(benchmark::State &state) {
+  fcpp::tests::AllocationCounter allocations;
+  for (auto _ : state) {
+    auto [lhs, rhs] = CreateSortedSides<T>(state);
+    std::vector<T> result;
+    std::set_difference(
+        std::make_move_iterator(lhs.begin()),
+        std::make_move_iterator(lhs.end()), rhs.begin(), rhs.end(),
+        std::back_inserter(result));
+    benchmark::DoNotOptimize(result);
+  }
+  ReportCounters(state, allocations);
+}
+BENCHMARK_TYPES_DISTRIBUTED(BM_Difference, "Difference");
+
+template <typename T>
+static void BM_Intersect(benchmark::State &state) {
+  fcpp::tests::AllocationCounter allocations;
+  for (auto _ : state) {
+    auto [lhs, rhs] = CreateSortedSides<T>(state);
+    std::vector<T> result;
+    std::set_intersection(
+        std::make_move_iterator(lhs.begin()),
+        std::make_move_iterator(lhs.end()), rhs.begin(), rhs.end(),
+        std::back_inserter(result));
+    benchmark::DoNotOptimize(result);
+  }
+  ReportCounters(state, allocations);
+}
+BENCHMARK_TYPES_DISTRIBUTED(BM_Intersect, "Intersect");
+
+template <typename T>
+static void BM_Union(benchmark::State &state) {
+  fcpp::tests::AllocationCounter allocations;
+  for (auto _ : state) {
+    auto [lhs, rhs] = CreateSortedSides<T>(state);
+    std::vector<T> result;
+    result.reserve(lhs.size() + rhs.size());
+    std::set_union(
+        std::make_move_iterator(lhs.begin()),
+        std::make_move_iterator(lhs.end()),
+        std::make_move_iterator(rhs.begin()),
+        std::make_move_iterator(rhs.end()), std::back_inserter(result));
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    benchmark::DoNotOptimize(result);
+  }
+  ReportCounters(state, allocations);
+}
+BENCHMARK_TYPES_DISTRIBUTED(BM_Union, "Union");
+
+template <typename T>
+static void BM_Zip(benchmark::State &state) {
+  fcpp::tests::AllocationCounter allocations;
+  for (auto _ : state) {
+    CREATE_ITEMS(T, state)
+    auto rhs_items = Untimed(
+        state, [&state]() { return CreateSequence<T>(state.range(0)); });
+    size_t size = std::min(items.size(), rhs_items.size());
+    std::vector<std::tuple<T, T>> result;
+    result.reserve(size);
+    for (size_t i = 0; i < size; i++) {
+      result.emplace_back(std::move(items[i]), std::move(rhs_items[i]));
+    }
+    benchmark::DoNotOptimize(result);
+  }
+  ReportCounters(state, allocations);
+}
+BENCHMARK_TYPES(BM_Zip, "Zip");
+
+template <typename T>
+static void BM_Branch(benchmark::State &state) {
+  fcpp::tests::AllocationCounter allocations;
+  for (auto _ : state) {
+    CREATE_ITEMS(T, state)
+    auto middle = std::partition(items.begin(), items.end(), [](const T &x) {
+      return Value(x) % 2 == 0;
+    });
+    size_t true_size = std::distance(items.begin(), middle);
+    size_t false_size = std::distance(middle, items.end());
+    size_t size = std::min(true_size, false_size);
+    std::vector<std::tuple<KeyType<T>, KeyType<T>>> result;
+    result.reserve(size);
+    for (size_t i = 0; i < size; i++) {
+      result.emplace_back(Key(items[i]), Key(items[true_size + i]));
+    }
+    benchmark::DoNotOptimize(result);
+  }
+  ReportCounters(state, allocations);
+}
+BENCHMARK_TYPES(BM_Branch, "Branch");
+
+template <typename T>
+static void BM_TakeRandom(benchmark::State &state) {
+  fcpp::tests::AllocationCounter allocations;
+  std::mt19937 generator(std::random_device{}());
+  for (auto _ : state) {
+    CREATE_ITEMS(T, state)
+    std::vector<T> result;
+    result.reserve(items.size() / 2);
+    std::sample(
+        std::make_move_iterator(items.begin()),
+        std::make_move_iterator(items.end()), std::back_inserter(result),
+        items.size() / 2, generator);
+    benchmark::DoNotOptimize(result);
+  }
+  ReportCounters(state, allocations);
+}
+BENCHMARK_TYPES(BM_TakeRandom, "TakeRandom");
+
+template <typename T>
+static void BM_Flatten(benchmark::State &state) {
+  fcpp::tests::AllocationCounter allocations;
+  for (auto _ : state) {
+    auto chunks = Untimed(state, [&state]() {
+      return Chunk(CreateSequence<T>(state.range(0)), 16);
+    });
+    size_t size = 0;
+    for (const std::vector<T> &chunk : chunks) {
+      size += chunk.size();
+    }
+    std::vector<T> result;
+    result.reserve(size);
+    for (std::vector<T> &chunk : chunks) {
+      std::move(chunk.begin(), chunk.end(), std::back_inserter(result));
+    }
+    benchmark::DoNotOptimize(result);
+  }
+  ReportCounters(state, allocations);
+}
+BENCHMARK_TYPES(BM_Flatten, "Flatten");
+
+template <typename T>
+static void BM_Accumulate(benchmark::State &state) {
+  fcpp::tests::AllocationCounter allocations;
+  for (auto _ : state) {
+    CREATE_ITEMS(T, state)
+    int64_t result = 0;
+    for (const T &item : items) {
+      result += Value(item);
+    }
+    benchmark::DoNotOptimize(result);
+  }
+  ReportCounters(state, allocations);
+}
+BENCHMARK_TYPES(BM_Accumulate, "Accumulate");
+
+template <typename T>
+static void BM_Max(benchmark::State &state) {
+  fcpp::tests::AllocationCounter allocations;
+  for (auto _ : state) {
+    CREATE_ITEMS(T, state)
+    T result = std::move(*std::max_element(
+        items.begin(), items.end(),
+        [](const T &lhs, const T &rhs) { return Value(lhs) < Value(rhs); }));
+    benchmark::DoNotOptimize(result);
+  }
+  ReportCounters(state, allocations);
+}
+BENCHMARK_TYPES(BM_Max, "Max");
+
+template <typename T>
+static void BM_ToSet(benchmark::State &state) {
+  fcpp::tests::AllocationCounter allocations;
+  for (auto _ : state) {
+    CREATE_ITEMS(T, state)
+    std::set<T> result(
+        std::make_move_iterator(items.begin()),
+        std::make_move_iterator(items.end()));
+    benchmark::DoNotOptimize(result);
+  }
+  ReportCounters(state, allocations);
+}
+BENCHMARK_TYPES_DISTRIBUTED(BM_ToSet, "ToSet");
+
+// Never matches, so every item is visited.
+template <typename T>
+static void BM_FirstOrDefault(benchmark::State &state) {
+  fcpp::tests::AllocationCounter allocations;
+  for (auto _ : state) {
+    CREATE_ITEMS(T, state)
+    auto it = std::find_if(items.begin(), items.end(), [](const T &x) {
+      return Value(x) < 0;
+    });
+    std::optional<T> result =
+        it != items.end() ? std::make_optional(std::move(*it)) : std::nullopt;
+    benchmark::DoNotOptimize(result);
+  }
+  ReportCounters(state, allocations);
+}
+BENCHMARK_TYPES(BM_FirstOrDefault, "FirstOrDefault");
+
+template <typename T>
+static void BM_ToMultiValueMap(benchmark::State &state) {
+  fcpp::tests::AllocationCounter allocations;
+  for (auto _ : state) {
+    CREATE_ITEMS(T, state)
+    std::map<KeyType<T>, std::vector<T>> result;
+    for (T &item : items) {
+      result[Key(item)].push_back(std::move(item));
+    }
+    benchmark::DoNotOptimize(result);
   }
+  ReportCounters(state, allocations);
 }
-BENCHMARK(BM_Select_string)->Range(STRING_RANGE_LOW, STRING_RANGE_HIGH);
+BENCHMARK_TYPES_DISTRIBUTED(BM_ToMultiValueMap, "ToMultiValueMap");
 
 } // namespace
 
@@ -1,47 +1,407 @@
+#include "allocations.h"
+#include "distributions.h"
+#include "perf_counters.h"
+
+#include <algorithm>
+#include <benchmark/benchmark.h>
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
+#include <memory>
 #include <stddef.h>
 #include <stdint.h>
 #include <string>
+#include <utility>
 #include <vector>
 
-#define INT_RANGE_LOW 1 << 12
-#define INT_RANGE_HIGH 1 << 30
-#define STRING_RANGE_LOW 1 << 8
-#define STRING_RANGE_HIGH 1 << 18
-
+// Creates the items of a benchmark iteration from its size and distribution
+// arguments.
 #define CREATE_ITEMS(type, state)                                              \
-  state.PauseTiming();                                                         \
-  auto items = CreateSequence<type>(state.range(0));                           \
-  state.ResumeTiming();
+  auto items = Untimed(state, [&state]() {                                     \
+    return CreateSequence<type>(state.range(0), DistributionOf(state));        \
+  });
+
+// Registers a templated benchmark for every benchmarked type, named
+// BM_<name>_<type> so the same benchmark of fluentcpp and the baseline can be
+// matched up. Its arguments are the size and the index of the distribution of
+// the items, which is uniform.
+#define BENCHMARK_TYPES(func, name)                                            \
+  BENCHMARK_TYPES_OVER(func, name, {0})
+
+// Registers a templated benchmark like BENCHMARK_TYPES, for every
+// distribution of the items.
+#define BENCHMARK_TYPES_DISTRIBUTED(func, name)                                \
+  BENCHMARK_TYPES_OVER(                                                        \
+      func, name,                                                              \
+      benchmark::CreateDenseRange(0, Distributions().size() - 1, 1))
+
+#define BENCHMARK_TYPES_OVER(func, name, distributions)                        \
+  BENCHMARK_TYPE(func, name, int, "int", distributions);                       \
+  BENCHMARK_TYPE(func, name, std::string, "string", distributions);            \
+  BENCHMARK_TYPE(                                                              \
+      func, name, FlatPrimaryObject, "FlatPrimaryObject", distributions);      \
+  BENCHMARK_TYPE(                                                              \
+      func, name, FlatDerivedObject, "FlatDerivedObject", distributions);      \
+  BENCHMARK_TYPE(                                                              \
+      func, name, FlatUserDefinedObject, "FlatUserDefinedObject",              \
+      distributions);                                                          \
+  BENCHMARK_TYPE(func, name, NestedObject, "NestedObject", distributions)
+
+#define BENCHMARK_TYPE(func, name, type, type_name, distributions)             \
+  BENCHMARK_TEMPLATE(func, type)                                               \
+      ->Name("BM_" name "_" type_name)                                         \
+      ->ArgsProduct(                                                           \
+          {benchmark::CreateRange(                                             \
+               SizeRange<type>::kLow, SizeRange<type>::kHigh, 8),              \
+           distributions})
 
 namespace fcpp::benchmarks {
 
+// Records of increasing size and indirection. Records are keyed, ordered and
+// compared by int_val.
+
+struct FlatPrimaryObject {
+  int int_val;
+  int64_t int64_val;
+  double double_val;
+  int64_t int64_val2;
+};
+
+struct FlatDerivedObject {
+  std::string string_val;
+  int int_val;
+  int64_t int64_val;
+  double double_val;
+  int64_t int64_val2;
+  std::string string_val2;
+};
+
+struct FlatUserDefinedObject {
+  std::vector<int> int_vec_val;
+  int int_val;
+  int64_t int64_val;
+  std::vector<std::string> vec_string_val;
+  double double_val;
+  FlatPrimaryObject flat_primary_val;
+  std::string string_val2;
+};
+
+struct NestedObject {
+  std::vector<FlatUserDefinedObject> flat_userdef_vec_val;
+  int int_val;
+  FlatUserDefinedObject flat_userdef_val;
+  int64_t int64_val;
+  std::vector<std::string> vec_string_val;
+  FlatDerivedObject flat_deriv_val;
+  double double_val;
+  FlatPrimaryObject flat_primary_val;
+};
+
 template <typename T>
-T CreateItem();
+concept Record = requires(const T &item) { item.int_val; };
 
-template <>
-int CreateItem() {
-  return std::rand();
+template <Record T>
+bool operator==(const T &lhs, const T &rhs) {
+  return lhs.int_val == rhs.int_val;
+}
+
+template <Record T>
+bool operator<(const T &lhs, const T &rhs) {
+  return lhs.int_val < rhs.int_val;
 }
 
+// Smallest and largest sequence sizes benchmarked, scaled down as items get
+// more expensive to create.
+template <typename T>
+struct SizeRange {
+  static constexpr int64_t kLow = 1 << 8;
+  static constexpr int64_t kHigh = 1 << 14;
+};
+
 template <>
-std::string CreateItem() {
-  int length = std::rand() % 20;
-  std::string item;
-  item.reserve(length);
-  for (int i = 0; i < length; i++) {
-    item[i] = (std::rand() % (126 - 32)) + 32;
+struct SizeRange<int> {
+  static constexpr int64_t kLow = 1 << 12;
+  static constexpr int64_t kHigh = 1 << 20;
+};
+
+template <>
+struct SizeRange<std::string> {
+  static constexpr int64_t kLow = 1 << 8;
+  static constexpr int64_t kHigh = 1 << 18;
+};
+
+template <>
+struct SizeRange<FlatPrimaryObject> {
+  static constexpr int64_t kLow = 1 << 10;
+  static constexpr int64_t kHigh = 1 << 18;
+};
+
+template <>
+struct SizeRange<NestedObject> {
+  static constexpr int64_t kLow = 1 << 6;
+  static constexpr int64_t kHigh = 1 << 12;
+};
+
+// Key items are ordered, grouped and joined by.
+inline int Key(int item) { return item; }
+inline const std::string &Key(const std::string &item) { return item; }
+template <Record T>
+int Key(const T &item) {
+  return item.int_val;
+}
+
+// Number that stands for an item in aggregates.
+inline int64_t Value(int item) { return item; }
+inline int64_t Value(const std::string &item) { return item.size(); }
+template <Record T>
+int64_t Value(const T &item) {
+  return item.int_val;
+}
+
+namespace detail {
+
+// Heap usage above the inputs, from the end of the last setup on.
+fcpp::tests::HeapPeak heap_peak;
+// Largest heap usage above the inputs of the iterations of the benchmark.
+size_t max_heap_peak = 0;
+// Heap usage left by the setups of the iterations of the benchmark, i.e. the
+// inputs along with whatever their items own.
+size_t input_bytes = 0;
+// Heap usage at the beginning of the running setup.
+size_t setup_live_bytes = 0;
+// True until the first setup of a benchmark, so whatever ran before it is
+// left out of the measurements.
+bool stale = true;
+
+// Hardware counters of the benchmark thread if the FCPP_PERF_COUNTERS
+// environment variable is set and any counter could be opened, else null.
+fcpp::tests::PerfCounters *PerfCounters() {
+  static std::unique_ptr<fcpp::tests::PerfCounters> counters =
+      []() -> std::unique_ptr<fcpp::tests::PerfCounters> {
+    if (std::getenv("FCPP_PERF_COUNTERS") == nullptr) {
+      return nullptr;
+    }
+    auto opened = std::make_unique<fcpp::tests::PerfCounters>();
+    if (opened->Empty()) {
+      std::cerr << "warning: no perf counters could be opened, "
+                << "perf_event_paranoid is "
+                << fcpp::tests::PerfEventParanoid() << ".\n";
+      return nullptr;
+    }
+    return opened;
+  }();
+  return counters.get();
+}
+
+// Stops measuring for the setup of an iteration.
+void BeginSetup() {
+  if (!stale) {
+    max_heap_peak = std::max(max_heap_peak, heap_peak.Get());
+  }
+  if (auto *counters = PerfCounters()) {
+    counters->Stop();
+    if (stale) {
+      counters->Reset();
+    }
   }
-  return item;
+  setup_live_bytes = fcpp::tests::LiveBytes();
+  stale = false;
+}
+
+// Measures from the end of the setup of an iteration on.
+void EndSetup() {
+  size_t live_bytes = fcpp::tests::LiveBytes();
+  if (live_bytes > setup_live_bytes) {
+    input_bytes += live_bytes - setup_live_bytes;
+  }
+  heap_peak.Reset();
+  if (auto *counters = PerfCounters()) {
+    counters->Start();
+  }
+}
+
+} // namespace detail
+
+// Runs the setup of a benchmark iteration without timing it or counting its
+// allocations or hardware events. The heap peak of the iteration is measured
+// above what the setup leaves allocated, i.e. the inputs.
+template <typename Fn>
+auto Untimed(benchmark::State &state, Fn create) {
+  state.PauseTiming();
+  detail::BeginSetup();
+  auto created = [&create]() {
+    fcpp::tests::UncountedScope uncounted;
+    return create();
+  }();
+  detail::EndSetup();
+  state.ResumeTiming();
+  return created;
+}
+
+// Reports the measurements of a benchmark after its last iteration:
+//  - allocations counted since the counter was created, per iteration;
+//  - largest heap usage above the inputs of an iteration, in bytes and
+//    relative to the inputs;
+//  - bytes of the inputs processed per second;
+//  - hardware events if enabled, per iteration and item of the first
+//    argument.
+void ReportCounters(
+    benchmark::State &state, const fcpp::tests::AllocationCounter &counter) {
+  fcpp::tests::Allocations allocations = counter.Get();
+  state.counters["allocs"] = benchmark::Counter(
+      allocations.count, benchmark::Counter::kAvgIterations);
+  state.counters["bytes"] = benchmark::Counter(
+      allocations.bytes, benchmark::Counter::kAvgIterations);
+  detail::BeginSetup();
+  state.counters["peak"] = benchmark::Counter(
+      detail::max_heap_peak, benchmark::Counter::kDefaults,
+      benchmark::Counter::kIs1024);
+  if (detail::input_bytes > 0 && state.iterations() > 0) {
+    state.SetBytesProcessed(detail::input_bytes);
+    double input_bytes =
+        static_cast<double>(detail::input_bytes) / state.iterations();
+    state.counters["peak_per_input"] = detail::max_heap_peak / input_bytes;
+  }
+  if (auto *counters = detail::PerfCounters()) {
+    double size = std::max<int64_t>(state.range(0), 1);
+    for (const auto &[name, count] : counters->Read()) {
+      state.counters[name] =
+          benchmark::Counter(count / size, benchmark::Counter::kAvgIterations);
+    }
+  }
+  detail::max_heap_peak = 0;
+  detail::input_bytes = 0;
+  detail::stale = true;
+}
+
+// Gets the distribution of the items of a benchmark from its second argument
+// and labels the benchmark with its name.
+const Distribution &DistributionOf(benchmark::State &state) {
+  const Distribution &distribution = Distributions().at(state.range(1));
+  state.SetLabel(distribution.name);
+  return distribution;
+}
+
+inline int64_t RandomInt64() {
+  return std::uniform_int_distribution<int64_t>()(Generator());
+}
+
+inline double RandomDouble() {
+  return std::uniform_real_distribution<double>()(Generator());
+}
+
+// Creates an item from its key. Items of the same key are equal and items
+// order like their keys.
+template <typename T>
+T CreateItem(int key);
+
+// Creates a sequence of items whose keys have the given distribution.
+template <typename T>
+std::vector<T> CreateSequence(
+    size_t size, const Distribution &distribution = Distributions().front());
+
+template <>
+int CreateItem(int key) {
+  return key;
+}
+
+template <>
+std::string CreateItem(int key) {
+  return KeyString(key);
+}
+
+template <>
+FlatPrimaryObject CreateItem(int key) {
+  return {key, RandomInt64(), RandomDouble(), RandomInt64()};
+}
+
+template <>
+FlatDerivedObject CreateItem(int key) {
+  return {KeyString(key), key,           RandomInt64(),
+          RandomDouble(), RandomInt64(), KeyString(key)};
+}
+
+template <>
+FlatUserDefinedObject CreateItem(int key) {
+  return {CreateSequence<int>(Generator()() % 8),
+          key,
+          RandomInt64(),
+          CreateSequence<std::string>(Generator()() % 4),
+          RandomDouble(),
+          CreateItem<FlatPrimaryObject>(key),
+          KeyString(key)};
+}
+
+template <>
+NestedObject CreateItem(int key) {
+  return {CreateSequence<FlatUserDefinedObject>(Generator()() % 4),
+          key,
+          CreateItem<FlatUserDefinedObject>(key),
+          RandomInt64(),
+          CreateSequence<std::string>(Generator()() % 4),
+          CreateItem<FlatDerivedObject>(key),
+          RandomDouble(),
+          CreateItem<FlatPrimaryObject>(key)};
 }
 
 template <typename T>
-std::vector<T> CreateSequence(size_t size) {
+std::vector<T> CreateSequence(const std::vector<int> &keys) {
   std::vector<T> sequence;
-  sequence.reserve(size);
-  for (int i = 0; i < size; i++) {
-    sequence.push_back(CreateItem<T>());
+  sequence.reserve(keys.size());
+  for (int key : keys) {
+    sequence.push_back(CreateItem<T>(key));
   }
   return sequence;
 }
 
-} // namespace fcpp::benchmarks
\ No newline at end of file
+template <typename T>
+std::vector<T> CreateSequence(size_t size, const Distribution &distribution) {
+  return CreateSequence<T>(CreateKeys(size, distribution));
+}
+
+// Creates the sides of a foreign key join of a benchmark iteration: the left
+// hand side has the distribution of the benchmark and the right hand side has
+// an item per distinct key of the left.
+template <typename T, typename U = T>
+std::pair<std::vector<T>, std::vector<U>> CreateJoinSides(
+    benchmark::State &state) {
+  return Untimed(state, [&state]() {
+    std::vector<int> keys = CreateKeys(state.range(0), DistributionOf(state));
+    std::vector<int> rhs_keys = keys;
+    std::sort(rhs_keys.begin(), rhs_keys.end());
+    rhs_keys.erase(
+        std::unique(rhs_keys.begin(), rhs_keys.end()), rhs_keys.end());
+    std::shuffle(rhs_keys.begin(), rhs_keys.end(), Generator());
+    return std::make_pair(
+        CreateSequence<T>(keys), CreateSequence<U>(rhs_keys));
+  });
+}
+
+// Creates the sorted sides of a set operation of a benchmark iteration, since
+// set operations take sorted sequences.
+template <typename T>
+std::pair<std::vector<T>, std::vector<T>> CreateSortedSides(
+    benchmark::State &state) {
+  return Untimed(state, [&state]() {
+    auto lhs = CreateSequence<T>(state.range(0), DistributionOf(state));
+    auto rhs = CreateSequence<T>(state.range(0), DistributionOf(state));
+    std::sort(lhs.begin(), lhs.end());
+    std::sort(rhs.begin(), rhs.end());
+    return std::make_pair(std::move(lhs), std::move(rhs));
+  });
+}
+
+// Splits a sequence into consecutive sub sequences, for flattening.
+template <typename T>
+std::vector<std::vector<T>> Chunk(std::vector<T> items, size_t chunk_size) {
+  std::vector<std::vector<T>> chunks;
+  for (size_t i = 0; i < items.size(); i += chunk_size) {
+    auto begin = std::make_move_iterator(items.begin() + i);
+    auto end = std::make_move_iterator(
+        items.begin() + std::min(i + chunk_size, items.size()));
+    chunks.emplace_back(begin, end);
+  }
+  return chunks;
+}
+
+} // namespace fcpp::benchmarks
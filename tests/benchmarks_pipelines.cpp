@@ -0,0 +1,309 @@
+#include "benchmarks_common.h"
+#include "query.h"
+
+#include <algorithm>
+#include <benchmark/benchmark.h>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <ranges>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// End to end chains of operators, each written with fluentcpp, as a hand
+// fused loop and with std::ranges views, named BM_<chain>_<implementation>.
+
+#define BENCHMARK_PIPELINE(func, distribution)                                 \
+  BENCHMARK(func)->ArgsProduct(                                                \
+      {benchmark::CreateRange(1 << 10, 1 << 18, 8),                            \
+       {DistributionIndex(distribution)}})
+
+namespace fcpp::benchmarks::pipelines {
+
+namespace {
+
+constexpr int kMiddle = std::numeric_limits<int>::max() / 2;
+
+// Top customers by order amount.
+typedef std::vector<std::pair<std::string, int64_t>> Ranking;
+constexpr size_t kTop = 10;
+
+int64_t Amount(const FlatPrimaryObject &order) {
+  return order.int64_val % 1000;
+}
+
+double Price(const FlatPrimaryObject &item) {
+  return item.double_val * (item.int64_val % 100);
+}
+
+// complex_query of examples/demo.cpp.
+
+static void BM_ComplexQuery_fcpp(benchmark::State &state) {
+  fcpp::tests::AllocationCounter allocations;
+  for (auto _ : state) {
+    CREATE_ITEMS(int, state)
+    auto result = fcpp::query(std::move(items))
+                      .where([](int x) { return x > kMiddle; })
+                      .shuffle()
+                      .skip(10)
+                      .select([](int x) { return x % 10; })
+                      .distinct()
+                      .order_by([](int x) { return x; })
+                      .branch([](int x) { return x > 5; })
+                      .when_true([](auto q) {
+                        return q.select([](int x) { return x + 100; });
+                      })
+                      .when_false([](auto q) {
+                        return q.select([](int x) { return x - 100; });
+                      })
+                      .merge()
+                      .select([](auto x) { return std::get<0>(x); })
+                      .to_vector();
+    benchmark::DoNotOptimize(result);
+  }
+  ReportCounters(state, allocations);
+}
+BENCHMARK_PIPELINE(BM_ComplexQuery_fcpp, "uniform");
+
+static void BM_ComplexQuery_fused(benchmark::State &state) {
+  fcpp::tests::AllocationCounter allocations;
+  std::mt19937 generator(std::random_device{}());
+  for (auto _ : state) {
+    CREATE_ITEMS(int, state)
+    std::vector<int> filtered;
+    for (int x : items) {
+      if (x > kMiddle) {
+        filtered.push_back(x);
+      }
+    }
+    std::shuffle(filtered.begin(), filtered.end(), generator);
+    bool seen[10] = {};
+    for (size_t i = 10; i < filtered.size(); i++) {
+      seen[filtered[i] % 10] = true;
+    }
+    std::vector<int> result;
+    size_t false_size = 0;
+    for (int x = 0; x < 10; x++) {
+      if (!seen[x]) {
+        continue;
+      }
+      if (x > 5) {
+        result.push_back(x + 100);
+      } else {
+        false_size++;
+      }
+    }
+    // Merging pads the shorter branch.
+    result.resize(std::max(result.size(), false_size));
+    benchmark::DoNotOptimize(result);
+  }
+  ReportCounters(state, allocations);
+}
+BENCHMARK_PIPELINE(BM_ComplexQuery_fused, "uniform");
+
+static void BM_ComplexQuery_ranges(benchmark::State &state) {
+  fcpp::tests::AllocationCounter allocations;
+  std::mt19937 generator(std::random_device{}());
+  for (auto _ : state) {
+    CREATE_ITEMS(int, state)
+    auto filtered_view =
+        items | std::views::filter([](int x) { return x > kMiddle; });
+    std::vector<int> filtered(filtered_view.begin(), filtered_view.end());
+    std::ranges::shuffle(filtered, generator);
+    auto digits_view = filtered | std::views::drop(10) |
+                       std::views::transform([](int x) { return x % 10; });
+    std::vector<int> digits(digits_view.begin(), digits_view.end());
+    std::ranges::sort(digits);
+    auto duplicates = std::ranges::unique(digits);
+    digits.erase(duplicates.begin(), duplicates.end());
+    auto true_view = digits |
+                     std::views::filter([](int x) { return x > 5; }) |
+                     std::views::transform([](int x) { return x + 100; });
+    auto false_view = digits |
+                      std::views::filter([](int x) { return x <= 5; }) |
+                      std::views::transform([](int x) { return x - 100; });
+    std::vector<int> result(true_view.begin(), true_view.end());
+    result.resize(std::max<size_t>(
+        result.size(), std::ranges::distance(false_view)));
+    benchmark::DoNotOptimize(result);
+  }
+  ReportCounters(state, allocations);
+}
+BENCHMARK_PIPELINE(BM_ComplexQuery_ranges, "uniform");
+
+// Filter, project and aggregate records.
+
+static void BM_FilterProjectAggregate_fcpp(benchmark::State &state) {
+  fcpp::tests::AllocationCounter allocations;
+  for (auto _ : state) {
+    CREATE_ITEMS(FlatPrimaryObject, state)
+    double result =
+        fcpp::query(std::move(items))
+            .where([](const FlatPrimaryObject &x) {
+              return x.int_val % 4 != 0;
+            })
+            .select([](const FlatPrimaryObject &x) { return Price(x); })
+            .accumulate(0.0, std::plus<double>());
+    benchmark::DoNotOptimize(result);
+  }
+  ReportCounters(state, allocations);
+}
+BENCHMARK_PIPELINE(BM_FilterProjectAggregate_fcpp, "uniform");
+
+static void BM_FilterProjectAggregate_fused(benchmark::State &state) {
+  fcpp::tests::AllocationCounter allocations;
+  for (auto _ : state) {
+    CREATE_ITEMS(FlatPrimaryObject, state)
+    double result = 0.0;
+    for (const FlatPrimaryObject &x : items) {
+      if (x.int_val % 4 != 0) {
+        result += Price(x);
+      }
+    }
+    benchmark::DoNotOptimize(result);
+  }
+  ReportCounters(state, allocations);
+}
+BENCHMARK_PIPELINE(BM_FilterProjectAggregate_fused, "uniform");
+
+static void BM_FilterProjectAggregate_ranges(benchmark::State &state) {
+  fcpp::tests::AllocationCounter allocations;
+  for (auto _ : state) {
+    CREATE_ITEMS(FlatPrimaryObject, state)
+    auto prices =
+        items |
+        std::views::filter(
+            [](const FlatPrimaryObject &x) { return x.int_val % 4 != 0; }) |
+        std::views::transform(
+            [](const FlatPrimaryObject &x) { return Price(x); });
+    double result = std::accumulate(prices.begin(), prices.end(), 0.0);
+    benchmark::DoNotOptimize(result);
+  }
+  ReportCounters(state, allocations);
+}
+BENCHMARK_PIPELINE(BM_FilterProjectAggregate_ranges, "uniform");
+
+// Join orders to their customers, total the amount per customer and rank the
+// top customers. Orders are skewed towards a few customers.
+
+static void BM_JoinGroupTopK_fcpp(benchmark::State &state) {
+  fcpp::tests::AllocationCounter allocations;
+  for (auto _ : state) {
+    auto [orders, customers] =
+        CreateJoinSides<FlatPrimaryObject, FlatDerivedObject>(state);
+    auto key = [](const auto &x) { return x.int_val; };
+    Ranking result =
+        fcpp::query(std::move(orders))
+            .join(std::move(customers), key, key)
+            .select([](auto joined) {
+              return std::make_pair(
+                  std::move(std::get<1>(joined).string_val),
+                  Amount(std::get<0>(joined)));
+            })
+            .keyed_group_by(
+                [](const std::pair<std::string, int64_t> &x) {
+                  return x.first;
+                })
+            .select([](auto group) {
+              int64_t total = 0;
+              for (const auto &[name, amount] : group.second) {
+                total += amount;
+              }
+              return std::make_pair(std::move(group.first), total);
+            })
+            .order_by(
+                [](const std::pair<std::string, int64_t> &x) {
+                  return x.second;
+                },
+                /*descending=*/true)
+            .take(kTop)
+            .to_vector();
+    benchmark::DoNotOptimize(result);
+  }
+  ReportCounters(state, allocations);
+}
+BENCHMARK_PIPELINE(BM_JoinGroupTopK_fcpp, "zipf");
+
+static void BM_JoinGroupTopK_fused(benchmark::State &state) {
+  fcpp::tests::AllocationCounter allocations;
+  for (auto _ : state) {
+    auto [orders, customers] =
+        CreateJoinSides<FlatPrimaryObject, FlatDerivedObject>(state);
+    std::unordered_map<int, const FlatDerivedObject *> customers_by_key;
+    customers_by_key.reserve(customers.size());
+    for (const FlatDerivedObject &customer : customers) {
+      customers_by_key.emplace(customer.int_val, &customer);
+    }
+    std::unordered_map<const FlatDerivedObject *, int64_t> totals;
+    for (const FlatPrimaryObject &order : orders) {
+      auto it = customers_by_key.find(order.int_val);
+      if (it != customers_by_key.end()) {
+        totals[it->second] += Amount(order);
+      }
+    }
+    Ranking result;
+    result.reserve(totals.size());
+    for (const auto &[customer, total] : totals) {
+      result.emplace_back(customer->string_val, total);
+    }
+    size_t top = std::min(kTop, result.size());
+    std::partial_sort(
+        result.begin(), result.begin() + top, result.end(),
+        [](const auto &lhs, const auto &rhs) {
+          return lhs.second > rhs.second;
+        });
+    result.resize(top);
+    benchmark::DoNotOptimize(result);
+  }
+  ReportCounters(state, allocations);
+}
+BENCHMARK_PIPELINE(BM_JoinGroupTopK_fused, "zipf");
+
+static void BM_JoinGroupTopK_ranges(benchmark::State &state) {
+  fcpp::tests::AllocationCounter allocations;
+  for (auto _ : state) {
+    auto [orders, customers] =
+        CreateJoinSides<FlatPrimaryObject, FlatDerivedObject>(state);
+    std::unordered_map<int, const FlatDerivedObject *> customers_by_key;
+    customers_by_key.reserve(customers.size());
+    for (const FlatDerivedObject &customer : customers) {
+      customers_by_key.emplace(customer.int_val, &customer);
+    }
+    auto joined =
+        orders | std::views::filter([&](const FlatPrimaryObject &order) {
+          return customers_by_key.contains(order.int_val);
+        }) |
+        std::views::transform([&](const FlatPrimaryObject &order) {
+          return std::make_pair(
+              customers_by_key.at(order.int_val), Amount(order));
+        });
+    std::unordered_map<const FlatDerivedObject *, int64_t> totals;
+    for (const auto &[customer, amount] : joined) {
+      totals[customer] += amount;
+    }
+    auto ranked_view =
+        totals | std::views::transform([](const auto &customer_total) {
+          return std::make_pair(
+              customer_total.first->string_val, customer_total.second);
+        });
+    Ranking result(ranked_view.begin(), ranked_view.end());
+    size_t top = std::min(kTop, result.size());
+    std::ranges::partial_sort(
+        result, result.begin() + top, std::ranges::greater(),
+        &std::pair<std::string, int64_t>::second);
+    result.resize(top);
+    benchmark::DoNotOptimize(result);
+  }
+  ReportCounters(state, allocations);
+}
+BENCHMARK_PIPELINE(BM_JoinGroupTopK_ranges, "zipf");
+
+} // namespace
+
+} // namespace fcpp::benchmarks::pipelines
+
+BENCHMARK_MAIN();
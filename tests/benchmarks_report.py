@@ -1,44 +1,216 @@
 #!/usr/bin/env python3
+"""Compares fluentcpp benchmarks against their baseline and a previous run.
 
+Takes the JSON output of the benchmarks and the baseline, run with
+--benchmark_repetitions so every benchmark has a sample of timings. Prints a
+CSV row per benchmark with the median and spread of each side and the delta
+of fluentcpp against the baseline with its confidence interval.
+
+Given the JSON output of a previous run of the benchmarks, it also compares
+against it and exits with a nonzero status if any benchmark got slower by
+more than the threshold with statistical significance.
+"""
+
+import argparse
 import json
+import math
+import random
+import statistics
 import sys
 
+NANOSECONDS = {'ns': 1, 'us': 1e3, 'ms': 1e6, 's': 1e9}
+BOOTSTRAP_RESAMPLES = 2000
+
+
+def delta_pct(x, reference):
+    """Percent that x is above the reference, positive if slower."""
+    return (x - reference) / reference * 100
+
 
-def delta_pct(x, y):
-    return '%.2f' % ((x - y) / y)
+def spread_pct(sample):
+    """Median absolute deviation as percent of the median."""
+    median = statistics.median(sample)
+    deviation = statistics.median(abs(x - median) for x in sample)
+    return deviation / median * 100 if median else 0.0
 
 
-def timings_from_json(filepath):
-    results = json.load(open(filepath))
+def timings_from_json(filepath, metric):
+    """Maps (function, type, distribution, size) to its sample of timings in
+    nanoseconds, one per repetition."""
+    with open(filepath) as f:
+        results = json.load(f)
     timings = dict()
 
     for benchmark in results['benchmarks']:
-        fqname = benchmark['name']
-        name_path, size = fqname.split('/')
+        if benchmark.get('run_type', 'iteration') != 'iteration':
+            continue
+        if benchmark.get('error_occurred'):
+            continue
+        name = benchmark.get('run_name', benchmark['name'])
+        # Drops arguments like repeats:N that are not benchmark arguments.
+        name_path, size, *_ = [p for p in name.split('/') if ':' not in p]
         _, fname, type = name_path.split('_')
-        timings[(fname, type, size)] = int(benchmark['cpu_time'])
+        distribution = benchmark.get('label', '')
+        timing = benchmark[metric] * NANOSECONDS[benchmark['time_unit']]
+        timings.setdefault((fname, type, distribution, size), []).append(
+            timing)
 
     return timings
 
 
-def deltas(timings_fcpp, timings_baseline):
-    lines = ["function,type,size,delta"]
+def median_delta_interval(sample, reference, confidence, rng):
+    """Bootstrap percentile interval of the delta percent of the medians."""
+    deltas = []
+    for _ in range(BOOTSTRAP_RESAMPLES):
+        resample = rng.choices(sample, k=len(sample))
+        reference_resample = rng.choices(reference, k=len(reference))
+        deltas.append(
+            delta_pct(
+                statistics.median(resample),
+                statistics.median(reference_resample)))
+    deltas.sort()
+    tail = (1 - confidence) / 2
+    low = deltas[int(tail * (len(deltas) - 1))]
+    high = deltas[int((1 - tail) * (len(deltas) - 1))]
+    return low, high
+
+
+def mann_whitney_p(sample, reference):
+    """One sided p-value of the sample being slower than the reference, from
+    the normal approximation of the Mann-Whitney U test with tie
+    correction."""
+    n, m = len(sample), len(reference)
+    ranked = sorted(
+        [(x, 0) for x in sample] + [(x, 1) for x in reference],
+        key=lambda pair: pair[0])
+
+    ranks = [0.0] * len(ranked)
+    ties = 0.0
+    i = 0
+    while i < len(ranked):
+        j = i
+        while j + 1 < len(ranked) and ranked[j + 1][0] == ranked[i][0]:
+            j += 1
+        for k in range(i, j + 1):
+            ranks[k] = (i + j) / 2 + 1
+        count = j - i + 1
+        ties += count**3 - count
+        i = j + 1
+
+    rank_sum = sum(r for r, (_, side) in zip(ranks, ranked) if side == 0)
+    u = rank_sum - n * (n + 1) / 2
+    mean = n * m / 2
+    variance = n * m / 12 * ((n + m + 1) - ties / ((n + m) * (n + m - 1)))
+    if variance <= 0:
+        return 1.0
+    z = (u - mean - 0.5) / math.sqrt(variance)
+    return 0.5 * math.erfc(z / math.sqrt(2))
+
 
-    for key, cpu_time_fcpp in timings_fcpp.items():
-        (fname, type, size) = key
-        cpu_time_baseline = timings_baseline[key]
-        delta = delta_pct(cpu_time_baseline, cpu_time_fcpp)
-        lines.append(f'{fname},{type},{size},{delta}')
+def compare(timings, reference_timings, args, rng):
+    """Compares every benchmark with a sample on both sides. Yields the key,
+    both samples, the delta percent of the medians, its interval and the
+    p-value of being slower."""
+    for key in sorted(timings):
+        if key not in reference_timings:
+            continue
+        sample = timings[key]
+        reference = reference_timings[key]
+        delta = delta_pct(
+            statistics.median(sample), statistics.median(reference))
+        if len(sample) > 1 and len(reference) > 1:
+            low, high = median_delta_interval(
+                sample, reference, args.confidence, rng)
+            p = mann_whitney_p(sample, reference)
+        else:
+            low, high, p = math.nan, math.nan, math.nan
+        yield key, sample, reference, delta, (low, high), p
 
+
+def report(title, reference_name, comparisons):
+    lines = [
+        f'# {title}',
+        'function,type,distribution,size,median_ns,spread_pct,'
+        f'{reference_name}_median_ns,{reference_name}_spread_pct,delta_pct,'
+        'ci_low_pct,ci_high_pct,p_value'
+    ]
+    for key, sample, reference, delta, (low, high), p in comparisons:
+        (fname, type, distribution, size) = key
+        lines.append(
+            f'{fname},{type},{distribution},{size},'
+            f'{statistics.median(sample):.0f},{spread_pct(sample):.2f},'
+            f'{statistics.median(reference):.0f},'
+            f'{spread_pct(reference):.2f},{delta:.2f},{low:.2f},{high:.2f},'
+            f'{p:.4f}')
     return lines
 
 
+def regressions(comparisons, args):
+    """Comparisons slower by more than the threshold, with an interval above
+    zero and significant at alpha."""
+    return [
+        comparison for comparison in comparisons
+        if comparison[3] > args.threshold and comparison[4][0] > 0 and
+        comparison[5] < args.alpha
+    ]
+
+
+def parse_args(argv):
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument('fcpp', help='JSON output of the benchmarks.')
+    parser.add_argument(
+        'baseline', help='JSON output of the baseline benchmarks.')
+    parser.add_argument(
+        '--previous', help='JSON output of a previous run of the benchmarks.')
+    parser.add_argument(
+        '--metric', default='cpu_time', choices=['cpu_time', 'real_time'])
+    parser.add_argument(
+        '--threshold', type=float, default=5.0,
+        help='Percent slower than the previous run that is a regression.')
+    parser.add_argument(
+        '--alpha', type=float, default=0.05,
+        help='Significance level of regressions.')
+    parser.add_argument(
+        '--confidence', type=float, default=0.95,
+        help='Confidence level of the intervals.')
+    return parser.parse_args(argv)
+
+
 def main(argv):
-    timings_fcpp = timings_from_json(argv[0])
-    timings_baseline = timings_from_json(argv[1])
-    lines = deltas(timings_fcpp, timings_baseline)
+    args = parse_args(argv)
+    # Fixed seed so the same results give the same report.
+    rng = random.Random(0)
+    timings_fcpp = timings_from_json(args.fcpp, args.metric)
+    timings_baseline = timings_from_json(args.baseline, args.metric)
+
+    if any(len(sample) < 2 for sample in timings_fcpp.values()):
+        print(
+            'warning: run with --benchmark_repetitions for intervals and '
+            'regression checks.',
+            file=sys.stderr)
+
+    lines = report(
+        'fluentcpp vs baseline', 'baseline',
+        compare(timings_fcpp, timings_baseline, args, rng))
+
+    regressed = []
+    if args.previous:
+        timings_previous = timings_from_json(args.previous, args.metric)
+        comparisons = list(
+            compare(timings_fcpp, timings_previous, args, rng))
+        lines.append('')
+        lines += report('fluentcpp vs previous', 'previous', comparisons)
+        regressed = regressions(comparisons, args)
+
     print('\n'.join(lines))
 
+    for key, _, _, delta, (low, high), p in regressed:
+        print(
+            f'regression: {"/".join(key)} is {delta:.2f}% slower '
+            f'({low:.2f}% to {high:.2f}%, p={p:.4f})',
+            file=sys.stderr)
+    return 1 if regressed else 0
+
 
 if __name__ == '__main__':
-    main(sys.argv[1:])
+    sys.exit(main(sys.argv[1:]))
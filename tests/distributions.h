@@ -0,0 +1,195 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Generators of benchmark keys with the distributions operators are sensitive
+// to: skew, order, duplicates and cardinality. Items are then built from the
+// keys, so equal keys make equal items and key order is item order.
+
+namespace fcpp::benchmarks {
+
+// Shared generator with a fixed seed, so runs see the same inputs.
+inline std::mt19937 &Generator() {
+  static std::mt19937 generator(128);
+  return generator;
+}
+
+struct Distribution {
+  enum class Shape {
+    // Keys drawn uniformly.
+    kUniform,
+    // Keys drawn by rank from a Zipf distribution, so a few keys are hot.
+    kZipf,
+  };
+
+  enum class Order {
+    kRandom,
+    kSorted,
+    kReverseSorted,
+    // Sorted with a percent of the keys swapped with a close neighbor.
+    kNearlySorted,
+  };
+
+  const char *name;
+  Shape shape = Shape::kUniform;
+  Order order = Order::kRandom;
+  // Fraction of the items repeating the key of another item.
+  double duplicate_ratio = 0.0;
+  // Number of distinct keys, overriding the duplicate ratio if not zero.
+  size_t cardinality = 0;
+  // Exponent of the Zipf distribution, higher is more skewed.
+  double skew = 1.0;
+
+  size_t Cardinality(size_t size) const {
+    if (cardinality > 0) {
+      return std::min(cardinality, std::max<size_t>(size, 1));
+    }
+    return std::max<size_t>(
+        1, std::llround(static_cast<double>(size) * (1.0 - duplicate_ratio)));
+  }
+};
+
+// Distributions benchmarks are parametrized over, by index.
+inline const std::vector<Distribution> &Distributions() {
+  using Shape = Distribution::Shape;
+  using Order = Distribution::Order;
+  static const std::vector<Distribution> distributions = {
+      {"uniform"},
+      {"sorted", Shape::kUniform, Order::kSorted},
+      {"reverse_sorted", Shape::kUniform, Order::kReverseSorted},
+      {"nearly_sorted", Shape::kUniform, Order::kNearlySorted},
+      {"zipf", Shape::kZipf},
+      {"duplicates_50", Shape::kUniform, Order::kRandom, 0.5},
+      {"duplicates_90", Shape::kUniform, Order::kRandom, 0.9},
+      {"cardinality_16", Shape::kUniform, Order::kRandom, 0.0, 16},
+  };
+  return distributions;
+}
+
+// Gets the index of a distribution by its name, for benchmark arguments.
+inline int64_t DistributionIndex(const std::string &name) {
+  const std::vector<Distribution> &distributions = Distributions();
+  for (size_t i = 0; i < distributions.size(); i++) {
+    if (distributions[i].name == name) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+namespace detail {
+
+// Distinct keys spread over the whole non-negative int range.
+inline std::vector<int> DistinctKeys(size_t count) {
+  std::uniform_int_distribution<int> uniform(
+      0, std::numeric_limits<int>::max());
+  std::vector<int> keys;
+  keys.reserve(count);
+  while (keys.size() < count) {
+    size_t missing = count - keys.size();
+    for (size_t i = 0; i < missing; i++) {
+      keys.push_back(uniform(Generator()));
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+  }
+  std::shuffle(keys.begin(), keys.end(), Generator());
+  return keys;
+}
+
+// Every distinct key once, then the rest drawn uniformly from them, so the
+// cardinality is exact.
+inline std::vector<int> UniformKeys(size_t size, size_t cardinality) {
+  std::vector<int> keys = DistinctKeys(std::min(size, cardinality));
+  std::uniform_int_distribution<size_t> index(0, keys.size() - 1);
+  while (keys.size() < size) {
+    keys.push_back(keys[index(Generator())]);
+  }
+  return keys;
+}
+
+// Keys are ranks, drawn by inverting the cumulative Zipf distribution.
+inline std::vector<int> ZipfKeys(size_t size, size_t cardinality, double skew) {
+  std::vector<double> cumulative(cardinality);
+  double total = 0.0;
+  for (size_t rank = 0; rank < cardinality; rank++) {
+    total += 1.0 / std::pow(static_cast<double>(rank + 1), skew);
+    cumulative[rank] = total;
+  }
+  std::uniform_real_distribution<double> uniform(0.0, total);
+  std::vector<int> keys;
+  keys.reserve(size);
+  for (size_t i = 0; i < size; i++) {
+    auto it = std::lower_bound(
+        cumulative.begin(), cumulative.end(), uniform(Generator()));
+    keys.push_back(std::min<size_t>(
+        std::distance(cumulative.begin(), it), cardinality - 1));
+  }
+  return keys;
+}
+
+} // namespace detail
+
+// Creates the keys of a sequence with the given distribution.
+inline std::vector<int> CreateKeys(
+    size_t size, const Distribution &distribution) {
+  if (size == 0) {
+    return {};
+  }
+  size_t cardinality = distribution.Cardinality(size);
+  std::vector<int> keys =
+      distribution.shape == Distribution::Shape::kZipf
+          ? detail::ZipfKeys(size, cardinality, distribution.skew)
+          : detail::UniformKeys(size, cardinality);
+
+  switch (distribution.order) {
+  case Distribution::Order::kRandom:
+    std::shuffle(keys.begin(), keys.end(), Generator());
+    break;
+  case Distribution::Order::kSorted:
+    std::sort(keys.begin(), keys.end());
+    break;
+  case Distribution::Order::kReverseSorted:
+    std::sort(keys.begin(), keys.end(), std::greater<int>());
+    break;
+  case Distribution::Order::kNearlySorted: {
+    std::sort(keys.begin(), keys.end());
+    std::uniform_int_distribution<size_t> index(0, size - 1);
+    std::uniform_int_distribution<size_t> offset(1, 8);
+    for (size_t i = 0; i < std::max<size_t>(size / 100, 1); i++) {
+      size_t from = index(Generator());
+      size_t to = std::min(from + offset(Generator()), size - 1);
+      std::swap(keys[from], keys[to]);
+    }
+    break;
+  }
+  }
+  return keys;
+}
+
+// Creates a string of 5 to 20 printable characters that is a function of the
+// key and orders like it.
+inline std::string KeyString(int key) {
+  constexpr int kFirst = 32;
+  constexpr int kBase = 126 - kFirst;
+  // Fixed width most significant digit first, so strings order like keys.
+  std::string item(5, ' ');
+  unsigned int digits = key;
+  for (int i = 4; i >= 0; i--) {
+    item[i] = kFirst + digits % kBase;
+    digits /= kBase;
+  }
+  std::minstd_rand suffix(key + 1);
+  item.resize(item.size() + suffix() % 16);
+  for (size_t i = 5; i < item.size(); i++) {
+    item[i] = kFirst + suffix() % kBase;
+  }
+  return item;
+}
+
+} // namespace fcpp::benchmarks
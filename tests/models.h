@@ -1,3 +1,4 @@
+#include <cstddef>
 #include <memory>
 #include <ostream>
 
@@ -102,4 +103,31 @@ std::ostream &operator<<(std::ostream &os, const NonCopyObject &item) {
   return os;
 }
 
+// Counts the copies and moves made of any instance, to check that operators
+// move and how often.
+struct CopyCountedObject : Object {
+  static inline size_t copies = 0;
+  static inline size_t moves = 0;
+
+  CopyCountedObject(int value) : Object(value) {}
+
+  CopyCountedObject(CopyCountedObject &&other) noexcept
+      : Object(other.value) {
+    moves++;
+  }
+  CopyCountedObject &operator=(CopyCountedObject &&other) noexcept {
+    value = other.value;
+    moves++;
+    return *this;
+  }
+  CopyCountedObject(const CopyCountedObject &other) : Object(other) {
+    copies++;
+  }
+  CopyCountedObject &operator=(const CopyCountedObject &other) {
+    value = other.value;
+    copies++;
+    return *this;
+  }
+};
+
 } // namespace fcpp::tests::models
\ No newline at end of file
@@ -0,0 +1,163 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <linux/perf_event.h>
+#include <string>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+// Hardware performance counters through Linux perf_event_open, so benchmarks
+// can tell if they are bound by cache misses, branch misses or instructions.
+//
+// The calling thread is counted along with the threads it starts after the
+// counters are opened. Threads that were already running, e.g. of a pool
+// started earlier, are not.
+//
+// Only user space is counted, which an unprivileged user may do if
+// /proc/sys/kernel/perf_event_paranoid is 2 or lower. Counters the kernel or
+// hardware does not allow, e.g. in virtual machines without a PMU, are left
+// out.
+
+namespace fcpp::tests {
+
+struct PerfEvent {
+  const char *name;
+  uint32_t type;
+  uint64_t config;
+};
+
+namespace detail {
+
+constexpr uint64_t CacheEvent(
+    perf_hw_cache_id cache, perf_hw_cache_op_id op,
+    perf_hw_cache_op_result_id result) {
+  return cache | (op << 8) | (result << 16);
+}
+
+} // namespace detail
+
+// Events counted by default.
+inline const std::vector<PerfEvent> &DefaultPerfEvents() {
+  static const std::vector<PerfEvent> events = {
+      {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+      {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+      {"L1d_misses", PERF_TYPE_HW_CACHE,
+       detail::CacheEvent(
+           PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ,
+           PERF_COUNT_HW_CACHE_RESULT_MISS)},
+      {"LLC_misses", PERF_TYPE_HW_CACHE,
+       detail::CacheEvent(
+           PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_READ,
+           PERF_COUNT_HW_CACHE_RESULT_MISS)},
+      {"branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+      {"dTLB_misses", PERF_TYPE_HW_CACHE,
+       detail::CacheEvent(
+           PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ,
+           PERF_COUNT_HW_CACHE_RESULT_MISS)},
+  };
+  return events;
+}
+
+// Counts the events that could be opened while started, from creation or the
+// last reset on.
+class PerfCounters {
+public:
+  explicit PerfCounters(
+      const std::vector<PerfEvent> &events = DefaultPerfEvents()) {
+    for (const PerfEvent &event : events) {
+      perf_event_attr attr;
+      std::memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = event.type;
+      attr.config = event.config;
+      attr.disabled = 1;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.inherit = 1;
+      // Times let counts be scaled up if the kernel multiplexed them.
+      attr.read_format =
+          PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+      int fd = syscall(
+          SYS_perf_event_open, &attr, /*pid=*/0, /*cpu=*/-1, /*group_fd=*/-1,
+          /*flags=*/0);
+      if (fd >= 0) {
+        counters_.push_back({event.name, fd, {}});
+      }
+    }
+  }
+  ~PerfCounters() {
+    for (const Counter &counter : counters_) {
+      close(counter.fd);
+    }
+  }
+  PerfCounters(const PerfCounters &) = delete;
+  PerfCounters &operator=(const PerfCounters &) = delete;
+
+  // True if no event could be opened.
+  bool Empty() const { return counters_.empty(); }
+
+  void Start() { Control(PERF_EVENT_IOC_ENABLE); }
+  void Stop() { Control(PERF_EVENT_IOC_DISABLE); }
+  // Counts from now on. The kernel's reset leaves the enabled and running
+  // times alone, so the raw values are kept and subtracted instead.
+  void Reset() {
+    for (Counter &counter : counters_) {
+      uint64_t values[3];
+      if (ReadRaw(counter, values)) {
+        std::copy(values, values + 3, counter.base);
+      }
+    }
+  }
+
+  // Gets the name and count of every opened event.
+  std::vector<std::pair<const char *, double>> Read() const {
+    std::vector<std::pair<const char *, double>> counts;
+    for (const Counter &counter : counters_) {
+      uint64_t values[3];
+      if (!ReadRaw(counter, values)) {
+        continue;
+      }
+      uint64_t value = values[0] - counter.base[0];
+      uint64_t enabled = values[1] - counter.base[1];
+      uint64_t running = values[2] - counter.base[2];
+      counts.emplace_back(
+          counter.name,
+          running > 0 ? static_cast<double>(value) * enabled / running : 0.0);
+    }
+    return counts;
+  }
+
+private:
+  struct Counter {
+    const char *name;
+    int fd;
+    // Value, enabled and running time at the last reset.
+    uint64_t base[3];
+  };
+
+  // Reads the value, enabled and running time of the counter.
+  static bool ReadRaw(const Counter &counter, uint64_t (&values)[3]) {
+    return read(counter.fd, values, sizeof(values)) == sizeof(values);
+  }
+
+  void Control(unsigned long request) {
+    for (const Counter &counter : counters_) {
+      ioctl(counter.fd, request, 0);
+    }
+  }
+
+  std::vector<Counter> counters_;
+};
+
+// Explains why counters may not open, for warnings.
+inline std::string PerfEventParanoid() {
+  std::ifstream paranoid("/proc/sys/kernel/perf_event_paranoid");
+  std::string level;
+  return paranoid >> level ? level : "unknown";
+}
+
+} // namespace fcpp::tests
@@ -1,8 +1,30 @@
+#include "allocations.h"
+#include "generator.h"
+#include "incremental.h"
+#include "mapped.h"
 #include "models.h"
 #include "query.h"
-
+#include "scheduler.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <numeric>
+#include <optional>
 #include <ostream>
+#include <set>
+#include <span>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
 
 #include <catch2/catch_template_test_macros.hpp>
 #include <catch2/catch_test_macros.hpp>
@@ -14,6 +36,7 @@ namespace fcpp::tests {
 
 namespace {
 
+using ::fcpp::tests::models::CopyCountedObject;
 using ::fcpp::tests::models::NonCopyObject;
 using ::fcpp::tests::models::Object;
 
@@ -36,6 +59,17 @@ Create(std::initializer_list<std::initializer_list<int>> items) {
   return std::move(created);
 }
 
+template <typename T> fcpp::Generator<T> Naturals() {
+  for (int i = 0;; i++) {
+    co_yield T(i);
+  }
+}
+
+fcpp::Generator<int> Throwing() {
+  co_yield 1;
+  throw std::invalid_argument("generator");
+}
+
 TEMPLATE_TEST_CASE("accumulate", "", Object, NonCopyObject) {
   REQUIRE(fcpp::query(Create<TestType>({1, 2, 3}))
               .accumulate(1, [](auto x, auto &y) { return x + y.value; }) == 7);
@@ -66,6 +100,64 @@ TEMPLATE_TEST_CASE("all true", "", Object, NonCopyObject) {
   }));
 }
 
+TEMPLATE_TEST_CASE("allocations", "", Object, NonCopyObject) {
+  auto items = Create<TestType>({1, 2, 3, 4});
+  AllocationCounter counter;
+  auto selected = fcpp::query(std::move(items)).select([](auto &&x) {
+    return TestType(x.value + 1);
+  });
+  REQUIRE(counter.Count() == 1);
+  REQUIRE(counter.Bytes() == 4 * sizeof(TestType));
+
+  counter.Reset();
+  auto reordered =
+      selected.reverse().order_by([](const auto &x) { return x.value; });
+  REQUIRE(counter.Count() == 0);
+
+  counter.Reset();
+  auto taken = reordered.take(2);
+  REQUIRE(counter.Count() == 1);
+  REQUIRE(taken.to_vector() == Create<TestType>({2, 3}));
+}
+
+TEST_CASE("allocations counting allocator") {
+  Allocations counted;
+  AllocationCounter counter;
+  std::vector<int, CountingAllocator<int>> items{
+      CountingAllocator<int>(&counted)};
+  items.reserve(8);
+  items.push_back(1);
+  REQUIRE(counted.count == 1);
+  REQUIRE(counted.bytes == 8 * sizeof(int));
+  REQUIRE(counter.Count() == 1);
+
+  {
+    UncountedScope uncounted;
+    auto ignored = std::make_unique<int>(1);
+  }
+  REQUIRE(counter.Count() == 1);
+}
+
+TEST_CASE("allocations every form") {
+  struct alignas(64) Aligned {
+    char bytes[64];
+  };
+  size_t live = LiveBytes();
+  AllocationCounter counter;
+  HeapPeak peak;
+  {
+    auto aligned = std::make_unique<Aligned>();
+    REQUIRE(reinterpret_cast<uintptr_t>(aligned.get()) % 64 == 0);
+    auto array = std::make_unique<int[]>(16);
+    std::unique_ptr<int> nothrow(new (std::nothrow) int(1));
+    REQUIRE(counter.Count() == 3);
+    REQUIRE(counter.Bytes() == sizeof(Aligned) + 16 * sizeof(int) +
+                                   sizeof(int));
+    REQUIRE(peak.Get() >= counter.Bytes());
+  }
+  REQUIRE(LiveBytes() == live);
+}
+
 TEMPLATE_TEST_CASE("any empty", "", Object, NonCopyObject) {
   REQUIRE_FALSE(fcpp::query(std::vector<TestType>()).any([](const auto &x) {
     return true;
@@ -101,6 +193,99 @@ TEMPLATE_TEST_CASE("branch", "", Object, NonCopyObject) {
               .to_vector() == expected);
 }
 
+TEMPLATE_TEST_CASE("branch concurrent", "", Object, NonCopyObject) {
+  std::vector<std::tuple<TestType, TestType>> expected;
+  expected.push_back({3, 0});
+  expected.push_back({5, 2});
+
+  REQUIRE(fcpp::query(Create<TestType>({1, 2, 3, 4}))
+              .branch([](const auto &x) { return x % 2 == 0; }, true)
+              .when_true([](auto q) {
+                return q.select([](auto &&x) { return TestType(x.value + 1); });
+              })
+              .when_false([](auto q) {
+                return q.select([](auto &&x) { return TestType(x.value - 1); });
+              })
+              .merge()
+              .to_vector() == expected);
+}
+
+TEST_CASE("branch concurrent nested") {
+  auto merged =
+      fcpp::query(std::vector<int>({1, 2, 3, 4}))
+          .branch(EXPR(x, x > 2), true)
+          .when_true([](auto q) {
+            return q.branch(EXPR(x, x > 3), true)
+                .when_true([](auto q) { return q; })
+                .when_false([](auto q) { return q; })
+                .merge(/*truncate=*/true)
+                .select(EXPR(x, std::get<0>(x) + std::get<1>(x)));
+          })
+          .when_false([](auto q) { return q.select(EXPR(x, x * 10)); })
+          .merge(/*truncate=*/true)
+          .to_vector();
+
+  REQUIRE(merged == std::vector<std::tuple<int, int>>({{7, 10}}));
+}
+
+TEST_CASE("branch concurrent exception") {
+  auto merge = fcpp::query(std::vector<int>({1, 2}))
+                   .branch(EXPR(x, x > 1), true)
+                   .when_true([](auto q) {
+                     throw std::runtime_error("when_true");
+                     return q;
+                   })
+                   .when_false([](auto q) { return q; });
+
+  REQUIRE_THROWS_AS(merge.merge(), std::runtime_error);
+}
+
+TEST_CASE("branch concurrent overlap") {
+  // Each block waits for the other to start, which only happens in time if
+  // they run at the same time.
+  std::promise<void> true_started;
+  std::promise<void> false_started;
+  std::future<void> true_awaited = false_started.get_future();
+  std::future<void> false_awaited = true_started.get_future();
+  auto meet = [](std::promise<void> &started, std::future<void> &other) {
+    started.set_value();
+    return other.wait_for(std::chrono::seconds(10)) ==
+           std::future_status::ready;
+  };
+  bool true_met = false;
+  bool false_met = false;
+  fcpp::query(std::vector<int>({1, 2}))
+      .branch(EXPR(x, x > 1), true)
+      .when_true([&](auto q) {
+        true_met = meet(true_started, true_awaited);
+        return q;
+      })
+      .when_false([&](auto q) {
+        false_met = meet(false_started, false_awaited);
+        return q;
+      })
+      .merge();
+
+  REQUIRE(true_met);
+  REQUIRE(false_met);
+}
+
+TEST_CASE("branch concurrent unmerged") {
+  std::atomic<bool> finished = false;
+  {
+    auto when_false = fcpp::query(std::vector<int>({1, 2}))
+                          .branch(EXPR(x, x > 1), true)
+                          .when_true([&finished](auto q) {
+                            std::this_thread::sleep_for(
+                                std::chrono::milliseconds(50));
+                            finished = true;
+                            return q;
+                          });
+  }
+  // Dropping the branch waited for its block rather than leaving it running.
+  REQUIRE(finished);
+}
+
 TEMPLATE_TEST_CASE("difference empty", "", Object, NonCopyObject) {
   REQUIRE(fcpp::query(std::vector<TestType>())
               .difference(std::vector<TestType>())
@@ -125,6 +310,14 @@ TEMPLATE_TEST_CASE("difference some", "", Object, NonCopyObject) {
               .to_vector() == Create<TestType>({1}));
 }
 
+TEST_CASE("difference uneven") {
+  std::vector<int> rhs_items(1000);
+  std::iota(rhs_items.begin(), rhs_items.end(), 0);
+  REQUIRE(fcpp::query(std::vector<int>({-1, 3, 3, 500, 2000}))
+              .difference(std::move(rhs_items))
+              .to_vector() == std::vector<int>({-1, 3, 2000}));
+}
+
 TEMPLATE_TEST_CASE("distinct multiple", "", Object, NonCopyObject) {
   REQUIRE(fcpp::query(Create<TestType>({1, 2})).distinct().to_vector() ==
           Create<TestType>({1, 2}));
@@ -135,6 +328,14 @@ TEMPLATE_TEST_CASE("distinct multiset", "", Object, NonCopyObject) {
           Create<TestType>({1}));
 }
 
+TEMPLATE_TEST_CASE("distinct redundant", "", Object, NonCopyObject) {
+  REQUIRE(fcpp::query(Create<TestType>({3, 1, 2, 1, 3}))
+              .distinct()
+              .where([](const TestType &x) { return x.value != 2; })
+              .distinct()
+              .to_vector() == Create<TestType>({1, 3}));
+}
+
 TEMPLATE_TEST_CASE("first_or_default default", "", Object, NonCopyObject) {
   REQUIRE(
       fcpp::query(Create<TestType>({1, 1})).first_or_default([](const auto &x) {
@@ -161,6 +362,17 @@ TEMPLATE_TEST_CASE("flatten empty", "", Object, NonCopyObject) {
       std::vector<TestType>());
 }
 
+TEST_CASE("flatten parallel") {
+  std::vector<std::vector<int>> items;
+  std::vector<int> expected;
+  for (int i = 0; i < 1 << 12; i++) {
+    items.push_back(std::vector<int>(i % 97, i));
+    expected.insert(expected.end(), i % 97, i);
+  }
+
+  REQUIRE(fcpp::query(std::move(items)).flatten().to_vector() == expected);
+}
+
 TEMPLATE_TEST_CASE("group_by multiple", "", Object, NonCopyObject) {
   REQUIRE(fcpp::query(Create<TestType>({1, 2, 3, 4}))
               .group_by([](const auto &x) { return x % 2 == 0; })
@@ -173,6 +385,65 @@ TEMPLATE_TEST_CASE("group_by single", "", Object, NonCopyObject) {
               .to_vector() == Create<TestType>({{1, 2, 3, 4}}));
 }
 
+TEMPLATE_TEST_CASE("incremental", "", Object, NonCopyObject) {
+  auto evens = fcpp::incremental::query<TestType>()
+                   .where([](const TestType &x) { return x.value % 2 == 0; })
+                   .to_vector();
+  auto sums = fcpp::incremental::query<TestType>()
+                  .select([](TestType &&x) { return x.value; })
+                  .keyed_accumulate(
+                      [](const int &x) { return x % 3; }, 0,
+                      [](int sum, const int &x) { return sum + x; });
+  evens.append(Create<TestType>({1, 2, 3, 4}));
+  sums.append(Create<TestType>({1, 2, 3, 4}));
+  REQUIRE(evens.result() == Create<TestType>({2, 4}));
+  REQUIRE(sums.result() == std::map<int, int>({{0, 3}, {1, 5}, {2, 2}}));
+
+  evens.append(Create<TestType>({5, 6}));
+  sums.append(Create<TestType>({5, 6}));
+  REQUIRE(evens.result() == Create<TestType>({2, 4, 6}));
+  REQUIRE(sums.result() == std::map<int, int>({{0, 9}, {1, 5}, {2, 7}}));
+  REQUIRE(evens.appended() == 6);
+}
+
+TEST_CASE("incremental distinct group top_k") {
+  auto distinct = fcpp::incremental::query<int>().distinct();
+  auto groups = fcpp::incremental::query<int>().keyed_group_by(
+      [](const int &x) { return x % 2; });
+  auto top = fcpp::incremental::query<int>().top_k(
+      3, [](const int &x) { return x; }, /*descending=*/true);
+  auto total = fcpp::incremental::query<int>().accumulate(
+      0, [](int sum, const int &x) { return sum + x; });
+  for (auto batch : {std::vector<int>({5, 1, 5}), std::vector<int>({7, 2}),
+                     std::vector<int>({1, 3})}) {
+    distinct.append(batch);
+    groups.append(batch);
+    top.append(batch);
+    total.append(batch);
+  }
+  REQUIRE(distinct.result() == std::set<int>({1, 2, 3, 5, 7}));
+  REQUIRE(
+      groups.result() ==
+      std::map<int, std::vector<int>>({{0, {2}}, {1, {5, 1, 5, 7, 1, 3}}}));
+  REQUIRE(top.result() == std::vector<int>({7, 5, 5}));
+  REQUIRE(total.result() == 24);
+}
+
+TEST_CASE("incremental top_k move only") {
+  auto top = fcpp::incremental::query<std::unique_ptr<int>>().top_k(
+      2, [](const std::unique_ptr<int> &x) { return *x; });
+  for (int batch = 0; batch < 3; batch++) {
+    std::vector<std::unique_ptr<int>> items;
+    for (int value : {9 - batch, 4 - batch, 6}) {
+      items.push_back(std::make_unique<int>(value));
+    }
+    top.append(std::move(items));
+  }
+  REQUIRE(top.result().size() == 2);
+  REQUIRE(*top.result()[0] == 2);
+  REQUIRE(*top.result()[1] == 3);
+}
+
 TEMPLATE_TEST_CASE("intersect", "", Object, NonCopyObject) {
   REQUIRE(fcpp::query(Create<TestType>({1, 2}))
               .intersect(Create<TestType>({2, 3}))
@@ -191,6 +462,16 @@ TEMPLATE_TEST_CASE("intersect none", "", Object, NonCopyObject) {
               .to_vector() == Create<TestType>({2}));
 }
 
+TEST_CASE("intersect uneven") {
+  std::vector<int> large(1000);
+  std::iota(large.begin(), large.end(), 0);
+  std::vector<int> small = {-1, 3, 3, 500, 2000};
+  REQUIRE(fcpp::query(std::vector<int>(small)).intersect(large).to_vector() ==
+          std::vector<int>({3, 500}));
+  REQUIRE(fcpp::query(std::move(large)).intersect(small).to_vector() ==
+          std::vector<int>({3, 500}));
+}
+
 TEMPLATE_TEST_CASE("join", "", Object, NonCopyObject) {
   std::vector<std::tuple<TestType, TestType>> expected;
   expected.push_back({1, 3});
@@ -204,6 +485,58 @@ TEMPLATE_TEST_CASE("join", "", Object, NonCopyObject) {
               .to_vector() == expected);
 }
 
+TEMPLATE_TEST_CASE("join multiple", "", Object, NonCopyObject) {
+  auto join = []() {
+    return fcpp::query(Create<TestType>({1, 3, 2}))
+        .join(
+            Create<TestType>({5, 7, 4}),
+            [](const auto &x) { return x % 2 == 0; },
+            [](const auto &x) { return x % 2 == 0; });
+  };
+
+  if constexpr (std::is_copy_constructible_v<TestType>) {
+    std::vector<std::tuple<TestType, TestType>> expected;
+    expected.push_back({1, 5});
+    expected.push_back({1, 7});
+    expected.push_back({3, 5});
+    expected.push_back({3, 7});
+    expected.push_back({2, 4});
+    REQUIRE(join().to_vector() == expected);
+  } else {
+    REQUIRE_THROWS_AS(join(), std::invalid_argument);
+  }
+}
+
+TEST_CASE("join large right hand side") {
+  std::vector<int> lhs(50);
+  std::iota(lhs.begin(), lhs.end(), 0);
+  std::vector<int> rhs(40);
+  std::iota(rhs.begin(), rhs.end(), 100);
+  auto key = [](const int &x) { return x % 20; };
+
+  // Large enough on both sides to be grouped into a tree.
+  std::vector<std::tuple<int, int>> expected;
+  for (int x : lhs) {
+    for (int y : rhs) {
+      if (key(x) == key(y)) {
+        expected.push_back({x, y});
+      }
+    }
+  }
+  REQUIRE(fcpp::query(std::vector<int>(lhs)).join(rhs, key, key).to_vector() ==
+          expected);
+}
+
+TEMPLATE_TEST_CASE("join second", "", Object, NonCopyObject) {
+  REQUIRE(fcpp::query(Create<TestType>({1, 2}))
+              .join(
+                  Create<TestType>({2, 3}),
+                  [](const auto &x) { return x % 2 == 0; },
+                  [](const auto &x) { return x % 2 == 0; })
+              .second()
+              .to_vector() == Create<TestType>({3, 2}));
+}
+
 TEMPLATE_TEST_CASE("keyed_group_by", "", Object, NonCopyObject) {
   std::vector<std::pair<bool, std::vector<TestType>>> expected;
   expected.push_back(std::make_pair(false, Create<TestType>({1})));
@@ -215,6 +548,725 @@ TEMPLATE_TEST_CASE("keyed_group_by", "", Object, NonCopyObject) {
       }) == expected);
 }
 
+TEST_CASE("keyed selectors copy free") {
+  static_assert(traits::is_copying_selector<
+                decltype([](std::string x) { return x; }), std::string>::value);
+  static_assert(traits::is_copying_selector<
+                decltype([](auto x) { return x; }), std::string>::value);
+  static_assert(!traits::is_copying_selector<
+                decltype([](const auto &x) { return x; }), std::string>::value);
+  static_assert(!traits::is_copying_selector<
+                decltype([](int x) { return x; }), int>::value);
+
+  auto key = [](const CopyCountedObject &x) { return x.value % 2; };
+  auto items = [] {
+    std::vector<CopyCountedObject> items;
+    for (int i = 0; i < 100; i++) {
+      items.emplace_back(i);
+    }
+    return items;
+  };
+  CopyCountedObject::copies = 0;
+  REQUIRE(fcpp::query(items()).group_by(key).size() == 2);
+  REQUIRE(fcpp::query(items()).keyed_group_by(key).size() == 2);
+  REQUIRE(fcpp::query(items()).to_multi_value_map(key).size() == 2);
+  REQUIRE(fcpp::query(items()).to_single_value_map(key).size() == 2);
+  REQUIRE(fcpp::query(items()).order_by(key).size() == 100);
+  REQUIRE(CopyCountedObject::copies == 0);
+  // Groups are sized up front, so each item is moved into one exactly once.
+  auto moves = [&items](auto group) {
+    auto query = fcpp::query(items());
+    CopyCountedObject::moves = 0;
+    group(query);
+    return CopyCountedObject::moves;
+  };
+  REQUIRE(moves([&key](auto &q) { q.group_by(key); }) == 100);
+  REQUIRE(moves([&key](auto &q) { q.keyed_group_by(key); }) == 100);
+  REQUIRE(moves([&key](auto &q) { q.to_multi_value_map(key); }) == 100);
+}
+
+TEST_CASE("join different types") {
+  REQUIRE(fcpp::query(std::vector<int>({1, 3}))
+              .join(
+                  std::vector<std::string>({"a", "abc"}),
+                  [](const int &x) { return x; },
+                  [](const std::string &x) {
+                    return static_cast<int>(x.size());
+                  })
+              .second()
+              .to_vector() == std::vector<std::string>({"a", "abc"}));
+}
+
+TEMPLATE_TEST_CASE("merge select", "", Object, NonCopyObject) {
+  REQUIRE(fcpp::query(Create<TestType>({1, 2, 3}))
+              .branch([](const auto &x) { return x > 1; })
+              .when_true([](auto q) { return q; })
+              .when_false([](auto q) { return q; })
+              .merge()
+              .select([](auto x) { return std::get<0>(std::move(x)); })
+              .to_vector() == Create<TestType>({2, 3}));
+}
+
+TEMPLATE_TEST_CASE("lazy accumulate", "", Object, NonCopyObject) {
+  REQUIRE(fcpp::query(Create<TestType>({1, 2, 3}))
+              .lazy(/*morsel_size=*/2)
+              .accumulate(1, [](auto x, auto &&y) { return x + y.value; }) ==
+          7);
+}
+
+TEMPLATE_TEST_CASE("lazy any", "", Object, NonCopyObject) {
+  REQUIRE(fcpp::query(Create<TestType>({1, 2, 3}))
+              .lazy(/*morsel_size=*/2)
+              .any([](const auto &x) { return x == 3; }));
+  REQUIRE_FALSE(fcpp::query(Create<TestType>({1, 2, 3}))
+                    .lazy(/*morsel_size=*/2)
+                    .any([](const auto &x) { return x == 4; }));
+}
+
+TEMPLATE_TEST_CASE("lazy first_or_default", "", Object, NonCopyObject) {
+  REQUIRE(fcpp::query(Create<TestType>({1, 2, 3}))
+              .lazy(/*morsel_size=*/2)
+              .first_or_default([](const auto &x) { return x > 1; }) == 2);
+  REQUIRE(fcpp::query(Create<TestType>({1, 2, 3}))
+              .lazy(/*morsel_size=*/2)
+              .first_or_default([](const auto &x) { return x > 3; }) ==
+          std::nullopt);
+}
+
+TEMPLATE_TEST_CASE("lazy flatten", "", Object, NonCopyObject) {
+  REQUIRE(
+      fcpp::query(Create<TestType>({{1, 2}, {}, {3}, {4, 5}}))
+          .lazy(/*morsel_size=*/2)
+          .flatten()
+          .to_vector() == Create<TestType>({1, 2, 3, 4, 5}));
+}
+
+TEMPLATE_TEST_CASE("lazy keyed_group_by budget", "", Object, NonCopyObject) {
+  auto dir = std::filesystem::temp_directory_path() / "fcpp_group_by";
+  std::filesystem::create_directories(dir);
+  std::vector<TestType> items;
+  for (int i = 0; i < 5000; i++) {
+    items.emplace_back(i);
+  }
+
+  // Small enough for the partitions to be partitioned again.
+  auto groups = fcpp::query(std::move(items))
+                    .lazy(/*morsel_size=*/100)
+                    .keyed_group_by(
+                        [](const TestType &x) { return x.value % 500; },
+                        {/*bytes=*/256, dir})
+                    .to_vector();
+  REQUIRE(groups.size() == 500);
+  REQUIRE(std::all_of(groups.begin(), groups.end(), [](const auto &group) {
+    if (group.second.size() != 10) {
+      return false;
+    }
+    for (size_t i = 0; i < group.second.size(); i++) {
+      if (group.second[i].value != group.first + (int)i * 500) {
+        return false;
+      }
+    }
+    return true;
+  }));
+  REQUIRE(std::filesystem::is_empty(dir));
+  std::filesystem::remove(dir);
+}
+
+TEST_CASE("lazy group_by budget in memory") {
+  REQUIRE(fcpp::query(std::vector<std::string>({"bb", "a", "cc", "d"}))
+              .group_by(
+                  [](const std::string &x) { return x.size(); },
+                  {/*bytes=*/1 << 20})
+              .to_vector() ==
+          std::vector<std::vector<std::string>>({{"a", "d"}, {"bb", "cc"}}));
+}
+
+TEMPLATE_TEST_CASE("lazy join budget", "", Object, NonCopyObject) {
+  auto dir = std::filesystem::temp_directory_path() / "fcpp_join";
+  std::filesystem::create_directories(dir);
+  std::vector<TestType> lhs;
+  std::vector<int> rhs;
+  for (int i = 0; i < 2000; i++) {
+    lhs.emplace_back(i);
+    rhs.push_back(i * 2);
+  }
+
+  // Small enough for the partitions to be partitioned again.
+  auto joined = fcpp::query(std::move(lhs))
+                    .lazy(/*morsel_size=*/100)
+                    .join(
+                        fcpp::query(std::move(rhs)).lazy(),
+                        [](const TestType &x) { return x.value; },
+                        [](const int &x) { return x; },
+                        {/*bytes=*/64, dir})
+                    .to_vector();
+  REQUIRE(std::all_of(joined.begin(), joined.end(), [](const auto &pair) {
+    return pair.first.value == pair.second;
+  }));
+  std::vector<int> joined_values;
+  for (const auto &pair : joined) {
+    joined_values.push_back(pair.second);
+  }
+  std::sort(joined_values.begin(), joined_values.end());
+  std::vector<int> expected;
+  for (int i = 0; i < 2000; i += 2) {
+    expected.push_back(i);
+  }
+  REQUIRE(joined_values == expected);
+  REQUIRE(std::filesystem::is_empty(dir));
+  std::filesystem::remove(dir);
+}
+
+TEST_CASE("lazy join budget in memory") {
+  auto joined = fcpp::query(std::vector<int>({3, 1, 2, 1}))
+                    .join(
+                        std::vector<std::string>({"a", "bb", "cc", "ddd"}),
+                        [](const int &x) { return x; },
+                        [](const std::string &x) { return (int)x.size(); },
+                        {/*bytes=*/1 << 20})
+                    .to_vector();
+  REQUIRE(
+      joined == std::vector<std::pair<int, std::string>>(
+                    {{3, "ddd"}, {1, "a"}, {2, "bb"}, {2, "cc"}, {1, "a"}}));
+}
+
+TEMPLATE_TEST_CASE("lazy order_by budget", "", Object, NonCopyObject) {
+  auto dir = std::filesystem::temp_directory_path() / "fcpp_order_by";
+  std::filesystem::create_directories(dir);
+  std::vector<int> values;
+  for (int i = 0; i < 10000; i++) {
+    values.push_back((i * 7919) % 10007);
+  }
+  std::vector<TestType> items;
+  for (int value : values) {
+    items.emplace_back(value);
+  }
+  std::sort(values.begin(), values.end(), std::greater<int>());
+
+  // Small enough to spill more runs than a single merge pass takes.
+  auto ordered = fcpp::query(std::move(items))
+                     .lazy(/*morsel_size=*/100)
+                     .order_by(
+                         [](const TestType &x) { return x.value; },
+                         /*descending=*/true, {64 * sizeof(TestType), dir})
+                     .to_vector();
+  REQUIRE(std::equal(
+      ordered.begin(), ordered.end(), values.begin(), values.end(),
+      [](const TestType &x, int y) { return x.value == y; }));
+  REQUIRE(std::filesystem::is_empty(dir));
+
+  REQUIRE(fcpp::query(Create<TestType>({3, 1, 2}))
+              .order_by(
+                  [](const TestType &x) { return x.value; },
+                  /*descending=*/false, {1 << 20, dir})
+              .to_vector() == Create<TestType>({1, 2, 3}));
+  std::filesystem::remove(dir);
+}
+
+TEST_CASE("lazy order_by budget string") {
+  std::vector<std::string> items = {"pear", "", "apple", "fig", "banana"};
+  REQUIRE(fcpp::query(std::vector<std::string>(items))
+              .lazy(/*morsel_size=*/2)
+              .order_by(
+                  [](const std::string &x) { return x; },
+                  /*descending=*/false, {/*bytes=*/1})
+              .to_vector() ==
+          std::vector<std::string>({"", "apple", "banana", "fig", "pear"}));
+}
+
+TEST_CASE("lazy order_by take") {
+  std::vector<std::pair<int, int>> items;
+  for (int i = 0; i < 1000; i++) {
+    items.emplace_back((i * 7919) % 101, i);
+  }
+  auto first = [](const std::pair<int, int> &x) { return x.first; };
+  auto second = [](const std::pair<int, int> &x) { return x.second; };
+  auto by_first = [](const auto &lhs, const auto &rhs) {
+    return lhs.first < rhs.first;
+  };
+  std::vector<std::pair<int, int>> sorted(items);
+  std::stable_sort(sorted.begin(), sorted.end(), by_first);
+
+  // Kept as top-k through the select, where equal items keep their order.
+  std::vector<int> expected;
+  for (size_t i = 0; i < 10; i++) {
+    expected.push_back(sorted[i].second);
+  }
+  REQUIRE(fcpp::query(std::vector<std::pair<int, int>>(items))
+              .lazy(/*morsel_size=*/64)
+              .order_by(first, /*descending=*/false, {1 << 20})
+              .select(second)
+              .take(10)
+              .to_vector() == expected);
+
+  // Filtered before sorting.
+  expected.clear();
+  for (const auto &item : sorted) {
+    if (item.second % 2 == 0 && expected.size() < 5) {
+      expected.push_back(item.second);
+    }
+  }
+  REQUIRE(fcpp::query(std::vector<std::pair<int, int>>(items))
+              .lazy(/*morsel_size=*/64)
+              .order_by(first, /*descending=*/false, {1 << 20})
+              .where([](const auto &x) { return x.second % 2 == 0; })
+              .take(5)
+              .select(second)
+              .to_vector() == expected);
+
+  // Too large for the budget, so sorted externally instead.
+  auto ordered = fcpp::query(std::vector<std::pair<int, int>>(items))
+                     .lazy(/*morsel_size=*/64)
+                     .order_by(first, /*descending=*/false, {/*bytes=*/64})
+                     .take(100)
+                     .to_vector();
+  // Equal items keep their order either way.
+  REQUIRE(ordered == std::vector<std::pair<int, int>>(
+                         sorted.begin(), sorted.begin() + 100));
+}
+
+TEST_CASE("lazy parallel") {
+  std::vector<int> items(100000);
+  std::iota(items.begin(), items.end(), 0);
+  std::vector<int> expected;
+  for (int item : items) {
+    if (item % 3 == 0) {
+      expected.push_back(item * 2);
+    }
+  }
+  REQUIRE(fcpp::query(std::vector<int>(items))
+              .lazy(/*morsel_size=*/1000)
+              .where([](const int &x) { return x % 3 == 0; })
+              .parallel()
+              .select([](int x) { return x * 2; })
+              .to_vector() == expected);
+  REQUIRE(fcpp::query(std::vector<int>(items))
+              .lazy(/*morsel_size=*/1000)
+              .parallel(/*max_in_flight=*/3)
+              .take(2500)
+              .accumulate(0L, [](long x, int y) { return x + y; }) ==
+          2500L * 2499 / 2);
+  REQUIRE(fcpp::query(std::vector<int>(items))
+              .lazy(/*morsel_size=*/1000)
+              .parallel()
+              .first_or_default([](const int &x) { return x > 1500; }) == 1501);
+}
+
+TEST_CASE("lazy parallel exception") {
+  REQUIRE_THROWS_AS(
+      fcpp::query(std::vector<int>(10000))
+          .lazy(/*morsel_size=*/100)
+          .parallel()
+          .select([](int x) -> int {
+            throw std::invalid_argument("select");
+            return x;
+          })
+          .to_vector(),
+      std::invalid_argument);
+}
+
+TEST_CASE("lazy pipelined") {
+  std::mutex mutex;
+  std::set<std::thread::id> threads;
+  auto record = [&]() {
+    std::lock_guard<std::mutex> lock(mutex);
+    threads.insert(std::this_thread::get_id());
+  };
+  std::vector<int> items(1000);
+  std::iota(items.begin(), items.end(), 0);
+
+  auto piped = fcpp::query(items)
+                   .lazy(/*morsel_size=*/16)
+                   .select([&](int x) {
+                     record();
+                     return x * 2;
+                   })
+                   .pipelined(/*capacity=*/2)
+                   .where([&](const int &x) {
+                     record();
+                     return x % 3 == 0;
+                   })
+                   .pipelined(/*capacity=*/1)
+                   .to_vector();
+  std::vector<int> expected;
+  for (int x : items) {
+    if (x * 2 % 3 == 0) {
+      expected.push_back(x * 2);
+    }
+  }
+  REQUIRE(piped == expected);
+  REQUIRE(threads.size() == 2);
+  REQUIRE(threads.count(std::this_thread::get_id()) == 0);
+
+  REQUIRE(fcpp::query(Naturals<int>(), /*morsel_size=*/4)
+              .pipelined(/*capacity=*/1)
+              .take(6)
+              .to_vector() == std::vector<int>({0, 1, 2, 3, 4, 5}));
+  REQUIRE_THROWS_AS(
+      fcpp::query(Throwing()).pipelined().to_vector(), std::invalid_argument);
+}
+
+TEMPLATE_TEST_CASE("lazy select_many", "", Object, NonCopyObject) {
+  REQUIRE(fcpp::query(Create<TestType>({1, 2, 3}))
+              .lazy(/*morsel_size=*/2)
+              .select_many([](auto &&x) {
+                return Create<TestType>({x.value, x.value * 10});
+              })
+              .to_vector() == Create<TestType>({1, 10, 2, 20, 3, 30}));
+}
+
+TEMPLATE_TEST_CASE("lazy take", "", Object, NonCopyObject) {
+  REQUIRE(fcpp::query(Create<TestType>({1, 2, 3, 4, 5}))
+              .lazy(/*morsel_size=*/2)
+              .where([](const auto &x) { return x.value != 2; })
+              .take(3)
+              .to_vector() == Create<TestType>({1, 3, 4}));
+  REQUIRE(fcpp::query(Create<TestType>({1, 2}))
+              .lazy()
+              .take(5)
+              .to_vector() == Create<TestType>({1, 2}));
+}
+
+TEMPLATE_TEST_CASE("lazy where select", "", Object, NonCopyObject) {
+  REQUIRE(fcpp::query(Create<TestType>({1, 2, 3, 4, 5}))
+              .lazy(/*morsel_size=*/2)
+              .where([](const auto &x) { return x.value % 2 == 1; })
+              .select([](auto &&x) { return TestType(x.value * 2); })
+              .to_vector() == Create<TestType>({2, 6, 10}));
+}
+
+TEST_CASE("lazy where reorder") {
+  std::vector<int> items(100000);
+  std::iota(items.begin(), items.end(), 0);
+  std::vector<int> expected;
+  for (int item : items) {
+    if (item % 10 == 0 && item % 3 == 0) {
+      expected.push_back(item);
+    }
+  }
+
+  // Written with the predicate that drops nothing first.
+  std::atomic<size_t> unselective_calls = 0;
+  auto filtered = fcpp::query(std::vector<int>(items))
+                      .lazy(/*morsel_size=*/1000)
+                      .where_all({
+                          [&unselective_calls](int x) {
+                            unselective_calls++;
+                            return x >= 0;
+                          },
+                          [](int x) { return x % 10 == 0; },
+                          [](int x) { return x % 3 == 0; },
+                      })
+                      .to_vector();
+  REQUIRE(filtered == expected);
+  // Only evaluated on every item of the first morsels.
+  REQUIRE(unselective_calls < items.size() / 5);
+
+  REQUIRE(fcpp::query(std::vector<int>(items))
+              .lazy(/*morsel_size=*/1000)
+              .where_all({
+                  [](int x) { return x % 3 == 0; },
+                  [](int x) { return x % 10 == 0; },
+              })
+              .parallel()
+              .to_vector() == expected);
+}
+
+TEST_CASE("lazy where guard chain") {
+  std::vector<std::optional<int>> optionals;
+  std::vector<int> values(10000);
+  std::iota(values.begin(), values.end(), 0);
+  std::vector<const int *> pointers;
+  for (const int &value : values) {
+    optionals.push_back(value % 3 == 0 ? std::nullopt
+                                       : std::optional<int>(value));
+    pointers.push_back(value % 4 == 0 ? nullptr : &value);
+  }
+  // Each second predicate is only defined on the items its guard passes.
+  auto has_value = [](const std::optional<int> &x) { return x.has_value(); };
+  auto is_large = [](const std::optional<int> &x) { return x.value() > 3; };
+  auto not_null = [](const int *x) { return x != nullptr; };
+  auto is_even = [](const int *x) { return *x % 2 == 0; };
+
+  auto expected_optionals = fcpp::query(std::vector(optionals))
+                                .where(has_value)
+                                .where(is_large)
+                                .to_vector();
+  auto expected_pointers = fcpp::query(std::vector(pointers))
+                               .where(not_null)
+                               .where(is_even)
+                               .to_vector();
+  for (bool parallel : {false, true}) {
+    auto evaluate = [parallel](auto items, auto guard, auto predicate) {
+      auto stream = fcpp::query(std::move(items))
+                        .lazy(/*morsel_size=*/100)
+                        .where(guard)
+                        .where(predicate);
+      return parallel ? stream.parallel().to_vector() : stream.to_vector();
+    };
+    std::vector<std::optional<int>> actual_optionals;
+    std::vector<const int *> actual_pointers;
+    REQUIRE_NOTHROW(actual_optionals =
+                        evaluate(optionals, has_value, is_large));
+    REQUIRE_NOTHROW(actual_pointers = evaluate(pointers, not_null, is_even));
+    REQUIRE(actual_optionals == expected_optionals);
+    REQUIRE(actual_pointers == expected_pointers);
+  }
+}
+
+TEST_CASE("lazy window_by") {
+  using Window = fcpp::window::Window<int, int>;
+  auto sum = [](int total, const int &x) { return total + x; };
+  auto identity = [](const int &x) { return x; };
+  REQUIRE(fcpp::query(std::vector<int>({1, 5, 12, 3, 25}))
+              .lazy(/*morsel_size=*/1)
+              .window_by(identity, 10)
+              .aggregate(0, sum)
+              .to_vector() == std::vector<Window>({
+                                  {{}, 0, 10, 6, 2},
+                                  {{}, 10, 20, 12, 1},
+                                  {{}, 20, 30, 25, 1},
+                              }));
+  REQUIRE(fcpp::query(std::vector<int>({1, 5, 12, 3, 25}))
+              .lazy(/*morsel_size=*/1)
+              .window_by(identity, 10)
+              .allowed_lateness(5)
+              .aggregate(0, sum)
+              .to_vector() == std::vector<Window>({
+                                  {{}, 0, 10, 9, 3},
+                                  {{}, 10, 20, 12, 1},
+                                  {{}, 20, 30, 25, 1},
+                              }));
+  REQUIRE(fcpp::query(std::vector<int>({1, 7, 12}))
+              .lazy()
+              .window_by(identity, 10)
+              .every(5)
+              .aggregate(0, sum)
+              .to_vector() == std::vector<Window>({
+                                  {{}, -5, 5, 1, 1},
+                                  {{}, 0, 10, 8, 2},
+                                  {{}, 5, 15, 19, 2},
+                                  {{}, 10, 20, 12, 1},
+                              }));
+  REQUIRE_THROWS_AS(
+      fcpp::query(std::vector<int>({1}))
+          .lazy()
+          .window_by(identity, 0)
+          .aggregate(0, sum),
+      std::invalid_argument);
+}
+
+TEST_CASE("lazy window_by unsigned") {
+  using Window = fcpp::window::Window<uint64_t, int>;
+  auto sum = [](int total, const uint64_t &x) {
+    return total + static_cast<int>(x);
+  };
+  auto identity = [](const uint64_t &x) { return x; };
+  // Windows and watermarks before zero must not wrap around.
+  REQUIRE(fcpp::query(std::vector<uint64_t>({1, 5, 12, 3, 25}))
+              .lazy(/*morsel_size=*/1)
+              .window_by(identity, 10)
+              .allowed_lateness(5)
+              .aggregate(0, sum)
+              .to_vector() == std::vector<Window>({
+                                  {{}, 0, 10, 9, 3},
+                                  {{}, 10, 20, 12, 1},
+                                  {{}, 20, 30, 25, 1},
+                              }));
+  REQUIRE(fcpp::query(std::vector<uint64_t>({1, 7, 12}))
+              .lazy()
+              .window_by(identity, 10)
+              .every(5)
+              .aggregate(0, sum)
+              .to_vector() == std::vector<Window>({
+                                  {{}, 0, 10, 8, 2},
+                                  {{}, 5, 15, 19, 2},
+                                  {{}, 10, 20, 12, 1},
+                              }));
+}
+
+TEST_CASE("lazy window_by key") {
+  using namespace std::chrono_literals;
+  struct Event {
+    std::chrono::sys_seconds time;
+    char key;
+  };
+  using Window = fcpp::window::Window<std::chrono::sys_seconds, int, char>;
+  std::chrono::sys_seconds epoch{};
+  auto count = [](int total, const Event &) { return total + 1; };
+  REQUIRE(fcpp::query(std::vector<Event>({
+                          {epoch + 1s, 'b'},
+                          {epoch + 30s, 'a'},
+                          {epoch + 45s, 'b'},
+                          {epoch + 61s, 'a'},
+                      }))
+              .lazy()
+              .window_by([](const Event &e) { return e.time; }, 1min)
+              .by([](const Event &e) { return e.key; })
+              .aggregate(0, count)
+              .to_vector() == std::vector<Window>({
+                                  {'a', epoch, epoch + 60s, 1, 1},
+                                  {'b', epoch, epoch + 60s, 2, 2},
+                                  {'a', epoch + 60s, epoch + 120s, 1, 1},
+                              }));
+}
+
+TEST_CASE("lazy session_by") {
+  using Window = fcpp::window::Window<int, int, char>;
+  auto count = [](int total, const std::pair<int, char> &) {
+    return total + 1;
+  };
+  REQUIRE(fcpp::query(std::vector<std::pair<int, char>>({
+                          {1, 'a'},
+                          {3, 'a'},
+                          {4, 'b'},
+                          {20, 'a'},
+                          {22, 'b'},
+                      }))
+              .lazy()
+              .session_by([](const auto &x) { return x.first; }, 5)
+              .by([](const auto &x) { return x.second; })
+              .aggregate(0, count)
+              .to_vector() == std::vector<Window>({
+                                  {'a', 1, 8, 2, 2},
+                                  {'b', 4, 9, 1, 1},
+                                  {'a', 20, 25, 1, 1},
+                                  {'b', 22, 27, 1, 1},
+                              }));
+  REQUIRE_THROWS_AS(
+      fcpp::query(std::vector<std::pair<int, char>>())
+          .lazy()
+          .session_by([](const auto &x) { return x.first; }, 5)
+          .every(1),
+      std::invalid_argument);
+}
+
+TEMPLATE_TEST_CASE("lazy empty", "", Object, NonCopyObject) {
+  REQUIRE(fcpp::query(std::vector<TestType>()).lazy().to_vector().empty());
+}
+
+TEMPLATE_TEST_CASE("query generator", "", Object, NonCopyObject) {
+  REQUIRE(fcpp::query(Naturals<TestType>(), /*morsel_size=*/4)
+              .where([](const auto &x) { return x.value % 2 == 0; })
+              .take(5)
+              .to_vector() == Create<TestType>({0, 2, 4, 6, 8}));
+  REQUIRE(fcpp::query(Naturals<TestType>())
+              .first_or_default([](const auto &x) { return x > 100; }) == 101);
+  REQUIRE(fcpp::query(Naturals<TestType>())
+              .select([](auto &&x) { return x.value; })
+              .any([](const int &x) { return x == 3; }));
+}
+
+TEST_CASE("query generator finite") {
+  auto letters = []() -> fcpp::Generator<std::string> {
+    for (char letter = 'a'; letter <= 'c'; letter++) {
+      co_yield std::string(1, letter);
+    }
+  };
+  REQUIRE(fcpp::query(letters(), /*morsel_size=*/2).to_vector() ==
+          std::vector<std::string>({"a", "b", "c"}));
+  REQUIRE_THROWS_AS(
+      fcpp::query(Throwing()).to_vector(), std::invalid_argument);
+}
+
+TEST_CASE("query_lines") {
+  auto path = std::filesystem::temp_directory_path() / "fcpp_query_lines.txt";
+  {
+    std::ofstream file(path);
+    file << "a\nbb\n\nccc\n";
+  }
+
+  REQUIRE(fcpp::query_lines(path, /*morsel_size=*/2)
+              .select([](auto &&line) { return line.size(); })
+              .to_vector() == std::vector<size_t>({1, 2, 0, 3}));
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("query_lines missing") {
+  REQUIRE_THROWS_AS(
+      fcpp::query_lines("/nonexistent/fcpp_query_lines.txt"),
+      std::invalid_argument);
+}
+
+TEST_CASE("query_mmap") {
+  struct Tick {
+    int id;
+    double price;
+  };
+  auto path = std::filesystem::temp_directory_path() / "fcpp_query_mmap.bin";
+  {
+    std::vector<Tick> ticks({{1, 1.5}, {2, 2.5}, {3, 3.5}});
+    std::ofstream file(path, std::ios::binary);
+    file.write(
+        reinterpret_cast<const char *>(ticks.data()),
+        ticks.size() * sizeof(Tick));
+  }
+
+  auto ticks = fcpp::query_mmap<Tick>(path, {.will_need = true});
+  REQUIRE(ticks.size() == 3);
+  REQUIRE(
+      ticks.accumulate(0.0, [](double sum, const Tick &tick) {
+        return sum + tick.price;
+      }) == 7.5);
+  REQUIRE(ticks.skip(1).take(1).span().front().id == 2);
+  REQUIRE(
+      ticks.where([](const Tick &tick) { return tick.id != 2; })
+          .select([](const Tick &tick) { return tick.id; })
+          .to_vector() == std::vector<int>({1, 3}));
+  REQUIRE(
+      ticks.lazy(/*morsel_size=*/2)
+          .select([](const Tick &tick) { return tick.id; })
+          .to_vector() == std::vector<int>({1, 2, 3}));
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("query_mmap empty") {
+  auto path = std::filesystem::temp_directory_path() / "fcpp_query_mmap.bin";
+  std::ofstream(path).close();
+
+  REQUIRE(fcpp::query_mmap<int>(path).empty());
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("query_mmap partial record") {
+  auto path = std::filesystem::temp_directory_path() / "fcpp_query_mmap.bin";
+  std::ofstream(path) << "abcde";
+
+  REQUIRE_THROWS_AS(fcpp::query_mmap<int>(path), std::invalid_argument);
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("query span") {
+  std::vector<int> items({3, 1, 2});
+
+  auto queried = fcpp::query(std::span<const int>(items));
+  REQUIRE(queried.max() == 3);
+  REQUIRE(queried.min() == 1);
+  REQUIRE(queried.any(EXPR(x, x == 2)));
+  REQUIRE(queried.select(EXPR(x, x * 2)).to_vector() ==
+          std::vector<int>({6, 2, 4}));
+  REQUIRE(items == std::vector<int>({3, 1, 2}));
+}
+
+TEST_CASE("query_stream") {
+  std::istringstream input("1\n2\n3\n4\n5\n6\n");
+  size_t parsed = 0;
+
+  REQUIRE(fcpp::query_stream(
+              input,
+              [&parsed](const std::string &line) {
+                parsed++;
+                return std::stoi(line);
+              },
+              /*morsel_size=*/2)
+              .where(EXPR(x, x % 2 == 0))
+              .take(2)
+              .to_vector() == std::vector<int>({2, 4}));
+  // Lines of the last morsel pulled are read, nothing after it.
+  REQUIRE(parsed == 4);
+  REQUIRE(input.good());
+}
+
 TEMPLATE_TEST_CASE("max", "", Object, NonCopyObject) {
   REQUIRE(fcpp::query(Create<TestType>({1, 3, 2})).max() == 3);
 }
@@ -241,6 +1293,78 @@ TEMPLATE_TEST_CASE("order_by", "", Object, NonCopyObject) {
               .to_vector() == Create<TestType>({2, 1, 3}));
 }
 
+#ifdef FCPP_PROFILING
+TEST_CASE("profile") {
+  auto profiled = fcpp::query(std::vector<int>({1, 2, 3, 4, 5, 6}))
+                      .profile()
+                      .where([](const int &x) { return x % 2 == 0; })
+                      .select([](int x) { return std::to_string(x); })
+                      .take(2);
+  REQUIRE(profiled.to_vector() == std::vector<std::string>({"2", "4"}));
+
+  const auto &operators = profiled.profiling()->operators();
+  REQUIRE(operators.size() == 3);
+  REQUIRE(operators[0].name == "where");
+  REQUIRE(operators[0].rows_in == 6);
+  REQUIRE(operators[0].rows_out == 3);
+  REQUIRE(operators[1].name == "select");
+  REQUIRE(operators[1].allocations.count >= 1);
+  REQUIRE(operators[2].name == "take");
+  REQUIRE(operators[2].rows_out == 2);
+
+  std::ostringstream report;
+  profiled.report(report);
+  REQUIRE(report.str().find("select") != std::string::npos);
+
+  fcpp::profile::Allocations before = fcpp::profile::allocations();
+  std::vector<int> grown;
+  for (int i = 0; i < 100; i++) {
+    grown.push_back(i);
+  }
+  fcpp::profile::Allocations after = fcpp::profile::allocations();
+  REQUIRE(after.count > before.count);
+  // Every growth after the first allocation replaces the previous buffer.
+  REQUIRE(
+      after.reallocations - before.reallocations ==
+      after.count - before.count - 1);
+
+  auto unprofiled = fcpp::query(std::vector<int>({1})).reverse();
+  REQUIRE(unprofiled.profiling() == nullptr);
+  REQUIRE_THROWS_AS(unprofiled.report(report), std::invalid_argument);
+}
+#endif
+
+#ifdef FCPP_TRACING
+TEST_CASE("trace") {
+  fcpp::trace::start();
+  auto result = fcpp::query(std::vector<int>({1, 2, 3, 4}))
+                    .where([](int x) { return x % 2 == 0; })
+                    .lazy(/*morsel_size=*/1)
+                    .parallel(/*max_in_flight=*/2)
+                    .to_vector();
+  fcpp::trace::stop();
+  REQUIRE(result == std::vector<int>({2, 4}));
+
+  std::ostringstream trace;
+  fcpp::trace::write(trace);
+  std::string events = trace.str();
+  REQUIRE(events.find("\"traceEvents\"") != std::string::npos);
+  REQUIRE(events.find("\"name\":\"where\"") != std::string::npos);
+  REQUIRE(
+      events.find("\"args\":{\"rows_in\":4,\"rows_out\":2}") !=
+      std::string::npos);
+  REQUIRE(events.find("\"name\":\"morsel\"") != std::string::npos);
+  REQUIRE(events.find("\"items\":1") != std::string::npos);
+  REQUIRE(events.find("\"name\":\"task\"") != std::string::npos);
+
+  // Nothing is recorded once stopped.
+  fcpp::query(std::vector<int>({1})).reverse();
+  std::ostringstream stopped;
+  fcpp::trace::write(stopped);
+  REQUIRE(stopped.str() == events);
+}
+#endif
+
 TEMPLATE_TEST_CASE("reverse", "", Object, NonCopyObject) {
   REQUIRE(fcpp::query(Create<TestType>({1, 2, 3})).reverse().to_vector() ==
           Create<TestType>({3, 2, 1}));
@@ -257,6 +1381,16 @@ TEMPLATE_TEST_CASE("select", "", Object, NonCopyObject) {
               .to_vector() == Create<TestType>({101, 102, 103}));
 }
 
+TEMPLATE_TEST_CASE("select_many", "", Object, NonCopyObject) {
+  REQUIRE(fcpp::query(Create<TestType>({1, 2, 3}))
+              .select_many([](auto &&x) {
+                return Create<TestType>(
+                    {x.value, x.value * 10, x.value * 100});
+              })
+              .to_vector() ==
+          Create<TestType>({1, 10, 100, 2, 20, 200, 3, 30, 300}));
+}
+
 TEMPLATE_TEST_CASE("shuffle", "", Object, NonCopyObject) {
   REQUIRE_FALSE(
       fcpp::query(Create<TestType>({1, 2, 3, 4, 5, 6, 7, 8, 9})).shuffle() ==
@@ -379,6 +1513,75 @@ TEMPLATE_TEST_CASE("zip", "", Object, NonCopyObject) {
               .to_vector() == expected);
 }
 
+TEMPLATE_TEST_CASE("zip first", "", Object, NonCopyObject) {
+  REQUIRE(fcpp::query(Create<TestType>({1, 2}))
+              .zip(Create<TestType>({5, 6, 7}), /*truncate=*/false)
+              .first()
+              .to_vector() == Create<TestType>({1, 2}));
+}
+
+TEST_CASE("zip no default constructor") {
+  struct Item {
+    explicit Item(int value) : value(value) {}
+    int value;
+  };
+  std::vector<Item> items;
+  items.push_back(Item(1));
+
+  auto zipped = fcpp::query(std::move(items))
+                    .zip(std::vector<int>({5, 6}), /*truncate=*/false);
+
+  REQUIRE(zipped.size() == 2);
+  REQUIRE(zipped.has_first(0));
+  REQUIRE_FALSE(zipped.has_first(1));
+  REQUIRE(zipped.has_second(1));
+  REQUIRE(zipped.second().to_vector() == std::vector<int>({5, 6}));
+}
+
+TEST_CASE("zip no default constructor padded") {
+  struct Item {
+    explicit Item(int value) : value(value) {}
+    int value;
+  };
+  std::vector<Item> items;
+  items.push_back(Item(1));
+
+  // Padded positions are given as nullptr rather than default constructed.
+  REQUIRE(fcpp::query(std::move(items))
+              .zip(std::vector<int>({5, 6}), /*truncate=*/false)
+              .select_present([](std::tuple<Item *, int *> x) {
+                auto [first, second] = x;
+                return (first != nullptr ? first->value : -1) + *second;
+              })
+              .to_vector() == std::vector<int>({6, 5}));
+}
+
+TEST_CASE("zip chained") {
+  using Pair = std::tuple<int, int>;
+  auto zipped = fcpp::query(std::vector<int>({1, 2, 3}))
+                    .zip(std::vector<int>({6, 5, 4}), /*truncate=*/false);
+  REQUIRE(zipped == std::vector<Pair>({{1, 6}, {2, 5}, {3, 4}}));
+  // Filtered in place, then converted to tuples to be ordered.
+  fcpp::Queryable<Pair> filtered =
+      zipped.where([](const auto &x) { return std::get<0>(x) > 1; });
+  REQUIRE(filtered.order_by([](const Pair &x) { return std::get<1>(x); })
+              .to_vector() == std::vector<Pair>({{3, 4}, {2, 5}}));
+
+  REQUIRE(fcpp::query(std::vector<int>({1, 2}))
+              .join(
+                  std::vector<int>({2, 4}), EXPR(x, x % 2 == 0),
+                  EXPR(x, x % 2 == 0))
+              .take(1)
+              .to_vector() == std::vector<Pair>({{2, 2}}));
+
+  REQUIRE(fcpp::query(std::vector<int>({1, 2, 3}))
+              .branch(EXPR(x, x > 1))
+              .when_true([](auto q) { return q; })
+              .when_false([](auto q) { return q; })
+              .merge()
+              .skip(1) == std::vector<Pair>({{3, 0}}));
+}
+
 TEMPLATE_TEST_CASE("zip truncate", "", Object, NonCopyObject) {
   std::vector<std::tuple<TestType, TestType>> expected;
   expected.push_back({1, 5});
@@ -391,6 +1594,70 @@ TEMPLATE_TEST_CASE("zip truncate", "", Object, NonCopyObject) {
               .to_vector() == expected);
 }
 
+TEST_CASE("spsc_queue") {
+  scheduler::SpscQueue<std::unique_ptr<int>> queue(/*capacity=*/3);
+  std::thread producer([&queue]() {
+    for (int i = 0; i < 10000; i++) {
+      queue.push(std::make_unique<int>(i));
+    }
+    queue.close();
+  });
+  std::vector<int> popped;
+  while (std::optional<std::unique_ptr<int>> item = queue.pop()) {
+    popped.push_back(**item);
+  }
+  producer.join();
+  std::vector<int> expected(10000);
+  std::iota(expected.begin(), expected.end(), 0);
+  REQUIRE(popped == expected);
+
+  scheduler::SpscQueue<int> cancelled(/*capacity=*/1);
+  REQUIRE(cancelled.push(1));
+  cancelled.cancel();
+  REQUIRE_FALSE(cancelled.push(2));
+  REQUIRE_THROWS_AS(scheduler::SpscQueue<int>(0), std::invalid_argument);
+}
+
+TEST_CASE("task_graph dependencies") {
+  std::mutex mutex;
+  std::vector<int> order;
+  auto record = [&](int id) {
+    return [&, id]() {
+      std::lock_guard<std::mutex> lock(mutex);
+      order.push_back(id);
+    };
+  };
+
+  scheduler::TaskGraph graph;
+  auto lhs = graph.add(record(1));
+  auto rhs = graph.add(record(2));
+  auto joined = graph.add(record(3), {lhs, rhs});
+  graph.add(record(4), {joined});
+  graph.run();
+
+  REQUIRE(order.size() == 4);
+  REQUIRE(std::set<int>(order.begin(), order.begin() + 2) ==
+          std::set<int>({1, 2}));
+  REQUIRE(order[2] == 3);
+  REQUIRE(order[3] == 4);
+}
+
+TEST_CASE("task_graph exception") {
+  std::atomic<bool> dependent_ran = false;
+
+  scheduler::TaskGraph graph;
+  auto failing = graph.add([]() { throw std::runtime_error("failing"); });
+  graph.add([&]() { dependent_ran = true; }, {failing});
+
+  REQUIRE_THROWS_AS(graph.run(), std::runtime_error);
+  REQUIRE_FALSE(dependent_ran);
+}
+
+TEST_CASE("task_graph forward dependency") {
+  scheduler::TaskGraph graph;
+  REQUIRE_THROWS_AS(graph.add([]() {}, {0}), std::invalid_argument);
+}
+
 } // namespace
 
 } // namespace fcpp::tests
\ No newline at end of file